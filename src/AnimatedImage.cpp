@@ -15,7 +15,7 @@ AnimatedImage::AnimatedImage(const string& fileName, int frameWidth,
      frameHeight(frameHeight),
      frameCount(frameCount),
      currFrame(0),
-     m_texture(Texture::Load(fileName))
+     m_texture(Texture::LoadSprite(fileName))
 {
    if (frameCount == 0) {
       if (m_texture.GetWidth() % frameWidth != 0) {
@@ -29,12 +29,12 @@ AnimatedImage::AnimatedImage(const string& fileName, int frameWidth,
       this->frameCount = FramesPerRow() * FramesPerCol();
    }
 
-   VertexI *vertexBuf = new VertexI[4 * frameCount];
+   m_quads.resize(4 * this->frameCount);
 
    const int texWidth = m_texture.GetWidth();
    const int texHeight = m_texture.GetHeight();
 
-   for (int i = 0; i < frameCount; i++) {
+   for (int i = 0; i < this->frameCount; i++) {
       int frameX = i % FramesPerRow();
       int frameY = i / FramesPerRow();
 
@@ -44,6 +44,12 @@ AnimatedImage::AnimatedImage(const string& fileName, int frameWidth,
       float tex_t = ((float)(frameY * frameHeight))/(float)texHeight;
       float tex_b = tex_t + (float)frameHeight/(float)texHeight;
 
+      // The image may be a region of an atlas texture
+      tex_l = m_texture.MapU(tex_l);
+      tex_r = m_texture.MapU(tex_r);
+      tex_t = m_texture.MapV(tex_t);
+      tex_b = m_texture.MapV(tex_b);
+
       const VertexI vertices[4] = {
          { -(frameWidth/2), -(frameHeight/2), tex_l, tex_t },
          { -(frameWidth/2), frameHeight/2, tex_l, tex_b },
@@ -51,12 +57,8 @@ AnimatedImage::AnimatedImage(const string& fileName, int frameWidth,
          { frameWidth/2, -frameHeight/2, tex_r, tex_t }
       };
 
-      copy(vertices, vertices + 4, vertexBuf + i*4);
+      copy(vertices, vertices + 4, m_quads.begin() + i*4);
    }
-
-   m_vbo = VertexBuffer::Make(vertexBuf, 4 * frameCount);
-
-   delete[] vertexBuf;
 }
 
 // Draw a particular frame
@@ -65,15 +67,11 @@ void AnimatedImage::DrawFrame(int frame, int x, int y, float rotate,
 {
    assert(frame >= 0 && frame < frameCount);
 
-   OpenGL& opengl = OpenGL::GetInstance();
-
-   opengl.SetTexture(m_texture);
-   opengl.SetScale(scale);
-   opengl.SetColour(white, white, white, alpha);
-   opengl.SetRotation(rotate);
-   opengl.SetTranslation(x + frameWidth/2, y + frameHeight/2);
+   SpriteBatch& sprites = OpenGL::GetInstance().GetSpriteBatch();
 
-   opengl.Draw(m_vbo, frame * 4, 4);
+   sprites.Add(m_texture, &m_quads[frame * 4],
+               x + frameWidth/2, y + frameHeight/2, rotate, scale,
+               Colour::Make(white, white, white, alpha));
 }
 
 // Draw the current frame
@@ -29,5 +29,5 @@ private:
    int frameWidth, frameHeight, frameCount;
    int currFrame;
    Texture m_texture;
-   VertexBuffer m_vbo;
+   vector<VertexI> m_quads;
 };
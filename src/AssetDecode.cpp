@@ -0,0 +1,69 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "AssetDecode.hpp"
+
+#include <algorithm>
+
+#include <SDL_image.h>
+
+void DecodeImage(const string& path, ImageData& out)
+{
+   SDL_Surface *surface = IMG_Load(path.c_str());
+   if (surface == NULL)
+      Die("Failed to load image %s: %s", path.c_str(), IMG_GetError());
+
+   SDL_Surface *rgba =
+      SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0);
+   if (rgba == NULL)
+      Die("Failed to convert image %s: %s", path.c_str(), SDL_GetError());
+
+   out.width = rgba->w;
+   out.height = rgba->h;
+   out.texels.resize(rgba->w * rgba->h * 4);
+
+   // Remove any row padding
+   for (int y = 0; y < rgba->h; y++) {
+      const uint8_t *row = static_cast<const uint8_t*>(rgba->pixels)
+         + y * rgba->pitch;
+      copy(row, row + rgba->w * 4, out.texels.begin() + y * rgba->w * 4);
+   }
+
+   SDL_FreeSurface(rgba);
+   SDL_FreeSurface(surface);
+}
+
+void DecodeSound(const string& path, SoundData& out)
+{
+   SDL_AudioSpec spec;
+   Uint8 *buf;
+   Uint32 len;
+   if (SDL_LoadWAV(path.c_str(), &spec, &buf, &len) == NULL)
+      Die("Failed to load sound %s: %s", path.c_str(), SDL_GetError());
+
+   SDL_AudioCVT cvt;
+   if (SDL_BuildAudioCVT(&cvt, spec.format, spec.channels, spec.freq,
+                         PCM_FORMAT, PCM_CHANNELS, PCM_RATE) < 0)
+      Die("Cannot convert %s: %s", path.c_str(), SDL_GetError());
+
+   out.samples.resize(len * max(cvt.len_mult, 1));
+   copy(buf, buf + len, out.samples.begin());
+   SDL_FreeWAV(buf);
+
+   if (cvt.needed) {
+      cvt.buf = out.samples.data();
+      cvt.len = len;
+      if (SDL_ConvertAudio(&cvt) < 0)
+         Die("Cannot convert %s: %s", path.c_str(), SDL_GetError());
+
+      out.samples.resize(cvt.len_cvt);
+   }
+   else
+      out.samples.resize(len);
+
+   out.rate = PCM_RATE;
+   out.format = PCM_FORMAT;
+   out.channels = PCM_CHANNELS;
+}
@@ -0,0 +1,41 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#pragma once
+
+#include "Platform.hpp"
+
+#include <vector>
+#include <cstdint>
+
+//
+// Decoding of asset files into the form they are uploaded in. None of
+// this touches OpenGL or the mixer so it may be run on any thread.
+//
+
+// Image with RGBA texels and no padding between rows
+struct ImageData {
+   int width = 0, height = 0;
+   vector<uint8_t> texels;
+};
+
+struct SoundData {
+   int rate = 0, channels = 0;
+   uint16_t format = 0;
+   vector<uint8_t> samples;
+};
+
+// The format sounds are decoded to ahead of time, which is the format
+// the mixer is opened with by default
+const int PCM_RATE = 44100;
+const uint16_t PCM_FORMAT = AUDIO_S16SYS;
+const int PCM_CHANNELS = 2;
+
+// The game's font and the sizes it is created at
+const char *const FONT_FILE = "fonts/VeraBd.ttf";
+const unsigned FONT_SIZES[] = { 11, 12, 14, 15, 16, 20 };
+
+void DecodeImage(const string& path, ImageData& out);
+void DecodeSound(const string& path, SoundData& out);
@@ -0,0 +1,133 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "AssetLoader.hpp"
+#include "AssetPack.hpp"
+#include "ThreadPool.hpp"
+
+#include <iostream>
+#include <filesystem>
+
+AssetLoader& AssetLoader::GetInstance()
+{
+   static AssetLoader loader;
+   return loader;
+}
+
+void AssetLoader::Start()
+{
+   lock_guard<mutex> lock(m_mutex);
+
+   QueueDirectory("images", ".png", &AssetLoader::QueueImage);
+   QueueDirectory("sounds", ".wav", &AssetLoader::QueueSound);
+
+   for (unsigned size : FONT_SIZES)
+      QueueFont(FONT_FILE, size);
+
+   cout << "Decoding " << m_images.size() + m_sounds.size() + m_fonts.size()
+        << " assets on " << ThreadPool::GetInstance().GetThreadCount()
+        << " threads" << endl;
+}
+
+//
+// Discards anything that was decoded but never used.
+//
+void AssetLoader::Finish()
+{
+   lock_guard<mutex> lock(m_mutex);
+
+   m_images.clear();
+   m_sounds.clear();
+   m_fonts.clear();
+}
+
+void AssetLoader::QueueDirectory(const string& dir, const string& extension,
+                                 void (AssetLoader::*queue)(const string&))
+{
+#ifndef MACOSX
+   using filesystem::path;
+   using filesystem::directory_iterator;
+
+   error_code ec;
+   for (const auto& entry : directory_iterator(LocateResource(dir), ec)) {
+      if (entry.path().extension() == extension)
+         (this->*queue)((path(dir) / entry.path().filename()).string());
+   }
+#endif
+}
+
+void AssetLoader::QueueImage(const string& name)
+{
+   if (AssetPack::GetInstance().Find(name, PACK_TEXTURE) != nullptr)
+      return;
+
+   m_images[name] = ThreadPool::GetInstance().Submit([name] {
+      shared_ptr<ImageData> image = make_shared<ImageData>();
+      DecodeImage(LocateResource(name), *image);
+      return shared_ptr<const ImageData>(image);
+   });
+}
+
+void AssetLoader::QueueSound(const string& name)
+{
+   if (AssetPack::GetInstance().Find(name, PACK_SOUND) != nullptr)
+      return;
+
+   m_sounds[name] = ThreadPool::GetInstance().Submit([name] {
+      shared_ptr<SoundData> sound = make_shared<SoundData>();
+      DecodeSound(LocateResource(name), *sound);
+      return shared_ptr<const SoundData>(sound);
+   });
+}
+
+void AssetLoader::QueueFont(const string& name, unsigned size)
+{
+   const string key = AssetPack::FontName(name, size);
+   if (AssetPack::GetInstance().Find(key, PACK_FONT) != nullptr)
+      return;
+
+   m_fonts[key] = ThreadPool::GetInstance().Submit([name, size] {
+      shared_ptr<RasterFont> font = make_shared<RasterFont>();
+      font->Rasterize(LocateResource(name), size);
+      return shared_ptr<const RasterFont>(font);
+   });
+}
+
+template <typename T>
+shared_ptr<const T> AssetLoader::Take(PendingMap<T>& pending,
+                                      const string& name)
+{
+   future<shared_ptr<const T>> result;
+
+   {
+      lock_guard<mutex> lock(m_mutex);
+
+      auto it = pending.find(name);
+      if (it == pending.end())
+         return nullptr;
+
+      result = std::move(it->second);
+      pending.erase(it);
+   }
+
+   // Only blocks if this item has not been decoded yet
+   return result.get();
+}
+
+shared_ptr<const ImageData> AssetLoader::TakeImage(const string& name)
+{
+   return Take(m_images, name);
+}
+
+shared_ptr<const SoundData> AssetLoader::TakeSound(const string& name)
+{
+   return Take(m_sounds, name);
+}
+
+shared_ptr<const RasterFont> AssetLoader::TakeFont(const string& name,
+                                                   unsigned size)
+{
+   return Take(m_fonts, AssetPack::FontName(name, size));
+}
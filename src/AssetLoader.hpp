@@ -0,0 +1,56 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#pragma once
+
+#include "Platform.hpp"
+#include "AssetDecode.hpp"
+#include "FontData.hpp"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <future>
+
+//
+// Decodes images, sounds and fonts on worker threads ahead of the
+// constructors that need them. Start queues every asset that is not
+// already in the asset pack; the loading code then takes the decoded
+// data, waiting only if that item is not ready yet, and performs just
+// the upload itself. Anything not queued returns NULL and is loaded
+// synchronously as before.
+//
+class AssetLoader {
+public:
+   static AssetLoader& GetInstance();
+
+   void Start();
+   void Finish();
+
+   shared_ptr<const ImageData> TakeImage(const string& name);
+   shared_ptr<const SoundData> TakeSound(const string& name);
+   shared_ptr<const RasterFont> TakeFont(const string& name, unsigned size);
+
+private:
+   AssetLoader() = default;
+   AssetLoader(const AssetLoader&) = delete;
+
+   template <typename T>
+   using PendingMap = map<string, future<shared_ptr<const T>>>;
+
+   template <typename T>
+   shared_ptr<const T> Take(PendingMap<T>& pending, const string& name);
+
+   void QueueDirectory(const string& dir, const string& extension,
+                       void (AssetLoader::*queue)(const string&));
+   void QueueImage(const string& name);
+   void QueueSound(const string& name);
+   void QueueFont(const string& name, unsigned size);
+
+   mutex m_mutex;
+   PendingMap<ImageData> m_images;
+   PendingMap<SoundData> m_sounds;
+   PendingMap<RasterFont> m_fonts;
+};
@@ -0,0 +1,199 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "AssetPack.hpp"
+#include "FontData.hpp"
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <cstdlib>
+
+#ifdef UNIX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+AssetPack::AssetPack()
+{
+   // Used by the tests to load a freshly built pack, which must then be
+   // valid, rather than whatever is installed
+   if (const char *override = getenv("LANDER_ASSET_PACK")) {
+      if (!Open(override))
+         Die("Cannot use asset pack %s", override);
+
+      cout << "Using asset pack " << override << endl;
+      return;
+   }
+
+#ifndef MACOSX
+   // The resource bundle lookup on Mac OS X fails hard for missing
+   // files so only loose files are used there
+   const string fileName = LocateResource(FILE_NAME);
+   if (Open(fileName))
+      cout << "Using asset pack " << fileName << endl;
+#endif
+}
+
+AssetPack::~AssetPack()
+{
+   Close();
+}
+
+AssetPack& AssetPack::GetInstance()
+{
+   static AssetPack pack;
+   return pack;
+}
+
+bool AssetPack::Open(const string& fileName)
+{
+#ifdef UNIX
+   const int fd = open(fileName.c_str(), O_RDONLY);
+   if (fd == -1)
+      return false;
+
+   struct stat st;
+   if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(PackHeader)) {
+      close(fd);
+      return false;
+   }
+
+   void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+
+   if (map == MAP_FAILED) {
+      cerr << "Warning: cannot map " << fileName << ": "
+           << strerror(errno) << endl;
+      return false;
+   }
+
+   m_base = static_cast<const uint8_t*>(map);
+   m_size = st.st_size;
+#else
+   FILE *f = fopen(fileName.c_str(), "rb");
+   if (f == NULL)
+      return false;
+
+   fseek(f, 0, SEEK_END);
+   m_buffer.resize(ftell(f));
+   fseek(f, 0, SEEK_SET);
+
+   const size_t nread = fread(m_buffer.data(), 1, m_buffer.size(), f);
+   fclose(f);
+
+   if (nread != m_buffer.size() || nread < sizeof(PackHeader)) {
+      m_buffer.clear();
+      return false;
+   }
+
+   m_base = m_buffer.data();
+   m_size = m_buffer.size();
+#endif
+
+   const PackHeader *header = reinterpret_cast<const PackHeader*>(m_base);
+
+   if (memcmp(header->magic, MAGIC, sizeof(header->magic)) != 0
+       || header->version != FORMAT_VERSION
+       || header->directoryOffset > m_size
+       || header->entryCount > (m_size - header->directoryOffset)
+                               / sizeof(PackEntry)) {
+      cerr << "Warning: ignoring invalid asset pack " << fileName << endl;
+      Close();
+      return false;
+   }
+
+   m_entries =
+      reinterpret_cast<const PackEntry*>(m_base + header->directoryOffset);
+   m_count = header->entryCount;
+
+   for (uint32_t i = 0; i < m_count; i++) {
+      const PackEntry& e = m_entries[i];
+      if (e.offset > m_size || e.size > m_size - e.offset
+          || !CheckEntry(e)
+          || (i > 0 && e.hash < m_entries[i - 1].hash)) {
+         cerr << "Warning: ignoring corrupt asset pack " << fileName << endl;
+         Close();
+         return false;
+      }
+   }
+
+   return true;
+}
+
+//
+// Checks the size of an entry matches what its parameters say it holds
+// so that nothing reads past the end of it.
+//
+bool AssetPack::CheckEntry(const PackEntry& entry)
+{
+   switch (entry.kind) {
+   case PACK_TEXTURE:
+      {
+         const uint64_t width = entry.params[0];
+         const uint64_t height = entry.params[1];
+         return width > 0 && height > 0 && entry.size == width * height * 4;
+      }
+
+   case PACK_SOUND:
+      {
+         const uint64_t frame =
+            SDL_AUDIO_BITSIZE(entry.params[1]) / 8 * entry.params[2];
+         return frame > 0 && entry.size % frame == 0;
+      }
+
+   case PACK_FONT:
+      {
+         // Glyph table followed by luminance and alpha texels
+         const uint64_t cellSize = entry.params[0];
+         const uint64_t textureWidth = entry.params[1];
+         return cellSize > 0 && textureWidth > 0
+            && entry.size == sizeof(FontGlyph) * RasterFont::MAX_CHAR
+                             + 2 * cellSize * textureWidth;
+      }
+
+   default:
+      return false;
+   }
+}
+
+void AssetPack::Close()
+{
+#ifdef UNIX
+   if (m_base != nullptr)
+      munmap(const_cast<uint8_t*>(m_base), m_size);
+#else
+   m_buffer.clear();
+#endif
+
+   m_base = nullptr;
+   m_size = 0;
+   m_entries = nullptr;
+   m_count = 0;
+}
+
+const PackEntry *AssetPack::Find(const string& name, PackKind kind) const
+{
+   const uint64_t hash = Hash(name);
+
+   const PackEntry *end = m_entries + m_count;
+   const PackEntry *it = lower_bound(
+      m_entries, end, hash,
+      [](const PackEntry& e, uint64_t h) { return e.hash < h; });
+
+   if (it != end && it->hash == hash && it->kind == kind)
+      return it;
+   else
+      return nullptr;
+}
+
+const void *AssetPack::GetData(const PackEntry *entry) const
+{
+   return m_base + entry->offset;
+}
@@ -0,0 +1,95 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#pragma once
+
+#include "Platform.hpp"
+
+#include <vector>
+#include <cstdint>
+
+//
+// Kinds of asset stored in a pack and the meaning of their parameters.
+//
+enum PackKind : uint32_t {
+   PACK_TEXTURE = 1,    // RGBA texels: width, height
+   PACK_SOUND = 2,      // PCM samples: frequency, format, channels
+   PACK_FONT = 3,       // Glyph table then texels: cell size, texture width
+};
+
+struct PackHeader {
+   char magic[8];
+   uint32_t version;
+   uint32_t entryCount;
+   uint64_t directoryOffset;
+};
+
+//
+// The directory at the end of the pack is sorted by hash.
+//
+struct PackEntry {
+   uint64_t hash;
+   uint64_t offset;
+   uint64_t size;
+   uint32_t kind;
+   uint32_t params[3];
+};
+
+//
+// A single file of assets decoded ahead of time by lander-pack into the
+// form they are uploaded in. The file is mapped into memory and assets
+// are used directly from the mapping. When there is no pack every
+// lookup fails and the individual files are loaded instead.
+//
+class AssetPack {
+public:
+   static AssetPack& GetInstance();
+
+   const PackEntry *Find(const string& name, PackKind kind) const;
+   const void *GetData(const PackEntry *entry) const;
+
+   static uint64_t Hash(const string& name);
+   static string FontName(const string& file, unsigned size);
+
+   static constexpr char MAGIC[9] = "LNDRPAK1";
+   static const uint32_t FORMAT_VERSION = 1;
+   static constexpr const char *FILE_NAME = "lander.pak";
+
+private:
+   AssetPack();
+   AssetPack(const AssetPack&) = delete;
+   ~AssetPack();
+
+   bool Open(const string& fileName);
+   void Close();
+
+   static bool CheckEntry(const PackEntry& entry);
+
+   const uint8_t *m_base = nullptr;
+   size_t m_size = 0;
+   const PackEntry *m_entries = nullptr;
+   uint32_t m_count = 0;
+#ifndef UNIX
+   vector<uint8_t> m_buffer;
+#endif
+};
+
+//
+// 64-bit FNV-1a hash of a resource name.
+//
+inline uint64_t AssetPack::Hash(const string& name)
+{
+   uint64_t hash = 0xcbf29ce484222325ull;
+   for (char c : name) {
+      hash ^= static_cast<uint8_t>(c);
+      hash *= 0x100000001b3ull;
+   }
+   return hash;
+}
+
+inline string AssetPack::FontName(const string& file, unsigned size)
+{
+   return file + ":" + to_string(size);
+}
@@ -4,20 +4,26 @@
 //
 
 #include "Asteroid.hpp"
+#include "SimContext.hpp"
 #include "OpenGL.hpp"
 #include "Ship.hpp"
 
 #include <string>
 #include <cassert>
 #include <stdexcept>
+#include <climits>
 
-Asteroid::Asteroid(int x, int y, int width, int surftex)
-   : StaticObject(x, y, width, 4),
-     m_texture(Texture::Load(SurfaceFileName(surftex)))
+//
+// Generates a random outline. This may be called on any thread.
+//
+void Asteroid::Generate(int width, Shape& shape)
 {
-   assert(width > 0);
+   assert(width > 0 && width <= MAX_ASTEROID_WIDTH);
 
-   const int texLoopInit = rand() % 10;
+   AsteroidSection *uppolys = shape.uppolys, *downpolys = shape.downpolys;
+   shape.width = width;
+
+   const int texLoopInit = SimContext::Current().Rand() % 10;
 
    int change, texloop = texLoopInit;
 
@@ -36,14 +42,14 @@ Asteroid::Asteroid(int x, int y, int width, int surftex)
       // Upper left vertex
       uppolys[i].points[1].x = i * OBJ_GRID_SIZE;
       if (i == 0)
-         uppolys[i].points[1].y = rand() % (2 * OBJ_GRID_SIZE);
+         uppolys[i].points[1].y = SimContext::Current().Rand() % (2 * OBJ_GRID_SIZE);
       else
          uppolys[i].points[1].y = uppolys[i - 1].points[2].y;
 
       // Upper right vertex
       uppolys[i].points[2].x = (i + 1) * OBJ_GRID_SIZE;
       do
-         change = uppolys[i].points[1].y + (rand() % AS_VARIANCE) - (AS_VARIANCE / 2);
+         change = uppolys[i].points[1].y + (SimContext::Current().Rand() % AS_VARIANCE) - (AS_VARIANCE / 2);
       while (change < 0 || change > 2 * OBJ_GRID_SIZE);
       uppolys[i].points[2].y = change;
 
@@ -72,14 +78,14 @@ Asteroid::Asteroid(int x, int y, int width, int surftex)
       // Lower left vertex
       downpolys[i].points[1].x = i * OBJ_GRID_SIZE;
       if (i == 0)
-         downpolys[i].points[1].y = rand() % (2 * OBJ_GRID_SIZE);
+         downpolys[i].points[1].y = SimContext::Current().Rand() % (2 * OBJ_GRID_SIZE);
       else
          downpolys[i].points[1].y = downpolys[i - 1].points[2].y;
 
       // Lower right vertex
       downpolys[i].points[2].x = (i + 1) * OBJ_GRID_SIZE;
       do
-         change = downpolys[i].points[1].y + (rand() % AS_VARIANCE) - (AS_VARIANCE / 2);
+         change = downpolys[i].points[1].y + (SimContext::Current().Rand() % AS_VARIANCE) - (AS_VARIANCE / 2);
       while (change < 0 || change > 2 * OBJ_GRID_SIZE);
       downpolys[i].points[2].y = change;
 
@@ -91,8 +97,17 @@ Asteroid::Asteroid(int x, int y, int width, int surftex)
    // Taper last poly
    downpolys[width-1].points[2].y = 0;
    downpolys[0].points[1].y = 0;
+}
+
+Asteroid::Asteroid(int x, int y, const Shape& shape, int surftex)
+   : StaticObject(x, y, shape.width, 4),
+     m_texture(Texture::Load(SurfaceFileName(surftex)))
+{
+   copy(shape.uppolys, shape.uppolys + width, uppolys);
+   copy(shape.downpolys, shape.downpolys + width, downpolys);
 
    GenerateDisplayList(surftex);
+   BakeBoundary();
 }
 
 Asteroid::~Asteroid()
@@ -189,15 +204,44 @@ void Asteroid::Draw(int viewadjust_x, int viewadjust_y) const
    opengl.Draw(m_vbo);
 }
 
-bool Asteroid::CheckCollision(const Ship& ship) const
+//
+// The box in level pixels enclosing the whole asteroid.
+//
+Rect Asteroid::GetBounds() const
 {
-   // Look at polys
-   for (int k = 0; k < GetWidth(); k++) {
-      LineSegment l1 = GetUpBoundary(k);
-      LineSegment l2 = GetDownBoundary(k);
+   Rect r;
+   ObjectGrid::Offset(xpos, ypos, &r.x, &r.y);
+   r.w = width * OBJ_GRID_SIZE;
+   r.h = height * OBJ_GRID_SIZE;
+   return r;
+}
 
-      if (ship.HotSpotCollision(l1) || ship.HotSpotCollision(l2))
-         return true;
+//
+// Works out the edges the ship can hit once as the asteroid never moves.
+//
+void Asteroid::BakeBoundary()
+{
+   for (int k = 0; k < width; k++) {
+      m_boundary[k] = GetUpBoundary(k);
+      m_boundary[width + k] = GetDownBoundary(k);
    }
-   return false;
+
+   int left = INT_MAX, top = INT_MAX, right = INT_MIN, bottom = INT_MIN;
+   for (int i = 0; i < width * 2; i++) {
+      const LineSegment& l = m_boundary[i];
+      left = min(left, min(l.p1.x, l.p2.x));
+      right = max(right, max(l.p1.x, l.p2.x));
+      top = min(top, min(l.p1.y, l.p2.y));
+      bottom = max(bottom, max(l.p1.y, l.p2.y));
+   }
+
+   m_hitBox = { left, top, right - left, bottom - top };
+}
+
+bool Asteroid::CheckCollision(const Ship& ship) const
+{
+   if (!ship.IsNear(m_hitBox.x, m_hitBox.y, m_hitBox.w, m_hitBox.h))
+      return false;
+
+   return ship.FirstHotSpotCollision(m_boundary, width * 2) != -1;
 }
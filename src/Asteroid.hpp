@@ -13,30 +13,46 @@
 
 class Asteroid : public StaticObject {
 public:
-   Asteroid(int x, int y, int width, int surftex);
+   static const int MAX_ASTEROID_WIDTH = 15;
+
+   struct AsteroidSection {
+      float texX, texwidth;
+      Point points[4];
+   };
+
+   // The outline of an asteroid which is generated without the GL
+   struct Shape {
+      int width;
+      AsteroidSection uppolys[MAX_ASTEROID_WIDTH];
+      AsteroidSection downpolys[MAX_ASTEROID_WIDTH];
+   };
+
+   static void Generate(int width, Shape& shape);
+
+   Asteroid(int x, int y, const Shape& shape, int surftex);
    Asteroid(Asteroid&& other) = default;
    Asteroid(const Asteroid& other) = delete;
    ~Asteroid();
 
    void Draw(int viewadjust_x, int viewadjust_y) const;
    bool CheckCollision(const Ship& ship) const;
-   LineSegment GetUpBoundary(int poly) const;
-   LineSegment GetDownBoundary(int poly) const;
-
-   static const int MAX_ASTEROID_WIDTH = 15;
+   Rect GetBounds() const;
 
 private:
    static const int AS_VARIANCE = 64;
 
    void GenerateDisplayList(int texidx);
+   void BakeBoundary();
+   LineSegment GetUpBoundary(int poly) const;
+   LineSegment GetDownBoundary(int poly) const;
    static const char *SurfaceFileName(int textureId);
 
    Texture m_texture;
    VertexBuffer m_vbo;
 
-   struct AsteroidSection {
-      float texX, texwidth;
-      Point points[4];
-   };
    AsteroidSection uppolys[MAX_ASTEROID_WIDTH], downpolys[MAX_ASTEROID_WIDTH];
+
+   // Top then bottom edges in level pixels and the box around them
+   LineSegment m_boundary[MAX_ASTEROID_WIDTH * 2];
+   Rect m_hitBox;
 };
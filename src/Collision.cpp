@@ -0,0 +1,200 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "Collision.hpp"
+
+#if defined __AVX__
+#include <immintrin.h>
+#elif defined __SSE2__
+#include <emmintrin.h>
+#endif
+
+//
+// The path of the point from (x, y) to (x + vecX, y + vecY) crosses the
+// segment if the parameters t and u of the intersection are both strictly
+// between zero and one. Where t = numT / denom this is only possible if
+// numT and denom have the same sign and |numT| < |denom|. Checking that
+// first skips the divisions for almost every pair without changing the
+// result: otherwise the quotient is always <= 0 or >= 1 after rounding.
+//
+
+void SweptPoints::Set(int i, double x, double y, double vecX, double vecY)
+{
+   this->x[i] = x;
+   this->y[i] = y;
+   this->vecX[i] = vecX;
+   this->vecY[i] = vecY;
+}
+
+static bool PointHitsSegment(const SweptPoints& pts, int i,
+                             const LineSegment& l)
+{
+   const double wallX = (double)(l.p2.x - l.p1.x);
+   const double wallY = (double)(l.p2.y - l.p1.y);
+
+   const double offX = pts.x[i] - l.p1.x;
+   const double offY = pts.y[i] - l.p1.y;
+
+   const double numT = wallX * offY - wallY * offX;
+   const double numU = pts.vecX[i] * offY - pts.vecY[i] * offX;
+   const double denom = wallY * pts.vecX[i] - wallX * pts.vecY[i];
+
+   const bool maybeT = denom > 0.0
+      ? numT > 0.0 && numT < denom
+      : numT < 0.0 && numT > denom;
+   const bool maybeU = denom > 0.0
+      ? numU > 0.0 && numU < denom
+      : numU < 0.0 && numU > denom;
+   if (!maybeT || !maybeU)
+      return false;
+
+   const double t = numT / denom;
+   const double u = numU / denom;
+   return (t > 0.0) && (t < 1.0) && (u > 0.0) && (u < 1.0);
+}
+
+int FirstSegmentHitScalar(const SweptPoints& pts, const LineSegment* segs,
+                          int count)
+{
+   for (int s = 0; s < count; s++) {
+      for (int i = 0; i < SweptPoints::MAX_POINTS; i++) {
+         if (PointHitsSegment(pts, i, segs[s]))
+            return s;
+      }
+   }
+
+   return -1;
+}
+
+#if defined __AVX__
+
+int FirstSegmentHit(const SweptPoints& pts, const LineSegment* segs,
+                    int count)
+{
+   const __m256d zero = _mm256_setzero_pd();
+   const __m256d one = _mm256_set1_pd(1.0);
+
+   for (int s = 0; s < count; s++) {
+      const LineSegment& l = segs[s];
+      const __m256d wallX = _mm256_set1_pd((double)(l.p2.x - l.p1.x));
+      const __m256d wallY = _mm256_set1_pd((double)(l.p2.y - l.p1.y));
+      const __m256d p1x = _mm256_set1_pd(l.p1.x);
+      const __m256d p1y = _mm256_set1_pd(l.p1.y);
+
+      for (int i = 0; i < SweptPoints::MAX_POINTS; i += 4) {
+         const __m256d vecX = _mm256_load_pd(pts.vecX + i);
+         const __m256d vecY = _mm256_load_pd(pts.vecY + i);
+         const __m256d offX = _mm256_sub_pd(_mm256_load_pd(pts.x + i), p1x);
+         const __m256d offY = _mm256_sub_pd(_mm256_load_pd(pts.y + i), p1y);
+
+         const __m256d numT = _mm256_sub_pd(_mm256_mul_pd(wallX, offY),
+                                            _mm256_mul_pd(wallY, offX));
+         const __m256d numU = _mm256_sub_pd(_mm256_mul_pd(vecX, offY),
+                                            _mm256_mul_pd(vecY, offX));
+         const __m256d denom = _mm256_sub_pd(_mm256_mul_pd(wallY, vecX),
+                                             _mm256_mul_pd(wallX, vecY));
+
+         const __m256d pos = _mm256_cmp_pd(denom, zero, _CMP_GT_OQ);
+         const __m256d inT = _mm256_blendv_pd(
+            _mm256_and_pd(_mm256_cmp_pd(numT, zero, _CMP_LT_OQ),
+                          _mm256_cmp_pd(numT, denom, _CMP_GT_OQ)),
+            _mm256_and_pd(_mm256_cmp_pd(numT, zero, _CMP_GT_OQ),
+                          _mm256_cmp_pd(numT, denom, _CMP_LT_OQ)),
+            pos);
+         const __m256d inU = _mm256_blendv_pd(
+            _mm256_and_pd(_mm256_cmp_pd(numU, zero, _CMP_LT_OQ),
+                          _mm256_cmp_pd(numU, denom, _CMP_GT_OQ)),
+            _mm256_and_pd(_mm256_cmp_pd(numU, zero, _CMP_GT_OQ),
+                          _mm256_cmp_pd(numU, denom, _CMP_LT_OQ)),
+            pos);
+         if (_mm256_movemask_pd(_mm256_and_pd(inT, inU)) == 0)
+            continue;
+
+         const __m256d t = _mm256_div_pd(numT, denom);
+         const __m256d u = _mm256_div_pd(numU, denom);
+         const __m256d hit = _mm256_and_pd(
+            _mm256_and_pd(_mm256_cmp_pd(t, zero, _CMP_GT_OQ),
+                          _mm256_cmp_pd(t, one, _CMP_LT_OQ)),
+            _mm256_and_pd(_mm256_cmp_pd(u, zero, _CMP_GT_OQ),
+                          _mm256_cmp_pd(u, one, _CMP_LT_OQ)));
+         if (_mm256_movemask_pd(hit) != 0)
+            return s;
+      }
+   }
+
+   return -1;
+}
+
+#elif defined __SSE2__
+
+//
+// Selects lanes of a where mask is set and b otherwise. There is no
+// blend instruction before SSE4.1.
+//
+static inline __m128d Select(__m128d mask, __m128d a, __m128d b)
+{
+   return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+}
+
+int FirstSegmentHit(const SweptPoints& pts, const LineSegment* segs,
+                    int count)
+{
+   const __m128d zero = _mm_setzero_pd();
+   const __m128d one = _mm_set1_pd(1.0);
+
+   for (int s = 0; s < count; s++) {
+      const LineSegment& l = segs[s];
+      const __m128d wallX = _mm_set1_pd((double)(l.p2.x - l.p1.x));
+      const __m128d wallY = _mm_set1_pd((double)(l.p2.y - l.p1.y));
+      const __m128d p1x = _mm_set1_pd(l.p1.x);
+      const __m128d p1y = _mm_set1_pd(l.p1.y);
+
+      for (int i = 0; i < SweptPoints::MAX_POINTS; i += 2) {
+         const __m128d vecX = _mm_load_pd(pts.vecX + i);
+         const __m128d vecY = _mm_load_pd(pts.vecY + i);
+         const __m128d offX = _mm_sub_pd(_mm_load_pd(pts.x + i), p1x);
+         const __m128d offY = _mm_sub_pd(_mm_load_pd(pts.y + i), p1y);
+
+         const __m128d numT = _mm_sub_pd(_mm_mul_pd(wallX, offY),
+                                         _mm_mul_pd(wallY, offX));
+         const __m128d numU = _mm_sub_pd(_mm_mul_pd(vecX, offY),
+                                         _mm_mul_pd(vecY, offX));
+         const __m128d denom = _mm_sub_pd(_mm_mul_pd(wallY, vecX),
+                                          _mm_mul_pd(wallX, vecY));
+
+         const __m128d pos = _mm_cmpgt_pd(denom, zero);
+         const __m128d inT = Select(
+            pos,
+            _mm_and_pd(_mm_cmpgt_pd(numT, zero), _mm_cmplt_pd(numT, denom)),
+            _mm_and_pd(_mm_cmplt_pd(numT, zero), _mm_cmpgt_pd(numT, denom)));
+         const __m128d inU = Select(
+            pos,
+            _mm_and_pd(_mm_cmpgt_pd(numU, zero), _mm_cmplt_pd(numU, denom)),
+            _mm_and_pd(_mm_cmplt_pd(numU, zero), _mm_cmpgt_pd(numU, denom)));
+         if (_mm_movemask_pd(_mm_and_pd(inT, inU)) == 0)
+            continue;
+
+         const __m128d t = _mm_div_pd(numT, denom);
+         const __m128d u = _mm_div_pd(numU, denom);
+         const __m128d hit = _mm_and_pd(
+            _mm_and_pd(_mm_cmpgt_pd(t, zero), _mm_cmplt_pd(t, one)),
+            _mm_and_pd(_mm_cmpgt_pd(u, zero), _mm_cmplt_pd(u, one)));
+         if (_mm_movemask_pd(hit) != 0)
+            return s;
+      }
+   }
+
+   return -1;
+}
+
+#else
+
+int FirstSegmentHit(const SweptPoints& pts, const LineSegment* segs,
+                    int count)
+{
+   return FirstSegmentHitScalar(pts, segs, count);
+}
+
+#endif
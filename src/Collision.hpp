@@ -0,0 +1,35 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#pragma once
+
+#include "Geometry.hpp"
+
+//
+// A set of points that each move by a vector during the next step,
+// stored so all of them can be tested against a segment at once. Unused
+// slots are left with no movement and never collide.
+//
+struct SweptPoints {
+   static const int MAX_POINTS = 8;
+
+   void Set(int i, double x, double y, double vecX, double vecY);
+
+   alignas(32) double x[MAX_POINTS] = {};
+   alignas(32) double y[MAX_POINTS] = {};
+   alignas(32) double vecX[MAX_POINTS] = {};
+   alignas(32) double vecY[MAX_POINTS] = {};
+};
+
+//
+// Returns the index of the first segment crossed by the path of any of
+// the points, or -1 if none are.
+//
+int FirstSegmentHit(const SweptPoints& pts, const LineSegment* segs,
+                    int count);
+
+// The same test without SIMD instructions
+int FirstSegmentHitScalar(const SweptPoints& pts, const LineSegment* segs,
+                          int count);
@@ -0,0 +1,126 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "CollisionGrid.hpp"
+#include "ObjectGrid.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+//
+// Removes all objects and resizes the grid to cover a new level.
+//
+void CollisionGrid::Reset(int levelWidth, int levelHeight)
+{
+   const int size = ObjectGrid::OBJ_GRID_SIZE;
+
+   m_cols = levelWidth / size + 1;
+   m_rows = (levelHeight - ObjectGrid::OBJ_GRID_TOP) / size + 1;
+
+   m_cells.assign(m_cols * m_rows, vector<Handle>());
+
+   for (vector<CellRange>& ranges : m_ranges)
+      ranges.clear();
+}
+
+//
+// Finds the squares overlapping a rectangle in level pixels. Anything
+// outside the level is counted as being in the nearest square.
+//
+CollisionGrid::CellRange CollisionGrid::ToCells(const Rect& r) const
+{
+   if (r.w <= 0 || r.h <= 0)
+      return CellRange{0, 0, -1, -1};
+
+   const int size = ObjectGrid::OBJ_GRID_SIZE;
+   const int top = ObjectGrid::OBJ_GRID_TOP;
+
+   auto clampX = [this](int x) { return max(0, min(x, m_cols - 1)); };
+   auto clampY = [this](int y) { return max(0, min(y, m_rows - 1)); };
+
+   // Division rounds towards zero but negative squares are clamped
+   // to zero anyway
+   return CellRange{
+      clampX(r.x / size),
+      clampY((r.y - top) / size),
+      clampX((r.x + r.w - 1) / size),
+      clampY((r.y + r.h - 1 - top) / size)
+   };
+}
+
+CollisionGrid::CellRange& CollisionGrid::RangeOf(Handle h)
+{
+   vector<CellRange>& ranges = m_ranges[GetKind(h)];
+   const size_t index = GetIndex(h);
+   if (index >= ranges.size())
+      ranges.resize(index + 1, CellRange{0, 0, -1, -1});
+   return ranges[index];
+}
+
+void CollisionGrid::Add(Handle h, const CellRange& range)
+{
+   for (int y = range.y0; y <= range.y1; y++) {
+      for (int x = range.x0; x <= range.x1; x++)
+         m_cells[x + y * m_cols].push_back(h);
+   }
+}
+
+void CollisionGrid::Remove(Handle h, const CellRange& range)
+{
+   for (int y = range.y0; y <= range.y1; y++) {
+      for (int x = range.x0; x <= range.x1; x++) {
+         vector<Handle>& cell = m_cells[x + y * m_cols];
+         vector<Handle>::iterator it = find(cell.begin(), cell.end(), h);
+         assert(it != cell.end());
+         *it = cell.back();
+         cell.pop_back();
+      }
+   }
+}
+
+void CollisionGrid::Insert(Handle h, const Rect& bounds)
+{
+   CellRange& range = RangeOf(h);
+   assert(range.x1 < range.x0);
+
+   range = ToCells(bounds);
+   Add(h, range);
+}
+
+//
+// Moves an object to its new bounds. This does nothing unless it has
+// crossed into a different square. Empty bounds remove the object.
+//
+void CollisionGrid::Update(Handle h, const Rect& bounds)
+{
+   CellRange& range = RangeOf(h);
+   const CellRange next = ToCells(bounds);
+   if (next == range)
+      return;
+
+   Remove(h, range);
+   range = next;
+   Add(h, range);
+}
+
+//
+// Lists each object overlapping the squares under an area once in order
+// of kind then index.
+//
+void CollisionGrid::Query(const Rect& area, vector<Handle>& found) const
+{
+   found.clear();
+
+   const CellRange range = ToCells(area);
+   for (int y = range.y0; y <= range.y1; y++) {
+      for (int x = range.x0; x <= range.x1; x++) {
+         const vector<Handle>& cell = m_cells[x + y * m_cols];
+         found.insert(found.end(), cell.begin(), cell.end());
+      }
+   }
+
+   sort(found.begin(), found.end());
+   found.erase(unique(found.begin(), found.end()), found.end());
+}
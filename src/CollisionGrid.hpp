@@ -0,0 +1,60 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#pragma once
+
+#include "Platform.hpp"
+#include "Geometry.hpp"
+
+#include <vector>
+#include <cstdint>
+
+//
+// Divides the level into the same squares as ObjectGrid and lists the
+// objects overlapping each square. Collision tests and drawing then only
+// look at objects near the area they care about. Objects are identified
+// by their kind and index in the game's list of that kind.
+//
+class CollisionGrid {
+public:
+   enum Kind { ASTEROID, GATEWAY, MINE, MISSILE, NUM_KINDS };
+
+   typedef uint32_t Handle;
+
+   static Handle MakeHandle(Kind kind, int index)
+   {
+      return (kind << 24) | index;
+   }
+   static Kind GetKind(Handle h) { return (Kind)(h >> 24); }
+   static int GetIndex(Handle h) { return h & 0xffffff; }
+
+   void Reset(int levelWidth, int levelHeight);
+   void Insert(Handle h, const Rect& bounds);
+   void Update(Handle h, const Rect& bounds);
+
+   void Query(const Rect& area, vector<Handle>& found) const;
+
+private:
+   struct CellRange {
+      int x0, y0, x1, y1;   // Inclusive, empty if x1 < x0
+
+      bool operator==(const CellRange& other) const
+      {
+         return x0 == other.x0 && y0 == other.y0
+            && x1 == other.x1 && y1 == other.y1;
+      }
+   };
+
+   CellRange ToCells(const Rect& r) const;
+   CellRange& RangeOf(Handle h);
+   void Add(Handle h, const CellRange& range);
+   void Remove(Handle h, const CellRange& range);
+
+   int m_cols = 0, m_rows = 0;
+   vector<vector<Handle>> m_cells;
+
+   // The squares each object was last added to
+   vector<CellRange> m_ranges[NUM_KINDS];
+};
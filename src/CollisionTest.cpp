@@ -0,0 +1,119 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "Collision.hpp"
+
+#include <iostream>
+#include <random>
+#include <cmath>
+
+using namespace std;
+
+//
+// The original test of one moving point against a segment, kept to check
+// the batched version gives exactly the same answers.
+//
+static bool Reference(double xpos, double ypos, double cX, double cY,
+                      const LineSegment& l)
+{
+   double vecX = cX - xpos;
+   double vecY = cY - ypos;
+
+   double wallX = (double)(l.p2.x - l.p1.x);
+   double wallY = (double)(l.p2.y - l.p1.y);
+
+   double numT = wallX * (ypos - l.p1.y) - wallY * (xpos - l.p1.x);
+   double numU = vecX * (ypos - l.p1.y) - vecY * (xpos - l.p1.x);
+
+   double denom = wallY * (cX - xpos) - wallX * (cY - ypos);
+
+   double u = numU / denom;
+   double t = numT / denom;
+
+   return (t > 0.0) && (t < 1.0) && (u > 0.0) && (u < 1.0);
+}
+
+//
+// Compares the SIMD, scalar and reference tests on random ship positions
+// near random segments. Integer coordinates and axis aligned walls are
+// common in the game so many cases are rounded to hit the edge cases.
+//   lander-collision-test [ROUNDS]
+//
+int main(int argc, char **argv)
+{
+   const int rounds = argc > 1 ? max(atoi(argv[1]), 1) : 200000;
+
+   mt19937 rng(42);
+   uniform_real_distribution<double> pos(-40.0, 40.0);
+   uniform_real_distribution<double> speed(-12.0, 12.0);
+   uniform_int_distribution<int> coord(-32, 32);
+   uniform_int_distribution<int> kind(0, 3);
+
+   const int NUM_SEGS = 4;
+   int hits = 0, failures = 0;
+
+   for (int r = 0; r < rounds; r++) {
+      const bool rounded = kind(rng) == 0;
+      const bool still = kind(rng) == 0;
+
+      double xpos = pos(rng), ypos = pos(rng);
+      double speedX = still ? 0.0 : speed(rng);
+      double speedY = speed(rng);
+      if (rounded) {
+         xpos = floor(xpos);
+         ypos = floor(ypos);
+         speedX = floor(speedX * 4) / 4;
+         speedY = floor(speedY * 4) / 4;
+      }
+
+      SweptPoints pts;
+      double cXs[SweptPoints::MAX_POINTS], cYs[SweptPoints::MAX_POINTS];
+      for (int i = 0; i < SweptPoints::MAX_POINTS; i++) {
+         const double x = xpos + (double)coord(rng);
+         const double y = ypos + (double)coord(rng);
+         cXs[i] = x + speedX;
+         cYs[i] = y + speedY;
+         pts.Set(i, x, y, cXs[i] - x, cYs[i] - y);
+      }
+
+      LineSegment segs[NUM_SEGS];
+      for (int s = 0; s < NUM_SEGS; s++) {
+         const int x1 = coord(rng), y1 = coord(rng);
+         switch (kind(rng)) {
+         case 0: segs[s] = LineSegment(x1, y1, coord(rng), y1); break;
+         case 1: segs[s] = LineSegment(x1, y1, x1, coord(rng)); break;
+         case 2: segs[s] = LineSegment(x1, y1, x1, y1); break;
+         default: segs[s] = LineSegment(x1, y1, coord(rng), coord(rng));
+         }
+      }
+
+      int expect = -1;
+      for (int s = 0; s < NUM_SEGS && expect == -1; s++) {
+         for (int i = 0; i < SweptPoints::MAX_POINTS; i++) {
+            if (Reference(pts.x[i], pts.y[i], cXs[i], cYs[i], segs[s])) {
+               expect = s;
+               break;
+            }
+         }
+      }
+
+      const int simd = FirstSegmentHit(pts, segs, NUM_SEGS);
+      const int scalar = FirstSegmentHitScalar(pts, segs, NUM_SEGS);
+
+      if (simd != expect || scalar != expect) {
+         if (failures++ < 10)
+            cerr << "round " << r << ": expected " << expect << " got "
+                 << simd << " (SIMD) and " << scalar << " (scalar)" << endl;
+      }
+
+      if (expect != -1)
+         hits++;
+   }
+
+   cout << rounds << " rounds, " << hits << " collisions, "
+        << failures << " mismatches" << endl;
+
+   return failures == 0 ? 0 : 1;
+}
@@ -4,6 +4,7 @@
 //
 
 #include "ElectricGate.hpp"
+#include "SimContext.hpp"
 #include "Ship.hpp"
 #include "OpenGL.hpp"
 
@@ -15,7 +16,21 @@ ElectricGate::ElectricGate(Viewport* v, int length, bool vertical, int x, int y)
 {
    lightning.Build(length * OBJ_GRID_SIZE, vertical);
 
-   m_timer = rand() % 70 + 10;
+   m_timer = SimContext::Current().Rand() % 70 + 10;
+}
+
+//
+// The area in level pixels covered by both ends and the lightning
+// between them whether or not it is active.
+//
+Rect ElectricGate::GetBounds() const
+{
+   int dx = vertical ? 0 : length;
+   int dy = vertical ? length : 0;
+   return { xpos*OBJ_GRID_SIZE,
+            ypos*OBJ_GRID_SIZE + OBJ_GRID_TOP,
+            (dx + 1)*OBJ_GRID_SIZE,
+            (dy + 1)*OBJ_GRID_SIZE };
 }
 
 bool ElectricGate::CheckCollision(Ship& ship)
@@ -46,7 +61,20 @@ bool ElectricGate::CheckCollision(Ship& ship)
    }
 }
 
-void ElectricGate::Draw()
+void ElectricGate::Process()
+{
+   m_timer -= SimContext::Current().GetTimeScale();
+   if (m_timer < GATEWAY_ACTIVE) {
+      if (static_cast<int>(m_timer) % 5 == 0)
+         lightning.Build(length * OBJ_GRID_SIZE, vertical);
+
+      // Reset timer
+      if (m_timer < 0.0f)
+         m_timer = 100.0f;
+   }
+}
+
+void ElectricGate::Draw() const
 {
    // Draw first sphere
    int draw_x = xpos*OBJ_GRID_SIZE - viewport->GetXAdjust();
@@ -65,19 +93,11 @@ void ElectricGate::Draw()
    gateImage.Draw(draw_x, draw_y);
 
    // Draw the electricity stuff
-   m_timer -= OpenGL::GetInstance().GetTimeScale();
    if (m_timer < GATEWAY_ACTIVE) {
       float x = xpos*OBJ_GRID_SIZE + 16 - viewport->GetXAdjust();
       float y = ypos*OBJ_GRID_SIZE + OBJ_GRID_TOP + 16 - viewport->GetYAdjust();
 
       lightning.Draw(x, y);
-
-      if (static_cast<int>(m_timer) % 5 == 0)
-         lightning.Build(length * OBJ_GRID_SIZE, vertical);
-
-      // Reset timer
-      if (m_timer < 0.0f)
-         m_timer = 100.0f;
    }
 }
 
@@ -103,8 +123,8 @@ void Lightning::Build(int length, bool vertical)
       else
          vertices[i] = VertexF{i * delta, y};
 
-      float swing = rand() % 2 == 0 ? -1 : 1;
-      y += swing * SWING_SIZE * (float)(rand() % 4);
+      float swing = SimContext::Current().Rand() % 2 == 0 ? -1 : 1;
+      y += swing * SWING_SIZE * (float)(SimContext::Current().Rand() % 4);
       if (y > MAX_OUT)
          y = MAX_OUT - swing * SWING_SIZE;
       else if (y < -MAX_OUT)
@@ -130,7 +150,10 @@ LightLineStrip::LightLineStrip()
 
 void LightLineStrip::Build(const VertexF *vertices, int count)
 {
-   m_vbo = VertexBuffer::Make(vertices, count, GL_LINE_STRIP);
+   if (m_vbo.IsValid() && count <= m_vbo.GetCapacity())
+      m_vbo.Upload(vertices, count, GL_LINE_STRIP);
+   else
+      m_vbo = VertexBuffer::MakeDynamic(vertices, count, GL_LINE_STRIP);
 }
 
 void LightLineStrip::Draw(int x, int y) const
@@ -46,7 +46,9 @@ public:
    ElectricGate(Viewport* v, int length, bool vertical, int x, int y);
 
    bool CheckCollision(Ship& ship);
-   void Draw();
+   Rect GetBounds() const;
+   void Process();
+   void Draw() const;
 
 private:
    static constexpr float GATEWAY_ACTIVE = 30.0f;
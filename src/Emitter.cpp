@@ -4,10 +4,11 @@
 //
 
 #include "Emitter.hpp"
+#include "SimContext.hpp"
 #include "OpenGL.hpp"
 
-#include <cmath>
 #include <string>
+#include <cstdint>
 
 //
 // Creates a new particle emitter.
@@ -27,18 +28,32 @@ Emitter::Emitter(int x, int y, float r, float g, float b, bool createnew,
   : partsize(size), r(r), g(g), b(b), deviation(deviation), xg(xg), yg(yg),
     life(life), maxspeed(max_speed), xpos((float)x), ypos((float)y),
     slowdown(slowdown), createrate(128.0f), xi_bias(0.0f), yi_bias(0.0f),
-    m_texture(Texture::Load("images/particle.png")),
-    m_vbo(VertexBuffer::MakeQuad(partsize, partsize))
+    m_pool(nullptr), m_live(0),
+    m_texture(Texture::LoadSprite("images/particle.png"))
 {
    // Set up the particles
-   for (int i = 0; i < MAX_PARTICLES; i++) {
-      if (createnew)
-         NewParticle(i);
-      else {
-         particle[i].active = false;
-         particle[i].life = -1.0f;
-      }
-   }
+   if (createnew)
+      SpawnParticles((float)MAX_PARTICLES,
+                     SimContext::Current().GetTimeScale());
+}
+
+Emitter::Emitter(Emitter&& other)
+   : partsize(other.partsize), r(other.r), g(other.g), b(other.b),
+     deviation(other.deviation), xg(other.xg), yg(other.yg),
+     life(other.life), maxspeed(other.maxspeed),
+     xpos(other.xpos), ypos(other.ypos), slowdown(other.slowdown),
+     createrate(other.createrate), xi_bias(other.xi_bias),
+     yi_bias(other.yi_bias), m_random(other.m_random), m_pool(other.m_pool),
+     m_blocks(move(other.m_blocks)), m_live(other.m_live),
+     m_texture(move(other.m_texture))
+{
+   other.m_blocks.clear();
+   other.m_live = 0;
+}
+
+Emitter::~Emitter()
+{
+   Reset();
 }
 
 
@@ -47,9 +62,43 @@ Emitter::Emitter(int x, int y, float r, float g, float b, bool createnew,
 //
 void Emitter::Reset()
 {
-   for (int i = 0; i < MAX_PARTICLES; i++)	{
-      particle[i].active = false;
-      particle[i].life = -1.0f;
+   m_live = 0;
+   ReleaseUnused();
+}
+
+
+//
+// Gives back blocks that no longer hold live particles.
+//
+void Emitter::ReleaseUnused()
+{
+   const size_t needed =
+      (m_live + ParticlePool::BLOCK_SIZE - 1) / ParticlePool::BLOCK_SIZE;
+   while (m_blocks.size() > needed) {
+      m_pool->Release(m_blocks.back());
+      m_blocks.pop_back();
+   }
+}
+
+
+//
+// Creates new particles in unused slots while fewer than limit have been
+// made.
+//
+void Emitter::SpawnParticles(float limit, float timeScale)
+{
+   for (int created = 0; m_live < MAX_PARTICLES && created < limit; created++) {
+      if (m_live == (int)m_blocks.size() * ParticlePool::BLOCK_SIZE) {
+         if (m_pool == nullptr) {
+            // Seed from the game so its particles repeat with it
+            SimContext& context = SimContext::Current();
+            m_pool = &context.GetParticles();
+            m_random.Seed(context.Rand());
+         }
+         m_blocks.push_back(m_pool->Allocate());
+      }
+
+      NewParticle(Slot(m_live++), timeScale);
    }
 }
 
@@ -59,23 +108,16 @@ void Emitter::Reset()
 //
 void Emitter::NewCluster(int x, int y)
 {
-   int i, created=0;
    float oldx, oldy;
 
-   const OpenGL::TimeScale timeScale = OpenGL::GetInstance().GetTimeScale();
+   const SimContext::TimeScale timeScale = SimContext::Current().GetTimeScale();
 
    oldx = xpos;
    oldy = ypos;
    xpos = (float)x;
    ypos = (float)y;
 
-   for (i = 0; i < MAX_PARTICLES; i++)	{
-      if ((particle[i].life < 0.0f || !particle[i].active)
-          && created < MAX_PARTICLES/(createrate * timeScale)) {
-         NewParticle(i);
-         created++;
-      }
-   }
+   SpawnParticles(MAX_PARTICLES/(createrate * timeScale), timeScale);
 
    xpos = oldx;
    ypos = oldy;
@@ -87,98 +129,134 @@ void Emitter::NewCluster(int x, int y)
 //
 void Emitter::Draw(float adjust_x, float adjust_y) const
 {
-   OpenGL& opengl = OpenGL::GetInstance();
-   opengl.Reset();
-   opengl.SetTexture(m_texture);
-   opengl.SetBlendFunc(GL_SRC_ALPHA, GL_ONE);
-
-   for (int i = 0; i < MAX_PARTICLES; i++)	{
-      if (particle[i].active)	{
-         float x = particle[i].x - adjust_x - partsize/2;
-         float y = particle[i].y - adjust_y - partsize/2;
-
-         opengl.SetTranslation(x, y);
-         opengl.SetColour(particle[i].r, particle[i].g, particle[i].b,
-                          particle[i].life);
-         opengl.Draw(m_vbo);
-      }
+   ParticleInstance instances[MAX_PARTICLES];
+
+   for (int i = 0; i < m_live; i++)	{
+      const int p = Slot(i);
+      ParticleInstance& inst = instances[i];
+      inst.x = m_pool->x[p] - adjust_x - partsize/2;
+      inst.y = m_pool->y[p] - adjust_y - partsize/2;
+      inst.r = Colour::ToByte(m_pool->r[p]);
+      inst.g = Colour::ToByte(m_pool->g[p]);
+      inst.b = Colour::ToByte(m_pool->b[p]);
+      inst.a = Colour::ToByte(m_pool->life[p]);
    }
+
+   OpenGL::GetInstance().DrawParticles(m_texture, (int)partsize,
+                                       instances, m_live);
 }
 
-void Emitter::Process(bool createnew, bool evolve)
+void Emitter::UpdateBlock(int first, int count, float timeScale)
+{
+   NoEffect none;
+   UpdateBlockWith(none, first, count, timeScale);
+}
+
+//
+// Removes particles that have faded out by moving the last live particle
+// into their place.
+//
+void Emitter::RetireDead()
 {
-   const OpenGL::TimeScale timeScale = OpenGL::GetInstance().GetTimeScale();
-
-   int created = 0;
-   for (int i = 0; i < MAX_PARTICLES; i++) {
-      if (particle[i].active) {
-         if (evolve)	{
-            // Move particle
-            particle[i].x += (particle[i].xi/(slowdown*1000)) * timeScale;
-            particle[i].y += (particle[i].yi/(slowdown*1000)) * timeScale;
-
-            // Apply gravity
-            particle[i].xi += particle[i].xg * timeScale;
-            particle[i].yi += particle[i].yg * timeScale;
-
-            // Fade particle
-            particle[i].life -= particle[i].fade * timeScale;
-
-            // Apply special effect
-            ProcessEffect(i);
-
-            // See if particle died
-            if (particle[i].life < 0.0f
-                && createnew
-                && created < MAX_PARTICLES/(createrate * timeScale)) {
-               NewParticle(i);
-               created++;
-            }
-            else if (particle[i].life < 0.0f)
-               particle[i].active = false;
+   int i = 0;
+   while (i < m_live) {
+      const int slot = Slot(i);
+
+#ifdef __SSE2__
+      // Skip quickly over groups where all are alive
+      if (i % 4 == 0 && i + 4 <= m_live) {
+         const __m128 dead = _mm_cmplt_ps(_mm_load_ps(&m_pool->life[slot]),
+                                          _mm_setzero_ps());
+         if (_mm_movemask_ps(dead) == 0) {
+            i += 4;
+            continue;
          }
       }
-      else if (createnew && created < MAX_PARTICLES/(createrate * timeScale)) {
-         NewParticle(i);
-         created++;
+#endif
+
+      if (m_pool->life[slot] < 0.0f)
+         m_pool->Copy(Slot(--m_live), slot);
+      else
+         i++;
+   }
+}
+
+void Emitter::Process(bool createnew, bool evolve)
+{
+   const SimContext::TimeScale timeScale = SimContext::Current().GetTimeScale();
+
+   if (evolve && m_live > 0) {
+      // Each block is contiguous in the pool
+      for (size_t n = 0; n < m_blocks.size(); n++) {
+         const int first = ParticlePool::First(m_blocks[n]);
+         const int count = min<int>(ParticlePool::BLOCK_SIZE,
+                                    m_live - n*ParticlePool::BLOCK_SIZE);
+         if (count <= 0)
+            break;
+
+         UpdateBlock(first, count, timeScale);
       }
+
+      RetireDead();
    }
+
+   // Refill as many dead and unused slots as the creation rate allows
+   if (createnew)
+      SpawnParticles(MAX_PARTICLES/(createrate * timeScale), timeScale);
+
+   ReleaseUnused();
 }
 
 //
-// Creates one new particle at the specified index.
+// Every whole number velocity, in units of the maximum speed, that fits
+// in a circle of radius 25. Picking one at random is the same as picking
+// any in the square and trying again if it is outside the circle.
 //
-void Emitter::NewParticle(int index)
+struct ParticleVelocity {
+   int8_t x, y;
+};
+
+static const vector<ParticleVelocity>& VelocityTable()
 {
-   float d[3];
-   int i;
+   static const vector<ParticleVelocity> table = [] {
+      vector<ParticleVelocity> t;
+      for (int x = -26; x < 24; x++) {
+         for (int y = -25; y < 25; y++) {
+            if (x*x + y*y <= 25*25)
+               t.push_back(ParticleVelocity{(int8_t)x, (int8_t)y});
+         }
+      }
+      return t;
+   }();
 
-   for (i = 0; i < 3; i++)	{
-      d[i] = (float)(rand()%100) - 50.0f;
-      d[i] /= 100.0f;
-      d[i] *= deviation;
-   }
+   return table;
+}
 
-   particle[index].active = true;
-   particle[index].life = life;
-   particle[index].fade = (float)(rand()%100)/1000.0f+0.003f;
-   particle[index].r = r + d[0] >= 1.0f ? 1.0f : r + d[0];
-   particle[index].g = g + d[1] >= 1.0f ? 1.0f : g + d[1];
-   particle[index].b = b + d[2] >= 1.0f ? 1.0f : b + d[2];
-   particle[index].x = xpos;
-   particle[index].y = ypos;
-   particle[index].xg = xg;
-   particle[index].yg = yg;
-
-   do {
-      particle[index].xi = (float)((rand()%50)-26.0f)*maxspeed;
-      particle[index].yi = (float)((rand()%50)-25.0f)*maxspeed;
-   } while (pow(particle[index].yi, 2) + pow(particle[index].xi, 2) > pow(25.0f*maxspeed, 2));
-
-   const OpenGL::TimeScale timeScale = OpenGL::GetInstance().GetTimeScale();
-
-   particle[index].xi += xi_bias * timeScale;
-   particle[index].yi += yi_bias * timeScale;
+//
+// Creates one new particle at the specified index.
+//
+void Emitter::NewParticle(int index, float timeScale)
+{
+   // Three colour deviations from one random number
+   int colour = m_random.Next();
+   float d[3];
+   for (int i = 0; i < 3; i++, colour /= 100)
+      d[i] = ((float)(colour%100) - 50.0f) / 100.0f * deviation;
+
+   ParticlePool& pool = *m_pool;
+   pool.life[index] = life;
+   pool.fade[index] = (float)(m_random.Next()%100)/1000.0f+0.003f;
+   pool.r[index] = r + d[0] >= 1.0f ? 1.0f : r + d[0];
+   pool.g[index] = g + d[1] >= 1.0f ? 1.0f : g + d[1];
+   pool.b[index] = b + d[2] >= 1.0f ? 1.0f : b + d[2];
+   pool.x[index] = xpos;
+   pool.y[index] = ypos;
+
+   const vector<ParticleVelocity>& velocities = VelocityTable();
+   const ParticleVelocity& v = velocities[m_random.Next() % velocities.size()];
+
+   pool.xi[index] = v.x * maxspeed + xi_bias * timeScale;
+   pool.yi[index] = v.y * maxspeed + yi_bias * timeScale;
 }
 
 
@@ -187,13 +265,15 @@ void Emitter::NewParticle(int index)
 //
 SmokeTrail::SmokeTrail(float r, float g, float b,
                        float dr, float dg, float db)
-  : Emitter(0, 0, r, g, b,
-            false, 0.2f,
-            0.0f, 0.0f,
-            0.3f, 0.0f, 6.0f, 0.001f),
-    dr(dr), dg(dg), db(db)
+  : BasicEmitter(0, 0, r, g, b,
+                 false, 0.2f,
+                 0.0f, 0.0f,
+                 0.3f, 0.0f, 6.0f, 0.001f)
 {
    createrate = 64.0f;
+   m_effect.dr = dr;
+   m_effect.dg = dg;
+   m_effect.db = db;
 }
 
 BlueSmokeTrail::BlueSmokeTrail()
@@ -207,52 +287,13 @@ OrangeSmokeTrail::OrangeSmokeTrail()
 
 }
 
-//
-// Processes the smoke trail effect for particle p.
-//
-void SmokeTrail::ProcessEffect(int p)
-{
-   const OpenGL::TimeScale timeScale = OpenGL::GetInstance().GetTimeScale();
-
-   if (particle[p].g > 0.5f)
-      particle[p].g -= 0.025f * timeScale;
-   else {
-      if (particle[p].r > 0.1f)
-         particle[p].r -= dr * timeScale;
-      if (particle[p].b > 0.1f)
-         particle[p].b -= db * timeScale;
-      if (particle[p].g > 0.1f)
-         particle[p].g -= dg * timeScale;
-   }
-}
-
 
 //
 // Explosion constructor. Sets Emitter constants to create a pretty explosion.
 //
 Explosion::Explosion()
-  : Emitter(0, 0, 0.7f, 0.7f, 0.0f, false, 0.3f, 0.0f, 0.0f, 1.0f, 120.0f, 8.5f, 2.0f)
+  : BasicEmitter(0, 0, 0.7f, 0.7f, 0.0f, false, 0.3f, 0.0f, 0.0f, 1.0f, 120.0f, 8.5f, 2.0f)
 {
    // Make a BIG explosion
    createrate = 20.0f;
 }
-
-
-//
-// Processes the explosion effect for particle p.
-//
-void Explosion::ProcessEffect(int p)
-{
-   const OpenGL::TimeScale timeScale = OpenGL::GetInstance().GetTimeScale();
-
-   if (particle[p].g > 0.5f)
-      particle[p].g -= 0.025f * timeScale;
-   else {
-      if (particle[p].r > 0.1f)
-         particle[p].r -= 0.025f * timeScale;
-      if (particle[p].b < 0.1f)
-         particle[p].b += 0.025f * timeScale;
-      if (particle[p].g > 0.1f)
-         particle[p].g -= 0.025f * timeScale;
-   }
-}
@@ -9,9 +9,34 @@
 #include "Platform.hpp"
 #include "Texture.hpp"
 #include "OpenGL.hpp"
+#include "ParticlePool.hpp"
+#include "SimContext.hpp"
+
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #define MAX_PARTICLES 512
 
+//
+// Effects change the colour of particles as they age. Begin is called
+// with the length of the step before a group of particles is updated and
+// Apply is then inlined into the update loop for one particle or, with
+// SSE2, four at a time. Effects that never change the colour set
+// CHANGES_COLOUR to false so the colours are not loaded at all.
+//
+struct NoEffect {
+   static const bool CHANGES_COLOUR = false;
+
+   void Begin(float timeScale) {}
+   void Apply(float& r, float& g, float& b) const {}
+#ifdef __SSE2__
+   void Apply(__m128& r, __m128& g, __m128& b) const {}
+#endif
+};
+
 
 //
 // A generic particle emitter.
@@ -22,51 +47,246 @@ public:
            float deviation=0.0f, float xg=0.0f, float yg=0.0f,
            float life=1.0f, float max_speed=10.0f, float size=2.0f,
            float slowdown=2.0f);
-   Emitter(Emitter&&) = default;
-   virtual ~Emitter() { }
+   Emitter(Emitter&& other);
+   virtual ~Emitter();
 
    void Draw(float adjust_x=0.0f, float adjust_y=0.0f) const;
    void NewCluster(int x, int y);
    void Reset();
    void Process(bool createnew, bool evolve = true);
 
-   virtual void ProcessEffect(int particle) { }
-
    float partsize, r, g, b, deviation, xg, yg, life, maxspeed, flSize;
    float xpos, ypos, slowdown, createrate;
 
    float xi_bias, yi_bias;
 
 protected:
-   void NewParticle(int index);
+   void NewParticle(int index, float timeScale);
+   void SpawnParticles(float limit, float timeScale);
+   void RetireDead();
+
+   // Updates count particles in the pool starting at first
+   virtual void UpdateBlock(int first, int count, float timeScale);
+
+   template <typename Effect>
+   void UpdateBlockWith(Effect& effect, int first, int count,
+                        float timeScale);
+   void ReleaseUnused();
+
+   // Index in the pool of this emitter's nth live particle
+   int Slot(int n) const
+   {
+      return ParticlePool::First(m_blocks[n / ParticlePool::BLOCK_SIZE])
+         + n % ParticlePool::BLOCK_SIZE;
+   }
 
-   struct Particle {
-      bool active;
-      float life, fade;
-      float r, g, b;
-      float x, y;
-      float xi, yi;
-      float xg, yg;
-   } particle[MAX_PARTICLES];
+   // Seeded from the game when the first particle is made
+   Random m_random;
+
+   // Particles are stored in blocks taken from the pool of the context
+   // that was current when the first one was made. The first m_live
+   // particles in the blocks are alive. The rest are still updated in
+   // groups of four but never drawn.
+   ParticlePool* m_pool;
+   vector<int> m_blocks;
+   int m_live;
 
    Texture m_texture;
-   VertexBuffer m_vbo;
+};
+
+
+//
+// An emitter whose particles change colour with Effect.
+//
+template <typename Effect>
+class BasicEmitter : public Emitter {
+public:
+   using Emitter::Emitter;
+
+protected:
+   void UpdateBlock(int first, int count, float timeScale) override
+   {
+      UpdateBlockWith(m_effect, first, count, timeScale);
+   }
+
+   Effect m_effect;
+};
+
+//
+// Moves the particles, applies gravity, fades them, and applies the
+// effect in one pass. Groups of four past count are also updated.
+//
+template <typename Effect>
+void Emitter::UpdateBlockWith(Effect& effect, int first, int count,
+                              float timeScale)
+{
+   const float rate = slowdown*1000;
+   const float dxi = xg * timeScale;
+   const float dyi = yg * timeScale;
+
+   float *x = m_pool->x.data() + first, *y = m_pool->y.data() + first;
+   float *xi = m_pool->xi.data() + first, *yi = m_pool->yi.data() + first;
+   float *life = m_pool->life.data() + first;
+   const float *fade = m_pool->fade.data() + first;
+   float *pr = m_pool->r.data() + first, *pg = m_pool->g.data() + first;
+   float *pb = m_pool->b.data() + first;
+
+   effect.Begin(timeScale);
+
+#ifdef __SSE2__
+   const __m128 vrate = _mm_set1_ps(rate);
+   const __m128 vscale = _mm_set1_ps(timeScale);
+   const __m128 vdxi = _mm_set1_ps(dxi);
+   const __m128 vdyi = _mm_set1_ps(dyi);
+
+   for (int i = 0; i < count; i += 4) {
+      const __m128 vxi = _mm_load_ps(xi + i);
+      const __m128 vyi = _mm_load_ps(yi + i);
+
+      const __m128 dx = _mm_mul_ps(_mm_div_ps(vxi, vrate), vscale);
+      const __m128 dy = _mm_mul_ps(_mm_div_ps(vyi, vrate), vscale);
+      _mm_store_ps(x + i, _mm_add_ps(_mm_load_ps(x + i), dx));
+      _mm_store_ps(y + i, _mm_add_ps(_mm_load_ps(y + i), dy));
+
+      _mm_store_ps(xi + i, _mm_add_ps(vxi, vdxi));
+      _mm_store_ps(yi + i, _mm_add_ps(vyi, vdyi));
+
+      const __m128 vfade = _mm_mul_ps(_mm_load_ps(fade + i), vscale);
+      _mm_store_ps(life + i, _mm_sub_ps(_mm_load_ps(life + i), vfade));
+
+      if constexpr (Effect::CHANGES_COLOUR) {
+         __m128 r = _mm_load_ps(pr + i);
+         __m128 g = _mm_load_ps(pg + i);
+         __m128 b = _mm_load_ps(pb + i);
+
+         effect.Apply(r, g, b);
+
+         _mm_store_ps(pr + i, r);
+         _mm_store_ps(pg + i, g);
+         _mm_store_ps(pb + i, b);
+      }
+   }
+#else
+   for (int i = 0; i < count; i++) {
+      x[i] += (xi[i]/rate) * timeScale;
+      y[i] += (yi[i]/rate) * timeScale;
+
+      xi[i] += dxi;
+      yi[i] += dyi;
+
+      life[i] -= fade[i] * timeScale;
+
+      if constexpr (Effect::CHANGES_COLOUR)
+         effect.Apply(pr[i], pg[i], pb[i]);
+   }
+#endif
+}
+
+
+//
+// Turns smoke grey then fades it towards black at a rate for each colour.
+//
+struct SmokeEffect {
+   static const bool CHANGES_COLOUR = true;
+
+   float dr, dg, db;
+
+   void Begin(float timeScale)
+   {
+      greying = 0.025f * timeScale;
+      stepR = dr * timeScale;
+      stepG = dg * timeScale;
+      stepB = db * timeScale;
+   }
+
+   void Apply(float& r, float& g, float& b) const
+   {
+      if (g > 0.5f)
+         g -= greying;
+      else {
+         if (r > 0.1f)
+            r -= stepR;
+         if (b > 0.1f)
+            b -= stepB;
+         if (g > 0.1f)
+            g -= stepG;
+      }
+   }
+
+#ifdef __SSE2__
+   void Apply(__m128& r, __m128& g, __m128& b) const
+   {
+      const __m128 half = _mm_set1_ps(0.5f), tenth = _mm_set1_ps(0.1f);
+      const __m128 bright = _mm_cmpgt_ps(g, half);
+
+      // Subtract only in the lanes where the condition holds
+      const __m128 dr = _mm_and_ps(_mm_cmpgt_ps(r, tenth), _mm_set1_ps(stepR));
+      const __m128 db = _mm_and_ps(_mm_cmpgt_ps(b, tenth), _mm_set1_ps(stepB));
+      const __m128 dg = _mm_or_ps(
+         _mm_and_ps(bright, _mm_set1_ps(greying)),
+         _mm_andnot_ps(bright, _mm_and_ps(_mm_cmpgt_ps(g, tenth),
+                                          _mm_set1_ps(stepG))));
+
+      r = _mm_sub_ps(r, _mm_andnot_ps(bright, dr));
+      b = _mm_sub_ps(b, _mm_andnot_ps(bright, db));
+      g = _mm_sub_ps(g, dg);
+   }
+#endif
+
+   float greying, stepR, stepG, stepB;
+};
+
+//
+// Turns an explosion from yellow to red to blue.
+//
+struct ExplosionEffect {
+   static const bool CHANGES_COLOUR = true;
+
+   void Begin(float timeScale) { step = 0.025f * timeScale; }
+
+   void Apply(float& r, float& g, float& b) const
+   {
+      if (g > 0.5f)
+         g -= step;
+      else {
+         if (r > 0.1f)
+            r -= step;
+         if (b < 0.1f)
+            b += step;
+         if (g > 0.1f)
+            g -= step;
+      }
+   }
+
+#ifdef __SSE2__
+   void Apply(__m128& r, __m128& g, __m128& b) const
+   {
+      const __m128 half = _mm_set1_ps(0.5f), tenth = _mm_set1_ps(0.1f);
+      const __m128 vstep = _mm_set1_ps(step);
+      const __m128 bright = _mm_cmpgt_ps(g, half);
+
+      // Change only the lanes where the condition holds
+      r = _mm_sub_ps(r, _mm_andnot_ps(
+                        bright, _mm_and_ps(_mm_cmpgt_ps(r, tenth), vstep)));
+      b = _mm_add_ps(b, _mm_andnot_ps(
+                        bright, _mm_and_ps(_mm_cmplt_ps(b, tenth), vstep)));
+      g = _mm_sub_ps(g, _mm_and_ps(_mm_cmpgt_ps(g, tenth), vstep));
+   }
+#endif
+
+   float step;
 };
 
 
 //
 // A smoke trail.
 //
-class SmokeTrail : public Emitter {
+class SmokeTrail : public BasicEmitter<SmokeEffect> {
 public:
    SmokeTrail(float r, float g, float b,
               float dr, float dg, float db);
    SmokeTrail(SmokeTrail&&) = default;
    virtual ~SmokeTrail() { }
-
-   void ProcessEffect(int particle);
-private:
-   const float dr, dg, db;
 };
 
 class BlueSmokeTrail : public SmokeTrail {
@@ -82,13 +302,10 @@ public:
 //
 // An explosion.
 //
-class Explosion : public Emitter {
+class Explosion : public BasicEmitter<ExplosionEffect> {
 public:
    Explosion();
    virtual ~Explosion() { }
-
-   void ProcessEffect(int particle);
-private:
 };
 
 #endif
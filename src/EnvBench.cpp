@@ -0,0 +1,82 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "Platform.hpp"
+#include "LanderEnv.hpp"
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstdlib>
+
+#include <SDL_main.h>
+
+//
+// A hand written agent that keeps upright and stops falling too fast.
+//
+static unsigned Hover(const EnvObservation& obs)
+{
+   unsigned actions = 0;
+
+   if (obs.speedY > 1.0f)
+      actions |= LanderEnv::THRUST;
+
+   if (obs.angle > 10.0f && obs.angle < 180.0f)
+      actions |= LanderEnv::LEFT;
+   else if (obs.angle >= 180.0f && obs.angle < 350.0f)
+      actions |= LanderEnv::RIGHT;
+
+   return actions;
+}
+
+//
+// Measures how many environment steps per second can be run.
+//   lander-env-bench [ENVS] [STEPS]
+//
+int main(int argc, char **argv)
+{
+   const int count = argc > 1 ? max(atoi(argv[1]), 1) : 16;
+   const int steps = argc > 2 ? max(atoi(argv[2]), 1) : 10000;
+
+   LanderEnv::Initialise();
+
+   VecEnv env(count);
+   vector<EnvObservation> obs(count);
+   vector<unsigned> actions(count);
+   vector<float> rewards(count);
+   unique_ptr<bool[]> dones(new bool[count]);
+
+   env.Reset(1, 1, obs.data());
+
+   int episodes = 0;
+   double totalReward = 0.0;
+
+   using namespace chrono;
+   const steady_clock::time_point start = steady_clock::now();
+
+   for (int n = 0; n < steps; n++) {
+      for (int i = 0; i < count; i++)
+         actions[i] = Hover(obs[i]);
+
+      env.Step(actions.data(), obs.data(), rewards.data(), dones.get());
+
+      for (int i = 0; i < count; i++) {
+         totalReward += rewards[i];
+         if (dones[i])
+            episodes++;
+      }
+   }
+
+   const double secs =
+      duration<double>(steady_clock::now() - start).count();
+
+   cout << count << " environments ran " << steps << " steps in " << secs
+        << "s (" << (int)(count * steps / secs) << " steps/s)" << endl
+        << episodes << " episodes with mean reward "
+        << (episodes > 0 ? totalReward / episodes : 0.0) << endl;
+
+   return 0;
+}
@@ -4,6 +4,7 @@
 //
 
 #include "Fade.hpp"
+#include "SimContext.hpp"
 #include "OpenGL.hpp"
 
 #include <cassert>
@@ -46,7 +47,7 @@ void Fade::BeginFadeOut()
 
 bool Fade::Process()
 {
-   const OpenGL::TimeScale timeScale = OpenGL::GetInstance().GetTimeScale();
+   const SimContext::TimeScale timeScale = SimContext::Current().GetTimeScale();
 
    switch (m_state) {
    case fOut:
@@ -5,128 +5,87 @@
 
 #include "Font.hpp"
 #include "OpenGL.hpp"
+#include "AssetPack.hpp"
+#include "AssetLoader.hpp"
 
 #include <string>
 #include <stdexcept>
 #include <cassert>
 
-int Font::fontRefCount = 0;
-FT_Library Font::library;
-
 Font::Font(const string& filename, unsigned int h)
    : m_height(h),
      m_colour(Colour::WHITE)
 {
-   if (++fontRefCount == 1) {
-      if (FT_Init_FreeType(&library))
-         Die("FT_Init_FreeType failed");
-   }
-
    m_buf = new char[MAX_TXT_BUF];
 
-   // Create the face
-   FT_Face face;
-   if (FT_New_Face(library, filename.c_str(), 0, &face))
-      Die("FT_New_Face failed, file name: %s", filename.c_str());
+   const AssetPack& pack = AssetPack::GetInstance();
+   const PackEntry *entry = pack.Find(AssetPack::FontName(filename, h),
+                                      PACK_FONT);
+   if (entry != nullptr) {
+      const FontGlyph *glyphs =
+         static_cast<const FontGlyph*>(pack.GetData(entry));
+      const GLubyte *texels =
+         reinterpret_cast<const GLubyte*>(glyphs + MAX_CHAR);
+
+      Build(glyphs, entry->params[0], entry->params[1], texels);
+   }
+   else {
+      shared_ptr<const RasterFont> raster =
+         AssetLoader::GetInstance().TakeFont(filename, h);
+      if (!raster) {
+         shared_ptr<RasterFont> rasterized = make_shared<RasterFont>();
+         rasterized->Rasterize(LocateResource(filename), h);
+         raster = rasterized;
+      }
 
-   // FreeType measures font sizes in 1/64ths of a pixel...
-   FT_Set_Char_Size(face, h<<6, h<<6, 96, 96);
+      Build(raster->glyphs, raster->cellSize, raster->textureWidth,
+            raster->texels.data());
+   }
+}
 
-   const unsigned cellSize = NextPowerOf2(h * 2);
-   const unsigned textureWidth = NextPowerOf2(cellSize * MAX_CHAR);
+Font::~Font()
+{
+   delete[] m_buf;
+}
+
+void Font::Build(const FontGlyph *glyphs, unsigned cellSize,
+                 unsigned textureWidth, const GLubyte *texels)
+{
    const float normCellSize = 1.0f / MAX_CHAR;
 
-   GLubyte *textureData = new GLubyte[2 * cellSize * textureWidth];
    Vertex<float> *vertexBuf = new Vertex<float>[MAX_CHAR * 4];
 
-   // Generate the characters
    for (int i = 0; i < MAX_CHAR; i++) {
-      // Load the character's glyph
-      if (FT_Load_Glyph(face, FT_Get_Char_Index(face, i), FT_LOAD_DEFAULT))
-         Die("FT_Load_Glyph failed");
-
-      // Store the face's glyph in a glyph object
-      FT_Glyph glyph;
-      if (FT_Get_Glyph(face->glyph, &glyph))
-         Die("FT_Get_Glyph failed");
-
-      // Convert the glyph to a bitmap
-      FT_Glyph_To_Bitmap(&glyph, ft_render_mode_normal, 0, 1);
-      FT_BitmapGlyph bitmapGlyph = (FT_BitmapGlyph)glyph;
-
-      // Get a reference to the bitmap
-      FT_Bitmap& bitmap = bitmapGlyph->bitmap;
-
-      assert(bitmap.width <= cellSize);
-      assert(bitmap.rows <= cellSize);
-
-      // Convert greyscale bitmap to lumiance and alpha channel
-      for (unsigned y = 0; y < cellSize; y++) {
-         for (unsigned x = 0; x < cellSize; x++) {
-            const int offset = 2 * (x + i*cellSize + y*textureWidth);
-            textureData[offset] = 255;
-            textureData[offset + 1] =
-               (x >= bitmap.width || y >= bitmap.rows)
-               ? 0
-               : bitmap.buffer[x + bitmap.width*y];
-         }
-      }
+      const FontGlyph& g = glyphs[i];
 
       const float tx = i * normCellSize;
-      const float tw = ((float)bitmap.width / (float)cellSize) * normCellSize;
-      const float th = (float)bitmap.rows / (float)cellSize;
+      const float tw = ((float)g.width / (float)cellSize) * normCellSize;
+      const float th = (float)g.rows / (float)cellSize;
 
       // Insert some space between characters
-      const float x = bitmapGlyph->left;
+      const float x = g.left;
 
       // Move down a bit to accomodate characters such as p and q
-      const float y = -bitmapGlyph->top;
+      const float y = -g.top;
 
       const Vertex<float> vertices[4] = {
-         { x, y + bitmap.rows, tx, th},
+         { x, y + g.rows, tx, th},
          { x, y, tx, 0.0f },
-         { x + bitmap.width, y, tx + tw, 0.0f },
-         { x + bitmap.width, y + bitmap.rows, tx + tw, th }
+         { x + g.width, y, tx + tw, 0.0f },
+         { x + g.width, y + g.rows, tx + tw, th }
       };
 
       copy(vertices, vertices + 4, vertexBuf + i * 4);
 
-      m_widths[i] = face->glyph->advance.x >> 6;
-
-      FT_Done_Glyph(glyph);
+      m_widths[i] = g.advance;
    }
 
-   m_texture = Texture::Make(textureWidth, cellSize, textureData,
+   m_texture = Texture::Make(textureWidth, cellSize, texels,
                              GL_LUMINANCE_ALPHA, GL_NEAREST);
 
    m_vbo = VertexBuffer::Make(vertexBuf, MAX_CHAR * 4);
 
    delete[] vertexBuf;
-   delete[] textureData;
-
-   // Free face data
-   FT_Done_Face(face);
-}
-
-Font::~Font()
-{
-   delete[] m_buf;
-
-   if (--fontRefCount == 0) {
-      FT_Done_FreeType(library);
-   }
-}
-
-int Font::NextPowerOf2(unsigned a)
-{
-   a--;
-   a |= a >> 1;
-   a |= a >> 2;
-   a |= a >> 4;
-   a |= a >> 8;
-   a |= a >> 16;
-   a++;
-   return a;
 }
 
 int Font::SplitIntoLines(const char* fmt, va_list ap)
@@ -162,8 +121,6 @@ void Font::Print(int x, int y, const char* fmt, ...)
    opengl.SetColour(m_colour);
    opengl.SetTexture(m_texture);
 
-   OpenGL::BindVertexBuffer bind(m_vbo);
-
    const char *p = m_buf;
    for (int i = 0; i < nlines; i++) {
       float offset = 0.0f;
@@ -7,13 +7,10 @@
 
 #include "Platform.hpp"
 #include "OpenGL.hpp"
+#include "FontData.hpp"
 
 #include <vector>
 
-#include <ft2build.h>
-#include FT_FREETYPE_H
-#include FT_GLYPH_H
-
 class Font {
 public:
    Font(const string& filename, unsigned int h);
@@ -24,10 +21,11 @@ public:
    void Print(int x, int y, const char* fmt, ...);
    int GetStringWidth(const char* fmt, ...);
 private:
-   int NextPowerOf2(unsigned a);
+   void Build(const FontGlyph *glyphs, unsigned cellSize,
+              unsigned textureWidth, const GLubyte *texels);
    int SplitIntoLines(const char* fmt, va_list ap);
 
-   static const int MAX_CHAR = 128;
+   static const int MAX_CHAR = RasterFont::MAX_CHAR;
    static const int MAX_TXT_BUF = 1024;
 
    VertexBuffer m_vbo;
@@ -36,7 +34,4 @@ private:
    unsigned     m_widths[MAX_CHAR];
    char        *m_buf;
    Colour       m_colour;
-
-   static int fontRefCount;
-   static FT_Library library;
 };
@@ -0,0 +1,91 @@
+//
+// Copyright (C) 2006-2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "FontData.hpp"
+
+#include <cassert>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_GLYPH_H
+
+void RasterFont::Rasterize(const string& filename, unsigned h)
+{
+   FT_Library library;
+   if (FT_Init_FreeType(&library))
+      Die("FT_Init_FreeType failed");
+
+   // Create the face
+   FT_Face face;
+   if (FT_New_Face(library, filename.c_str(), 0, &face))
+      Die("FT_New_Face failed, file name: %s", filename.c_str());
+
+   // FreeType measures font sizes in 1/64ths of a pixel...
+   FT_Set_Char_Size(face, h<<6, h<<6, 96, 96);
+
+   cellSize = NextPowerOf2(h * 2);
+   textureWidth = NextPowerOf2(cellSize * MAX_CHAR);
+
+   texels.assign(2 * cellSize * textureWidth, 0);
+
+   // Generate the characters
+   for (int i = 0; i < MAX_CHAR; i++) {
+      // Load the character's glyph
+      if (FT_Load_Glyph(face, FT_Get_Char_Index(face, i), FT_LOAD_DEFAULT))
+         Die("FT_Load_Glyph failed");
+
+      // Store the face's glyph in a glyph object
+      FT_Glyph glyph;
+      if (FT_Get_Glyph(face->glyph, &glyph))
+         Die("FT_Get_Glyph failed");
+
+      // Convert the glyph to a bitmap
+      FT_Glyph_To_Bitmap(&glyph, ft_render_mode_normal, 0, 1);
+      FT_BitmapGlyph bitmapGlyph = (FT_BitmapGlyph)glyph;
+
+      // Get a reference to the bitmap
+      FT_Bitmap& bitmap = bitmapGlyph->bitmap;
+
+      assert(bitmap.width <= cellSize);
+      assert(bitmap.rows <= cellSize);
+
+      // Convert greyscale bitmap to lumiance and alpha channel
+      for (unsigned y = 0; y < cellSize; y++) {
+         for (unsigned x = 0; x < cellSize; x++) {
+            const int offset = 2 * (x + i*cellSize + y*textureWidth);
+            texels[offset] = 255;
+            texels[offset + 1] =
+               (x >= bitmap.width || y >= bitmap.rows)
+               ? 0
+               : bitmap.buffer[x + bitmap.width*y];
+         }
+      }
+
+      FontGlyph& g = glyphs[i];
+      g.left = bitmapGlyph->left;
+      g.top = bitmapGlyph->top;
+      g.width = bitmap.width;
+      g.rows = bitmap.rows;
+      g.advance = face->glyph->advance.x >> 6;
+
+      FT_Done_Glyph(glyph);
+   }
+
+   // Free face data
+   FT_Done_Face(face);
+   FT_Done_FreeType(library);
+}
+
+unsigned RasterFont::NextPowerOf2(unsigned a)
+{
+   a--;
+   a |= a >> 1;
+   a |= a >> 2;
+   a |= a >> 4;
+   a |= a >> 8;
+   a |= a >> 16;
+   a++;
+   return a;
+}
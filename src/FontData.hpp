@@ -0,0 +1,38 @@
+//
+// Copyright (C) 2006-2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#pragma once
+
+#include "Platform.hpp"
+
+#include <vector>
+#include <cstdint>
+
+//
+// Placement of one glyph within a cell of the font texture.
+//
+struct FontGlyph {
+   int32_t left, top;
+   int32_t width, rows;
+   int32_t advance;
+};
+
+//
+// A font rasterized into a single row of fixed size cells, one for
+// each character, stored as luminance and alpha pairs. This does not
+// touch OpenGL so it can be prepared ahead of time.
+//
+struct RasterFont {
+   static const int MAX_CHAR = 128;
+
+   unsigned cellSize;
+   unsigned textureWidth;
+   FontGlyph glyphs[MAX_CHAR];
+   vector<uint8_t> texels;
+
+   void Rasterize(const string& filename, unsigned h);
+
+   static unsigned NextPowerOf2(unsigned a);
+};
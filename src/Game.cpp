@@ -8,6 +8,7 @@
 #include "HighScores.hpp"
 #include "Input.hpp"
 #include "ConfigFile.hpp"
+#include "ThreadPool.hpp"
 
 #include <iostream>
 #include <cassert>
@@ -15,30 +16,32 @@
 //
 // Constants affecting level generation.
 //
-const int Game::MAX_SURFACE_HEIGHT(300);
-const float Game::SHIP_SPEED(0.15f);
-const int Game::MAX_PAD_SIZE(2);
+const int GameSim::MAX_SURFACE_HEIGHT(300);
+const float GameSim::SHIP_SPEED(0.15f);
+const int GameSim::MAX_PAD_SIZE(2);
 const int FuelMeter::FUELBAR_OFFSET(68);
-const float Game::GRAVITY(0.035f);
-const int Game::MAX_MISSILES(20);
+const float GameSim::GRAVITY(0.035f);
+const int GameSim::MAX_MISSILES(20);
 
 //
 // Constants affecting state transitions.
 //
-const int Game::DEATH_TIMEOUT(50);		// Frames to wait for ending level
-const float Game::GAME_FADE_IN_SPEED(0.1f);	// Rate of alpha change at level start
-const float Game::GAME_FADE_OUT_SPEED(0.1f);	// Rate of alpha change at level end
-const float Game::LIFE_ALPHA_BASE(2.0f);
-const int Game::LEVEL_TEXT_TIMEOUT(75);
-
-const float Game::TURN_ANGLE(3.0f);
-const float Game::DEATH_SPIN_RATE(5.0f);
-const int Game::FUEL_BASE(600);
-const int Game::FUEL_PER_LEVEL(50);
-
-const int Game::SCORE_PAD_SIZE(10);
-const int Game::SCORE_LEVEL(100);
-const int Game::SCORE_FUEL_DIV(10);
+const int GameSim::DEATH_TIMEOUT(50);		// Frames to wait for ending level
+const float GameSim::GAME_FADE_IN_SPEED(0.1f);	// Rate of alpha change at level start
+const float GameSim::GAME_FADE_OUT_SPEED(0.1f);	// Rate of alpha change at level end
+const float GameSim::LIFE_ALPHA_BASE(2.0f);
+const float GameSim::LIFE_FADE_SPEED(0.03f);
+const float GameSim::STAR_ROTATE_SPEED(0.005f);
+const int GameSim::LEVEL_TEXT_TIMEOUT(75);
+
+const float GameSim::TURN_ANGLE(3.0f);
+const float GameSim::DEATH_SPIN_RATE(5.0f);
+const int GameSim::FUEL_BASE(600);
+const int GameSim::FUEL_PER_LEVEL(50);
+
+const int GameSim::SCORE_PAD_SIZE(10);
+const int GameSim::SCORE_LEVEL(100);
+const int GameSim::SCORE_FUEL_DIV(10);
 
 const int Game::SCORE_Y(30);
 
@@ -47,96 +50,119 @@ const float SpeedMeter::LAND_SPEED(2.0f);
 const int FuelMeter::FUELBAR_Y(15);
 
 
-Game::Game()
-   : ship(&viewport),
+GameSim::GameSim(bool verbose)
+   : m_verbose(verbose),
+     ship(&viewport),
      surface(&viewport),
      speedmeter(&ship),
      state(gsNone),
-     levelComp("images/levelcomp.png"),
-     smallShip("images/shipsmall.png"),
      starImage("images/star.png"),
-     gameOver("images/gameover.png"),
-     normalFont(LocateResource("fonts/VeraBd.ttf"), 11),
-     scoreFont(LocateResource("fonts/VeraBd.ttf"), 16),
-     bigFont(LocateResource("fonts/VeraBd.ttf"), 20),
-     impactSound(LocateResource("sounds/bomb_explosion.wav")),
-     collectSound(LocateResource("sounds/collect.wav"))
-{
-
-}
-
-void Game::Load()
+     impactSound("sounds/bomb_explosion.wav"),
+     collectSound("sounds/collect.wav")
 {
    starrotate = 0.0f;
    death_timeout = 0;
-   state = gsNone;
 
-   bDebugMode = false;
+   GLubyte white = 255;
+   m_gridTexture = Texture::Make(1, 1, &white, GL_LUMINANCE);
 }
 
-Game::~Game()
+void GameSim::SetScreenSize(int width, int height)
 {
+   viewport.SetScreenSize(width, height);
+}
 
+//
+// Generate the next level on a worker thread during the fade out rather
+// than when it is needed. Only worth doing when drawing every frame.
+//
+void GameSim::EnableBackgroundLoading()
+{
+   m_backgroundLoading = true;
 }
 
-void Game::NewGame()
+void GameSim::NewGame(int level, uint32_t seed)
 {
+   SimContext::Scope scope(m_context);
+
+   m_context.Seed(seed);
+
    // Reset score, lives, etc.
    score = 0;
    lives = 3;
 
    // Start the game
-   {
-      ConfigFile cfile;
-      level = cfile.get_int("level", 1);
-   }
    nextnewlife = 1000;
-   StartLevel();
+   PrepareLevel(level);
+   StartLevel(m_nextLevel.get());
 }
 
-void Game::CalculateScore(int padIndex)
+void GameSim::CalculateScore(int padIndex)
 {
    newscore =
       (level * SCORE_LEVEL)
       + ((MAX_PAD_SIZE + 2 - pads[padIndex].GetLength()) * SCORE_PAD_SIZE)
       + (fuelmeter.GetFuel() / SCORE_FUEL_DIV);
-   newscore_width = bigFont.GetStringWidth(i18n("Score:  %d"), newscore);
 }
 
-void Game::EnterDeathWait(int timeout)
+void GameSim::EnterDeathWait(int timeout)
 {
    state = gsDeathWait;
    death_timeout = timeout;
 }
 
-void Game::Process()
+void GameSim::TogglePause()
 {
-   Input& input = Input::GetInstance();
-   OpenGL& opengl = OpenGL::GetInstance();
+   if (state == gsPaused) {
+      // Unpause the game
+      state = gsInGame;
+   }
+   else if (state == gsInGame) {
+      // Pause the game
+      state = gsPaused;
+      ship.ThrustOff();
+   }
+}
 
-   // Check keys
-   if (input.QueryAction(Input::PAUSE)) {
-      if (state == gsPaused) {
-         // Unpause the game
-         state = gsInGame;
-      }
-      else if (state == gsInGame) {
-         // Pause the game
-         state = gsPaused;
-         ship.ThrustOff();
-      }
+//
+// True from the moment the ship explodes until the level fades out.
+// The fade is shared with completing a level so is not included.
+//
+bool GameSim::HasCrashed() const
+{
+   return state == gsExplode || state == gsDeathWait || state == gsGameOver
+      || state == gsFadeToDeath || state == gsFinished;
+}
 
-      input.ResetAction(Input::PAUSE);
-   }
+//
+// Advances the game by one step given a mask of the Input::Action bits
+// that are held down. Returns true if a new level was started so the
+// caller can skip drawing the half finished frame.
+//
+bool GameSim::Process(unsigned actions)
+{
+   SimContext::Scope scope(m_context);
+   m_context.Tick();
 
-   if (input.QueryResetAction(Input::SCREENSHOT))
-      opengl.DeferScreenShot();
+   const SimContext::TimeScale timeScale = m_context.GetTimeScale();
+
+   // Remember where everything was so frames drawn before the next step
+   // can be interpolated
+   ship.SavePosition();
+   viewport.SavePosition();
+   for (MineListIt it = mines.begin(); it != mines.end(); ++it)
+      (*it).SavePosition();
+   for (MissileListIt it = missiles.begin(); it != missiles.end(); ++it)
+      (*it).SavePosition();
+
+   // Rotate the background stars
+   starrotate += STAR_ROTATE_SPEED * stars.size() * timeScale;
 
    // Do no more game processing in the paused state
-   if (state == gsPaused)
-      return;
+   if (state == gsPaused || state == gsFinished)
+      return false;
 
-   if (input.QueryAction(Input::THRUST)
+   if ((actions & ActionBit(Input::THRUST))
        && !fuelmeter.OutOfFuel() && state == gsInGame) {
       // Thrusting
       ship.ThrustOn();
@@ -146,32 +172,26 @@ void Game::Process()
    else
       ship.ThrustOff();
 
-   if (input.QueryAction(Input::RIGHT) && state == gsInGame) {
+   if ((actions & ActionBit(Input::RIGHT)) && state == gsInGame) {
       // Turn clockwise
       ship.Turn(TURN_ANGLE);
    }
-   else if (input.QueryAction(Input::LEFT) && state == gsInGame) {
+   else if ((actions & ActionBit(Input::LEFT)) && state == gsInGame) {
       // Turn anti-clockwise
       ship.Turn(-TURN_ANGLE);
    }
 
-   if (input.QueryAction(Input::SKIP) && state == gsExplode) {
+   if ((actions & ActionBit(Input::SKIP)) && state == gsExplode) {
       // The player got bored watching the explosion
       EnterDeathWait(lives == 0 ? DEATH_TIMEOUT : 1);
    }
 
-   if (input.QueryAction(Input::ABORT) && state == gsInGame) {
+   if ((actions & ActionBit(Input::ABORT)) && state == gsInGame) {
       // Quit to main menu
       ExplodeShip();
       lives = 0;
    }
 
-   if (input.QueryAction(Input::DEBUG)) {
-      // Toggle debug mode
-      bDebugMode = !bDebugMode;
-      input.ResetAction(Input::DEBUG);
-   }
-
    // Move only if not in game over
    if (state == gsInGame || state == gsExplode) {
       ship.ApplyGravity(flGravity);
@@ -183,19 +203,33 @@ void Game::Process()
    ship.ProcessEffects(state == gsPaused, state == gsExplode);
 
    // Move mines
-   for (MineListIt it = mines.begin(); it != mines.end(); ++it)
-      (*it).Move();
+   for (size_t i = 0; i < mines.size(); i++) {
+      mines[i].Move();
+      collisionGrid.Update(
+         CollisionGrid::MakeHandle(CollisionGrid::MINE, i),
+         mines[i].GetBounds());
+   }
 
    // Move or fire missiles
-   for (MissileListIt it = missiles.begin(); it != missiles.end(); ++it)
-      (*it).Move(ship);
+   for (size_t i = 0; i < missiles.size(); i++) {
+      missiles[i].Move(ship);
+      collisionGrid.Update(
+         CollisionGrid::MakeHandle(CollisionGrid::MISSILE, i),
+         missiles[i].GetBounds());
+   }
+
+   // Animate keys and gateways
+   for (KeyListIt it = keys.begin(); it != keys.end(); ++it)
+      (*it).Process();
+   for (ElectricGateListIt it = gateways.begin(); it != gateways.end(); ++it)
+      (*it).Process();
 
    // Calculate view adjusts
    ship.CentreInViewport();
 
    // Check for collisions with surface
    int padIndex;
-   if (surface.CheckCollisions(ship, pads, &padIndex)) {
+   if (surface.CheckCollisions(ship, &padIndex)) {
       bool landed = false;
       if (state == gsInGame) {
          if (padIndex != -1) {
@@ -208,6 +242,9 @@ void Game::Process()
                CalculateScore(padIndex);
                countdown_timeout = 70;
                landed = true;
+
+               // Plenty of time to generate it while the score counts
+               PrepareLevel(level + 1);
             }
          }
          if (!landed) {
@@ -220,57 +257,30 @@ void Game::Process()
          EnterDeathWait();
    }
 
-   // Check for collisions with asteroids
-   LineSegment l1, l2;
-   for (AsteroidListIt it = asteroids_.begin();
-        it != asteroids_.end(); ++it) {
-      const Asteroid& a = *it;
-
-      if (a.ObjectInScreen(&viewport)) {
-         if (a.CheckCollision(ship)) {
-            // Crashed
-            if (state == gsInGame) {
-               // Destroy the ship
-               ExplodeShip();
-               ship.Bounce();
-            }
-            else if (state == gsExplode)
-               EnterDeathWait();
-         }
-      }
-   }
-
-   // Check for collision with gateways
-   for (ElectricGateListIt it = gateways.begin(); it != gateways.end(); ++it) {
-      if ((*it).CheckCollision(ship)) {
-         if (state == gsInGame) {
-            // Destroy the ship
-            ExplodeShip();
-            ship.Bounce();
-         }
-         else if (state == gsExplode) {
-            // Destroy the ship anyway
-            EnterDeathWait();
-         }
-      }
-   }
+   // Check for collisions with objects near the ship
+   collisionGrid.Query(ship.GetSweptBounds(), nearby);
+   for (CollisionGrid::Handle h : nearby) {
+      const int index = CollisionGrid::GetIndex(h);
 
-   // Check for collisions with mines
-   for (MineListIt it = mines.begin(); it != mines.end(); ++it) {
-      if ((*it).CheckCollision(ship)) {
-         if (state == gsInGame) {
-            // Destroy the ship
-            ExplodeShip();
-            ship.Bounce();
-         }
-         else if (state == gsExplode)
-            EnterDeathWait();
+      bool hit = false;
+      switch (CollisionGrid::GetKind(h)) {
+      case CollisionGrid::ASTEROID:
+         hit = asteroids_[index].CheckCollision(ship);
+         break;
+      case CollisionGrid::GATEWAY:
+         hit = gateways[index].CheckCollision(ship);
+         break;
+      case CollisionGrid::MINE:
+         hit = mines[index].CheckCollision(ship);
+         break;
+      case CollisionGrid::MISSILE:
+         hit = missiles[index].CheckCollison(ship);
+         break;
+      default:
+         break;
       }
-   }
 
-   // Check for collisons with missiles
-   for (MissileListIt it = missiles.begin(); it != missiles.end(); ++it) {
-      if ((*it).CheckCollison(ship)) {
+      if (hit) {
          if (state == gsInGame) {
             // Destroy the ship
             ExplodeShip();
@@ -293,6 +303,7 @@ void Game::Process()
    }
 
    // Entry / exit states
+   bool started = false;
    if (state == gsDeathWait) {
       if (--death_timeout == 0) {
          // Fade out
@@ -305,6 +316,7 @@ void Game::Process()
             }
 
             state = gsFadeToRestart;
+            PrepareLevel(level);
          }
 
          fade.BeginFadeOut();
@@ -325,18 +337,14 @@ void Game::Process()
    else if (state == gsFadeToRestart) {
       // Fade out
       if (fade.Process()) {
-         // Restart the level
-         StartLevel();
-         opengl.SkipDisplay();
+         // Start the level generated when the fade began
+         StartLevel(m_nextLevel.get());
+         started = true;
       }
    }
    else if (state == gsFadeToDeath) {
-      if (fade.Process()) {
-         // Return to main menu
-         ScreenManager& sm = ScreenManager::GetInstance();
-         HighScores* hs = static_cast<HighScores*>(sm.GetScreenById("HIGH SCORES"));
-         hs->CheckScore(score);
-      }
+      if (fade.Process())
+         state = gsFinished;
    }
    else if (state == gsLevelComplete) {
       // Decrease the displayed score
@@ -344,7 +352,6 @@ void Game::Process()
          countdown_timeout--;
       else if (levelcomp_timeout > 0) {
          if (--levelcomp_timeout == 0) {
-            level++;
             state = gsFadeToRestart;
             fade.BeginFadeOut();
          }
@@ -373,203 +380,332 @@ void Game::Process()
    if (leveltext_timeout > 0)
       leveltext_timeout--;
 
+   // Fade out the icon of a life that has just been lost
+   if (lives > 0 && life_alpha <= LIFE_ALPHA_BASE) {
+      if (life_alpha < 0.0f) {
+         lives--;
+         life_alpha = LIFE_ALPHA_BASE + 1.0f;
+      }
+      else
+         life_alpha -= LIFE_FADE_SPEED * timeScale;
+   }
+
    // Spin the ship if we're exploding
    if (state == gsExplode)
       ship.Turn(DEATH_SPIN_RATE);
+
+   return started;
 }
 
 // Increase n until it is a multiple of x and y
-void Game::MakeMultipleOf(int& n, int x, int y)
+void GameSim::MakeMultipleOf(int& n, int x, int y)
 {
    while (n % x > 0 || n % y > 0)
       ++n;
 }
 
 // There are between 1 and MAX_PADS landing pads in a level
-void Game::MakeLandingPads()
+void GameSim::MakeLandingPads(LevelDesc& desc)
 {
-   pads.clear();
-   int nLandingPads = rand()%MAX_PADS + 1;
+   const int nSections = desc.width / Surface::SURFACE_SIZE;
 
-   cout << "  Landing pads: " << nLandingPads << endl;
+   desc.pads.clear();
+   int nLandingPads = SimContext::Current().Rand()%MAX_PADS + 1;
 
    for (int i = 0; i < nLandingPads; i++) {
       int index, length;
       bool overlap;
       do {
-         index = rand() % (viewport.GetLevelWidth() / Surface::SURFACE_SIZE);
-         length = rand() % MAX_PAD_SIZE + 3;
+         index = SimContext::Current().Rand() % nSections;
+         length = SimContext::Current().Rand() % MAX_PAD_SIZE + 3;
 
          // Check for overlap
          overlap = false;
-         if (index + length > (viewport.GetLevelWidth() / Surface::SURFACE_SIZE))
+         if (index + length > nSections)
             overlap = true;
          for (int j = 0; j < i; j++) {
-            if (pads[j].GetIndex() == index)
+            const PadDesc& pad = desc.pads[j];
+            if (pad.index == index)
                overlap = true;
-            else if (pads[j].GetIndex() < index
-                     && pads[j].GetIndex() + pads[j].GetLength() >= index)
+            else if (pad.index < index && pad.index + pad.length >= index)
                overlap = true;
-            else if (index < pads[j].GetIndex()
-                     && index + length >= pads[j].GetIndex())
+            else if (index < pad.index && index + length >= pad.index)
                overlap = true;
          }
       } while (overlap);
 
-      pads.push_back(LandingPad(&viewport, index, length));
+      desc.pads.push_back(PadDesc{index, length, 0});
    }
 }
 
 // There are (level / 2) + (level % 2) keys per level
-void Game::MakeKeys()
+void GameSim::MakeKeys(LevelDesc& desc)
 {
-   nKeys = (level / 2) + (level % 2);
+   int nKeys = (desc.number / 2) + (desc.number % 2);
    if (nKeys > MAX_KEYS)
       nKeys = MAX_KEYS;
-   nKeysRemaining = nKeys;
-   const ArrowColour acols[MAX_KEYS] =
-      { acBlue, acRed, acYellow, acPink, acGreen };
-   keys.clear();
+   desc.keys.clear();
    for (int i = 0; i < MAX_KEYS; i++) {
       int xpos, ypos;
-      objgrid.AllocFreeSpace(xpos, ypos, 1, 1);
-      keys.push_back(Key(i < nKeysRemaining, xpos, ypos, acols[i]));
+      desc.objgrid.AllocFreeSpace(xpos, ypos, 1, 1);
+      desc.keys.push_back(LevelDesc::KeyDesc{xpos, ypos, i < nKeys});
    }
 }
 
-void Game::MakeAsteroids(int surftex)
+void GameSim::MakeAsteroids(LevelDesc& desc)
 {
-   int asteroidCount = 2 + level*2 + rand()%(level+3);
+   const int level = desc.number;
+   int asteroidCount = 2 + level*2 + SimContext::Current().Rand()%(level+3);
    if (asteroidCount > MAX_ASTEROIDS)
       asteroidCount = MAX_ASTEROIDS;
-   cout << "  Asteroids: " << asteroidCount << endl;
 
-   asteroids_.clear();
+   desc.asteroids.clear();
+   desc.asteroids.reserve(asteroidCount);
 
    for (int i = 0; i < asteroidCount; i++) {
       // Allocate space, check for timeout
-      int x, y, width = rand() % (Asteroid::MAX_ASTEROID_WIDTH - 4) + 4;
-      if (!objgrid.AllocFreeSpace(x, y, width, 4)) {
+      int x, y, width = SimContext::Current().Rand() % (Asteroid::MAX_ASTEROID_WIDTH - 4) + 4;
+      if (!desc.objgrid.AllocFreeSpace(x, y, width, 4)) {
          // Failed to allocate space so don't make any more asteroids
          break;
       }
 
       // Generate the asteroid
-      asteroids_.push_back(Asteroid(x, y, width, surftex));
+      desc.asteroids.emplace_back();
+      desc.asteroids.back().x = x;
+      desc.asteroids.back().y = y;
+      Asteroid::Generate(width, desc.asteroids.back().shape);
    }
 }
 
-void Game::MakeMissiles()
+void GameSim::MakeMissiles(LevelDesc& desc)
 {
-   int missileCount = max(level - 1 + rand()%level, 0);
+   const int level = desc.number;
+   const ObjectGrid& objgrid = desc.objgrid;
+
+   int missileCount = max(level - 1 + SimContext::Current().Rand()%level, 0);
    if (missileCount > MAX_MISSILES)
       missileCount = MAX_MISSILES;
-   cout << "  Missiles: " << missileCount << endl;
 
-   missiles.clear();
+   desc.missiles.clear();
    for (int i = 0; i < missileCount; i++) {
       Missile::Side side =
-         rand()%2 == 1 ? Missile::SIDE_LEFT : Missile::SIDE_RIGHT;
-      missiles.push_back(Missile(&objgrid, &viewport, side));
+         SimContext::Current().Rand()%2 == 1 ? Missile::SIDE_LEFT : Missile::SIDE_RIGHT;
+      const int x = (side == Missile::SIDE_LEFT) ? 0 : objgrid.GetWidth() - 1;
+
+      // Pick spaces at random until we find one that's empty
+      int y;
+      do {
+         y = SimContext::Current().Rand() % objgrid.GetHeight();
+      } while (objgrid.IsFilled(x, y));
+
+      desc.missiles.push_back(LevelDesc::MissileDesc{side, y});
    }
 }
 
-void Game::MakeGateways()
+void GameSim::MakeGateways(LevelDesc& desc)
 {
-   int gatewaycount = max(level/3 + rand()%level - 2, 0);
-   gateways.clear();
+   const int level = desc.number;
+   int gatewaycount = max(level/3 + SimContext::Current().Rand()%level - 2, 0);
+   desc.gateways.clear();
    if (gatewaycount > MAX_GATEWAYS)
       gatewaycount = MAX_GATEWAYS;
-   cout << "  Gateways: " << gatewaycount << endl;
 
    for (int i = 0; i < gatewaycount; i++) {
       // Allocate space for gateway
-      int length = rand()%(MAX_GATEWAY_LENGTH-3) + 3;
-      bool vertical = rand() % 2 == 0;
+      int length = SimContext::Current().Rand()%(MAX_GATEWAY_LENGTH-3) + 3;
+      bool vertical = SimContext::Current().Rand() % 2 == 0;
 
       bool result;
       int xpos, ypos;
       if (vertical)
-         result = objgrid.AllocFreeSpace(xpos, ypos, 1, length+1);
+         result = desc.objgrid.AllocFreeSpace(xpos, ypos, 1, length+1);
       else
-         result = objgrid.AllocFreeSpace(xpos, ypos, length+1, 1);
+         result = desc.objgrid.AllocFreeSpace(xpos, ypos, length+1, 1);
       if (!result) {
          // Failed to allocate space so don't make any more gateways
          break;
       }
 
-      gateways.push_back(ElectricGate(&viewport, length, vertical, xpos, ypos));
+      desc.gateways.push_back(
+         LevelDesc::GateDesc{xpos, ypos, length, vertical});
    }
 }
 
-void Game::MakeMines()
+void GameSim::MakeMines(LevelDesc& desc)
 {
-   int minecount = max(level/2 + rand()%level - 1, 0);
-   cout << "  Mines: " << minecount << endl;
+   const int level = desc.number;
+   int minecount = max(level/2 + SimContext::Current().Rand()%level - 1, 0);
 
-   mines.clear();
+   desc.mines.clear();
    if (minecount > MAX_MINES)
       minecount = MAX_MINES;
    for (int i = 0; i < minecount; i++) {
       // Allocate space for mine
       int xpos, ypos;
-      if (!objgrid.AllocFreeSpace(xpos, ypos, 2, 2)) {
+      if (!desc.objgrid.AllocFreeSpace(xpos, ypos, 2, 2)) {
          // Failed to allocate space
-         minecount = i + 1;
          break;
       }
-      mines.push_back(Mine(&objgrid, &viewport, xpos, ypos));
+
+      // Free the space again so the mines can move around
+      desc.objgrid.UnlockSpace(xpos, ypos, 2, 2);
+
+      desc.mines.push_back(LevelDesc::MineDesc{xpos, ypos});
    }
 }
 
-void Game::StartLevel()
+//
+// Works out everything about a level that is random. This does not use
+// the GL or touch the game so it can run on any thread.
+//
+LevelDesc GameSim::GenerateLevel(int number, uint32_t seed)
 {
-   cout << endl << "Start level " << level << ":" << endl;
-
-   // Set level size
-   int levelWidth = 2000 + 2*Surface::SURFACE_SIZE*level;
-   MakeMultipleOf(levelWidth, Surface::SURFACE_SIZE, ObjectGrid::OBJ_GRID_SIZE);
+   // The level only depends on the seed wherever it is generated
+   SimContext context;
+   context.Seed(seed);
+   SimContext::Scope scope(context);
 
-   int levelHeight = 1500 + 2*Surface::SURFACE_SIZE*level;
+   LevelDesc desc;
+   desc.number = number;
 
-   viewport.SetLevelWidth(levelWidth);
-   viewport.SetLevelHeight(levelHeight);
-   flGravity = GRAVITY;
+   // Set level size
+   desc.width = 2000 + 2*Surface::SURFACE_SIZE*number;
+   MakeMultipleOf(desc.width, Surface::SURFACE_SIZE, ObjectGrid::OBJ_GRID_SIZE);
 
-   cout << "  Dimensions: " << levelWidth << "x" << levelHeight << endl;
+   desc.height = 1500 + 2*Surface::SURFACE_SIZE*number;
 
    // Create the object grid
-   int grid_w = viewport.GetLevelWidth() / ObjectGrid::OBJ_GRID_SIZE;
-   int grid_h = (viewport.GetLevelHeight() - ObjectGrid::OBJ_GRID_TOP
+   int grid_w = desc.width / ObjectGrid::OBJ_GRID_SIZE;
+   int grid_h = (desc.height - ObjectGrid::OBJ_GRID_TOP
                  - MAX_SURFACE_HEIGHT - 100) / ObjectGrid::OBJ_GRID_SIZE;
-   objgrid.Reset(grid_w, grid_h);
+   desc.objgrid.Reset(grid_w, grid_h);
 
    // Create background stars
-   nStarCount = (viewport.GetLevelWidth() * viewport.GetLevelHeight()) / 10000;
+   int nStarCount = (desc.width * desc.height) / 10000;
    if (nStarCount > MAX_GAME_STARS)
       nStarCount = MAX_GAME_STARS;
-   for (int i = 0; i < nStarCount; i++) {
-      stars[i].xpos = (int)(rand()%(viewport.GetLevelWidth()/20))*20;
-      stars[i].ypos = (int)(rand()%(viewport.GetLevelHeight()/20))*20;
-      stars[i].scale = (double)rand()/(double)RAND_MAX/8.0;
+   desc.stars.resize(nStarCount);
+   for (LevelDesc::Star& star : desc.stars) {
+      star.xpos = (int)(SimContext::Current().Rand()%(desc.width/20))*20;
+      star.ypos = (int)(SimContext::Current().Rand()%(desc.height/20))*20;
+      star.scale = (double)SimContext::Current().Rand()/(double)Random::MAX/8.0;
    }
 
-   MakeLandingPads();
+   MakeLandingPads(desc);
 
    // Generate the surface
-   int surftex = rand() % Surface::NUM_SURF_TEX;
-   surface.Generate(surftex, pads);
+   desc.surftex = SimContext::Current().Rand() % Surface::NUM_SURF_TEX;
+   Surface::Generate(desc.width, desc.pads, desc.surface);
 
-   MakeKeys();
-   MakeAsteroids(surftex);
-   MakeMissiles();
-   MakeGateways();
+   MakeKeys(desc);
+   MakeAsteroids(desc);
+   MakeMissiles(desc);
+   MakeGateways(desc);
 
    // Create mines (MUST BE CREATED LAST)
-   MakeMines();
+   MakeMines(desc);
+
+   return desc;
+}
+
+//
+// Starts generating the given level using the next number from this
+// game's generator as the seed.
+//
+void GameSim::PrepareLevel(int number)
+{
+   const uint32_t seed = m_context.Rand();
+   auto generate = [number, seed] { return GenerateLevel(number, seed); };
+
+   if (m_backgroundLoading)
+      m_nextLevel = ThreadPool::GetInstance().Submit(generate);
+   else
+      m_nextLevel = async(launch::deferred, generate);
+}
+
+//
+// Creates the objects for a generated level. This is the only part of
+// changing level that has to happen on the main thread.
+//
+void GameSim::StartLevel(LevelDesc&& desc)
+{
+   level = desc.number;
+
+   if (m_verbose) {
+      cout << endl << "Start level " << level << ":" << endl
+           << "  Dimensions: " << desc.width << "x" << desc.height << endl
+           << "  Landing pads: " << desc.pads.size() << endl
+           << "  Asteroids: " << desc.asteroids.size() << endl
+           << "  Missiles: " << desc.missiles.size() << endl
+           << "  Gateways: " << desc.gateways.size() << endl
+           << "  Mines: " << desc.mines.size() << endl;
+   }
+
+   viewport.SetLevelWidth(desc.width);
+   viewport.SetLevelHeight(desc.height);
+   flGravity = GRAVITY;
+
+   objgrid = move(desc.objgrid);
+   stars = move(desc.stars);
+
+   pads.clear();
+   for (const PadDesc& p : desc.pads)
+      pads.push_back(LandingPad(&viewport, p));
+
+   surface.Load(desc.surftex, move(desc.surface), desc.pads);
+
+   const ArrowColour acols[MAX_KEYS] =
+      { acBlue, acRed, acYellow, acPink, acGreen };
+   keys.clear();
+   nKeys = 0;
+   for (size_t i = 0; i < desc.keys.size(); i++) {
+      const LevelDesc::KeyDesc& k = desc.keys[i];
+      keys.push_back(Key(k.active, k.x, k.y, acols[i]));
+      if (k.active)
+         nKeys++;
+   }
+   nKeysRemaining = nKeys;
+
+   asteroids_.clear();
+   for (const LevelDesc::AsteroidDesc& a : desc.asteroids)
+      asteroids_.push_back(Asteroid(a.x, a.y, a.shape, desc.surftex));
+
+   missiles.clear();
+   for (const LevelDesc::MissileDesc& m : desc.missiles)
+      missiles.push_back(Missile(&objgrid, &viewport, m.side, m.y));
+
+   gateways.clear();
+   for (const LevelDesc::GateDesc& g : desc.gateways)
+      gateways.push_back(
+         ElectricGate(&viewport, g.length, g.vertical, g.x, g.y));
+
+   mines.clear();
+   for (const LevelDesc::MineDesc& m : desc.mines)
+      mines.push_back(Mine(&objgrid, &viewport, m.x, m.y));
+
+   collisionGrid.Reset(desc.width, desc.height);
+   for (size_t i = 0; i < asteroids_.size(); i++)
+      collisionGrid.Insert(
+         CollisionGrid::MakeHandle(CollisionGrid::ASTEROID, i),
+         asteroids_[i].GetBounds());
+   for (size_t i = 0; i < gateways.size(); i++)
+      collisionGrid.Insert(
+         CollisionGrid::MakeHandle(CollisionGrid::GATEWAY, i),
+         gateways[i].GetBounds());
+   for (size_t i = 0; i < mines.size(); i++)
+      collisionGrid.Insert(
+         CollisionGrid::MakeHandle(CollisionGrid::MINE, i),
+         mines[i].GetBounds());
+   for (size_t i = 0; i < missiles.size(); i++)
+      collisionGrid.Insert(
+         CollisionGrid::MakeHandle(CollisionGrid::MISSILE, i),
+         missiles[i].GetBounds());
 
    // Set ship starting position
    ship.Reset();
+   ship.CentreInViewport();
+   viewport.SavePosition();
 
    leveltext_timeout = LEVEL_TEXT_TIMEOUT;
 
@@ -585,7 +721,7 @@ void Game::StartLevel()
 //
 // Destroys the ship after a collision.
 //
-void Game::ExplodeShip()
+void GameSim::ExplodeShip()
 {
    // Set the game state
    state = gsExplode;
@@ -596,26 +732,29 @@ void Game::ExplodeShip()
    impactSound.Play();
 }
 
-void Game::Display()
+void GameSim::Display(bool debugMode)
 {
    OpenGL& opengl = OpenGL::GetInstance();
 
    // Draw the stars
-   for (int i = 0; i < nStarCount; i++) {
+   for (size_t i = 0; i < stars.size(); i++) {
       int x = stars[i].xpos - viewport.GetXAdjust();
       int y = stars[i].ypos - viewport.GetYAdjust();
 
       starImage.Draw(x, y, starrotate, stars[i].scale);
-      starrotate += 0.005f * opengl.GetTimeScale();
    }
 
    surface.Display();
 
-   // Draw the asteroids
-   for (AsteroidListIt it = asteroids_.begin();
-        it != asteroids_.end(); ++it) {
-      if ((*it).ObjectInScreen(&viewport))
-         (*it).Draw(viewport.GetXAdjust(), viewport.GetYAdjust());
+   // Draw the asteroids on screen
+   const Rect screen = { viewport.GetXAdjust(), viewport.GetYAdjust(),
+                         viewport.GetScreenWidth(),
+                         viewport.GetScreenHeight() };
+   collisionGrid.Query(screen, nearby);
+   for (CollisionGrid::Handle h : nearby) {
+      if (CollisionGrid::GetKind(h) == CollisionGrid::ASTEROID)
+         asteroids_[CollisionGrid::GetIndex(h)].Draw(viewport.GetXAdjust(),
+                                                     viewport.GetYAdjust());
    }
 
    // Draw the keys
@@ -634,31 +773,27 @@ void Game::Display()
    for (MissileListIt it = missiles.begin(); it != missiles.end(); ++it)
       (*it).Draw();
 
-   if (bDebugMode) {
+   if (debugMode) {
       // Draw red squares around no-go areas
-      int x, y;
-      glDisable(GL_DEPTH_TEST);
-      glEnable(GL_BLEND);
-      glColor4f(1.0f, 0.0f, 0.0f, 0.4f);
-      for (x = 0; x < objgrid.GetWidth(); x++) {
-         for (y = 0; y < objgrid.GetHeight(); y++) {
-            if (objgrid.IsFilled(x, y)) {
-               glLoadIdentity();
-               glBegin(GL_QUADS);
-               glVertex2i(x*ObjectGrid::OBJ_GRID_SIZE - viewport.GetXAdjust(),
-                          y*ObjectGrid::OBJ_GRID_SIZE - viewport.GetYAdjust()
-                          + ObjectGrid::OBJ_GRID_TOP);
-               glVertex2i((x+1)*ObjectGrid::OBJ_GRID_SIZE - viewport.GetXAdjust(),
-                          y*ObjectGrid::OBJ_GRID_SIZE - viewport.GetYAdjust()
-                          + ObjectGrid::OBJ_GRID_TOP);
-               glVertex2i((x+1)*ObjectGrid::OBJ_GRID_SIZE - viewport.GetXAdjust(),
-                          (y+1)*ObjectGrid::OBJ_GRID_SIZE - viewport.GetYAdjust()
-                          + ObjectGrid::OBJ_GRID_TOP);
-               glVertex2i(x*ObjectGrid::OBJ_GRID_SIZE - viewport.GetXAdjust(),
-                          (y+1)*ObjectGrid::OBJ_GRID_SIZE - viewport.GetYAdjust()
-                          + ObjectGrid::OBJ_GRID_TOP);
-               glEnd();
-            }
+      const int size = ObjectGrid::OBJ_GRID_SIZE;
+      const VertexI quad[4] = {
+         { 0, size, 0.0f, 0.0f },
+         { 0, 0, 0.0f, 1.0f },
+         { size, 0, 1.0f, 1.0f },
+         { size, size, 1.0f, 0.0f }
+      };
+      const Colour red = Colour::Make(1.0f, 0.0f, 0.0f, 0.4f);
+
+      SpriteBatch& sprites = opengl.GetSpriteBatch();
+
+      for (int x = 0; x < objgrid.GetWidth(); x++) {
+         for (int y = 0; y < objgrid.GetHeight(); y++) {
+            if (objgrid.IsFilled(x, y))
+               sprites.Add(m_gridTexture, quad,
+                           x*size - viewport.GetXAdjust(),
+                           y*size - viewport.GetYAdjust()
+                           + ObjectGrid::OBJ_GRID_TOP,
+                           0.0f, 1.0f, red);
          }
       }
    }
@@ -676,63 +811,138 @@ void Game::Display()
    }
 
    // Draw the explosion if necessary
-   if (state == gsExplode) {
+   if (state == gsExplode || state == gsDeathWait || state == gsGameOver
+       || state == gsFadeToDeath || state == gsFadeToRestart) {
       ship.DrawExplosion();
+   }
+
+   // Draw the arrows
+   for (KeyListIt it = keys.begin(); it != keys.end(); ++it)
+      (*it).DrawArrow(&viewport);
+}
+
+Game::Game()
+   : bDebugMode(false),
+     newscore_width(-1),
+     levelComp("images/levelcomp.png"),
+     smallShip("images/shipsmall.png"),
+     gameOver("images/gameover.png"),
+     normalFont("fonts/VeraBd.ttf", 11),
+     scoreFont("fonts/VeraBd.ttf", 16),
+     bigFont("fonts/VeraBd.ttf", 20)
+{
+   m_sim.EnableBackgroundLoading();
+}
+
+Game::~Game()
+{
+
+}
+
+void Game::Load()
+{
+   bDebugMode = false;
+}
+
+void Game::NewGame()
+{
+   OpenGL& opengl = OpenGL::GetInstance();
+
+   int level;
+   {
+      ConfigFile cfile;
+      level = cfile.get_int("level", 1);
+   }
+
+   // Seeded from rand() so recorded sessions replay the same levels
+   m_sim.GetContext().SetTimeScale(opengl.GetTimeScale());
+   m_sim.SetScreenSize(opengl.GetWidth(), opengl.GetHeight());
+   m_sim.NewGame(level, rand());
+}
+
+void Game::Process()
+{
+   Input& input = Input::GetInstance();
+   OpenGL& opengl = OpenGL::GetInstance();
+
+   // Check keys
+   if (input.QueryResetAction(Input::PAUSE))
+      m_sim.TogglePause();
+
+   if (input.QueryResetAction(Input::SCREENSHOT))
+      opengl.DeferScreenShot();
+
+   if (input.QueryResetAction(Input::DEBUG)) {
+      // Toggle debug mode
+      bDebugMode = !bDebugMode;
+   }
+
+   unsigned actions = 0;
+   const Input::Action held[] = {
+      Input::THRUST, Input::LEFT, Input::RIGHT, Input::SKIP, Input::ABORT
+   };
+   for (Input::Action a : held) {
+      if (input.QueryAction(a))
+         actions |= GameSim::ActionBit(a);
+   }
+
+   if (m_sim.Process(actions))
+      opengl.SkipDisplay();
+
+   if (m_sim.IsFinished()) {
+      // Return to main menu
+      ScreenManager& sm = ScreenManager::GetInstance();
+      HighScores* hs = static_cast<HighScores*>(sm.GetScreenById("HIGH SCORES"));
+      hs->CheckScore(m_sim.GetScore());
+   }
+}
+
+void Game::Display()
+{
+   OpenGL& opengl = OpenGL::GetInstance();
+   GameSim& sim = m_sim;
+
+   sim.Display(bDebugMode);
+
+   if (sim.state == GameSim::gsExplode) {
       const char* sdeath = i18n("Press SPACE to continue");
       int x = (opengl.GetWidth() - normalFont.GetStringWidth(sdeath)) / 2;
       int y = opengl.GetHeight() - 40;
       normalFont.SetColour(0.0f, 1.0f, 0.0f);
       normalFont.Print(x, y, sdeath);
    }
-   else if (state == gsDeathWait || state == gsGameOver
-            || state == gsFadeToDeath || state == gsFadeToRestart) {
-      ship.DrawExplosion();
-   }
-
-   // Draw the arrows
-   for (KeyListIt it = keys.begin(); it != keys.end(); ++it)
-      (*it).DrawArrow(&viewport);
 
    // Draw HUD
    scoreFont.SetColour(0.0f, 0.9f, 0.0f);
-   scoreFont.Print(10, SCORE_Y, "%.7d", score);
+   scoreFont.Print(10, SCORE_Y, "%.7d", sim.score);
 
-   fuelmeter.Display();
-   speedmeter.Display();
+   sim.fuelmeter.Display();
+   sim.speedmeter.Display();
 
    // Draw life icons
-   for (int i = 0; i < lives; i++) {
+   for (int i = 0; i < sim.lives; i++) {
       int draw_x = 5 + i*30;
       int draw_y = 60;
-      if (i == lives-1) {
-         if (life_alpha > LIFE_ALPHA_BASE)
-            smallShip.Draw(draw_x, draw_y);
-         else if (life_alpha < 0.0f) {
-            // Decrement lives
-            lives--;
-            life_alpha = LIFE_ALPHA_BASE + 1.0f;
-         }
-         else {
-            smallShip.Draw(draw_x, draw_y, 0.0, 1.0, life_alpha);
-            life_alpha -= 0.03f;
-         }
-      }
+      if (i == sim.lives-1 && sim.life_alpha <= GameSim::LIFE_ALPHA_BASE)
+         smallShip.Draw(draw_x, draw_y, 0.0, 1.0, max(sim.life_alpha, 0.0f));
       else
          smallShip.Draw(draw_x, draw_y);
    }
 
    // Draw key icons
-   int offset = (opengl.GetWidth() - MAX_KEYS*32)/2;
-   if (nKeysRemaining > 0) {
+   int offset = (opengl.GetWidth() - GameSim::MAX_KEYS*32)/2;
+   if (sim.nKeysRemaining > 0) {
       int i = 0;
-      for (KeyListIt it = keys.begin(); it != keys.end(); ++it) {
+      for (GameSim::KeyListIt it = sim.keys.begin();
+           it != sim.keys.end(); ++it) {
          (*it).DrawIcon(offset + i, 0.3f);
          i += 32;
       }
    }
    else {
       int i = 0;
-      for (KeyListIt it = keys.begin(); it != keys.end(); ++it) {
+      for (GameSim::KeyListIt it = sim.keys.begin();
+           it != sim.keys.end(); ++it) {
          (*it).DrawIcon(offset + i, 0.0f);
          i += 32;
       }
@@ -745,40 +955,48 @@ void Game::Display()
 
    // Draw level complete messages
    const char* scoretxt = i18n("Score:  %d");
-   if (state == gsLevelComplete) {
+   if (sim.state == GameSim::gsLevelComplete) {
       int lc_x = (opengl.GetWidth() - levelComp.GetWidth()) / 2;
       int lc_y = (opengl.GetHeight() - levelComp.GetHeight()) / 2 - 50;
       levelComp.Draw(lc_x, lc_y);
 
-      int printScore = newscore > 0 ? newscore : 0;
+      // Keep the text still while the score counts down
+      if (newscore_width < 0)
+         newscore_width = bigFont.GetStringWidth(scoretxt, sim.newscore);
+
+      int printScore = sim.newscore > 0 ? sim.newscore : 0;
       int x = (opengl.GetWidth() - newscore_width) / 2;
       int y = (opengl.GetHeight() - 30)/2 + 50;
       bigFont.SetColour(0.0f, 0.5f, 0.9f);
       bigFont.Print(x, y, scoretxt, printScore);
    }
+   else
+      newscore_width = -1;
 
    // Draw level number text
-   if (leveltext_timeout) {
+   if (sim.leveltext_timeout) {
       const char* lvltxt = i18n("Level  %d");
-      int x = (opengl.GetWidth() - bigFont.GetStringWidth(lvltxt, level)) / 2;
+      int x = (opengl.GetWidth() - bigFont.GetStringWidth(lvltxt, sim.level)) / 2;
       int y = (opengl.GetHeight() - 30) / 2;
       bigFont.SetColour(0.9f, 0.9f, 0.0f);
-      bigFont.Print(x, y, lvltxt, level);
+      bigFont.Print(x, y, lvltxt, sim.level);
    }
 
    // Draw the fade
-   if (state == gsFadeIn || state == gsFadeToDeath || state == gsFadeToRestart)
-      fade.Display();
+   if (sim.state == GameSim::gsFadeIn || sim.state == GameSim::gsFadeToDeath
+       || sim.state == GameSim::gsFadeToRestart)
+      sim.fade.Display();
 
    // Draw game over message
-   if (lives == 0 || (lives == 1 && life_alpha < LIFE_ALPHA_BASE)) {
+   if (sim.lives == 0
+       || (sim.lives == 1 && sim.life_alpha < GameSim::LIFE_ALPHA_BASE)) {
       int draw_x = (opengl.GetWidth() - gameOver.GetWidth()) / 2;
       int draw_y = (opengl.GetHeight() - 150)/2;
       gameOver.Draw(draw_x, draw_y);
    }
 
    // Draw paused message
-   if (state == gsPaused) {
+   if (sim.state == GameSim::gsPaused) {
       const char* txtpaused = i18n("Paused");
       int x = (opengl.GetWidth() - bigFont.GetStringWidth(txtpaused) - 20) / 2;
       int y = (opengl.GetHeight() - 150) / 2;
@@ -792,7 +1010,7 @@ FuelMeter::FuelMeter()
      fuelBarTexture(Texture::Load("images/fuelbar.png")),
      maxfuel(1)
 {
-   RebuildVBO();
+
 }
 
 void FuelMeter::RebuildVBO()
@@ -800,6 +1018,11 @@ void FuelMeter::RebuildVBO()
    const int maxWidth = 256 - FUELBAR_OFFSET;
 
    int fbsize = (int)((m_fuel/(float)maxfuel)*maxWidth);
+   if (fbsize == m_fbsize)
+      return;    // Nothing visible has changed
+
+   m_fbsize = fbsize;
+
    float texsize = fbsize/(float)maxWidth;
    const int height = 32;
 
@@ -810,13 +1033,18 @@ void FuelMeter::RebuildVBO()
       { maxWidth, height, 1.0f, 0.0f }
    };
 
-   m_vbo = VertexBuffer::Make(vertices, 4);
+   if (m_vbo.IsValid())
+      m_vbo.Update(vertices, 0, 4);
+   else
+      m_vbo = VertexBuffer::MakeDynamic(vertices, 4);
 }
 
 void FuelMeter::Display()
 {
    OpenGL& opengl = OpenGL::GetInstance();
 
+   RebuildVBO();
+
    opengl.Reset();
    opengl.SetTexture(fuelBarTexture);
    opengl.SetTranslation(opengl.GetWidth()+FUELBAR_OFFSET-256-10, FUELBAR_Y);
@@ -831,18 +1059,14 @@ void FuelMeter::Refuel(int howmuch)
 {
    maxfuel = howmuch;
    m_fuel = maxfuel;
-
-   RebuildVBO();
 }
 
 void FuelMeter::BurnFuel()
 {
    assert(m_fuel > 0.0f);
-   m_fuel -= OpenGL::GetInstance().GetTimeScale();
+   m_fuel -= SimContext::Current().GetTimeScale();
    if (m_fuel < 0.0f)
       m_fuel = 0.0f;
-
-   RebuildVBO();
 }
 
 int FuelMeter::GetFuel() const
@@ -15,6 +15,7 @@
 
 #include "Viewport.hpp"
 #include "ObjectGrid.hpp"
+#include "CollisionGrid.hpp"
 #include "Asteroid.hpp"
 #include "Ship.hpp"
 #include "LandingPad.hpp"
@@ -23,6 +24,10 @@
 #include "Missile.hpp"
 #include "ElectricGate.hpp"
 #include "Key.hpp"
+#include "SimContext.hpp"
+
+#include <future>
+#include <memory>
 
 // Different fonts to be loaded
 enum FontType { ftNormal, ftBig, ftScore, ftScoreName, ftLarge };
@@ -38,6 +43,7 @@ public:
    void BurnFuel();
 
    int GetFuel() const;
+   int GetMaxFuel() const { return maxfuel; }
 
 private:
    void RebuildVBO();
@@ -50,6 +56,7 @@ private:
 
    int maxfuel;
    float m_fuel = 0.0f;
+   int m_fbsize = -1;
 };
 
 class SpeedMeter {
@@ -69,34 +76,114 @@ private:
    Ship* ship;
 };
 
-class Game : public Screen {
-public:
-   Game();
-   virtual ~Game();
+//
+// Everything about a level that is decided at random. This is plain data
+// generated without the GL so the next level can be worked out on
+// another thread while the current one fades out.
+//
+struct LevelDesc {
+   int number;
+   int width, height;
+   ObjectGrid objgrid;
+   int surftex;
+   Surface::SectionList surface;
+   vector<PadDesc> pads;
 
-   void Load();
-   void Process();
-   void Display();
-   void NewGame();
-   void StartLevel();
+   struct Star {
+      double scale;
+      int xpos, ypos;
+   };
+   vector<Star> stars;
+
+   struct KeyDesc {
+      int x, y;
+      bool active;
+   };
+   vector<KeyDesc> keys;
+
+   struct AsteroidDesc {
+      int x, y;
+      Asteroid::Shape shape;
+   };
+   vector<AsteroidDesc> asteroids;
+
+   struct MissileDesc {
+      Missile::Side side;
+      int y;
+   };
+   vector<MissileDesc> missiles;
+
+   struct GateDesc {
+      int x, y, length;
+      bool vertical;
+   };
+   vector<GateDesc> gateways;
+
+   struct MineDesc {
+      int x, y;
+   };
+   vector<MineDesc> mines;
+};
 
-   const char *GetName() const override { return "GAME"; }
+//
+// The state of one game independent of the display and input devices.
+// Several of these can be stepped at once on different threads as long
+// as the GL is not used which means running headless.
+//
+class GameSim {
+public:
+   explicit GameSim(bool verbose = true);
+
+   void SetScreenSize(int width, int height);
+   void EnableBackgroundLoading();
+   void NewGame(int level, uint32_t seed);
+   bool Process(unsigned actions);
+   void TogglePause();
+   void Display(bool debugMode);
+
+   // Bit for each Input::Action in the mask passed to Process
+   static unsigned ActionBit(int action) { return 1u << action; }
+
+   SimContext& GetContext() { return m_context; }
+   const Ship& GetShip() const { return ship; }
+   const Viewport& GetViewport() const { return viewport; }
+   const FuelMeter& GetFuelMeter() const { return fuelmeter; }
+   const LandingPadList& GetPads() const { return pads; }
+   int GetScore() const { return score; }
+   int GetLevel() const { return level; }
+   int GetLives() const { return lives; }
+   int GetKeysRemaining() const { return nKeysRemaining; }
+
+   bool IsPlaying() const { return state == gsInGame; }
+   bool HasLanded() const { return state == gsLevelComplete; }
+   bool HasCrashed() const;
+   bool IsFinished() const { return state == gsFinished; }
+
+   template <typename F>
+   void ForEachHazard(F f) const;
 
 private:
+   friend class Game;
+
    static const float TURN_ANGLE, DEATH_SPIN_RATE;
    static const int FUEL_BASE, FUEL_PER_LEVEL;
    static const int SCORE_PAD_SIZE, SCORE_LEVEL, SCORE_FUEL_DIV;
-   static const int SCORE_Y, DEATH_TIMEOUT, LEVEL_TEXT_TIMEOUT;
+   static const int DEATH_TIMEOUT, LEVEL_TEXT_TIMEOUT;
    static const int MAX_SURFACE_HEIGHT, MAX_PAD_SIZE, FUEL_OFFSET;
    static const float SHIP_SPEED, GRAVITY, GAME_FADE_IN_SPEED,
-      GAME_FADE_OUT_SPEED, LIFE_ALPHA_BASE;
+      GAME_FADE_OUT_SPEED, LIFE_ALPHA_BASE, LIFE_FADE_SPEED,
+      STAR_ROTATE_SPEED;
 
-   void MakeLandingPads();
-   void MakeKeys();
-   void MakeAsteroids(int surftex);
-   void MakeMissiles();
-   void MakeGateways();
-   void MakeMines();
+   static LevelDesc GenerateLevel(int number, uint32_t seed);
+   static void MakeLandingPads(LevelDesc& desc);
+   static void MakeKeys(LevelDesc& desc);
+   static void MakeAsteroids(LevelDesc& desc);
+   static void MakeMissiles(LevelDesc& desc);
+   static void MakeGateways(LevelDesc& desc);
+   static void MakeMines(LevelDesc& desc);
+
+   void PrepareLevel(int number);
+   void StartLevel(LevelDesc&& desc);
 
    void ExplodeShip();
    void EnterDeathWait(int timeout = DEATH_TIMEOUT);
@@ -104,6 +191,14 @@ private:
 
    static void MakeMultipleOf(int& n, int x, int y);
 
+   // Random numbers and step length for this game only
+   SimContext m_context;
+   bool m_verbose;
+
+   // The level to start after the next fade out
+   bool m_backgroundLoading = false;
+   future<LevelDesc> m_nextLevel;
+
    Viewport viewport;
    Ship ship;
    Surface surface;
@@ -111,32 +206,25 @@ private:
    FuelMeter fuelmeter;
    SpeedMeter speedmeter;
    int death_timeout, level, lives;
-   bool bDebugMode;
    float flGravity, starrotate, life_alpha;
-   int score, newscore, nextnewlife, newscore_width;
+   int score, newscore, nextnewlife;
    int countdown_timeout, leveltext_timeout, levelcomp_timeout;
 
    enum GameState { gsNone, gsInGame, gsExplode, gsGameOver, gsDeathWait,
                     gsFadeIn, gsFadeToDeath, gsFadeToRestart, gsLevelComplete,
-                    gsPaused };
+                    gsPaused, gsFinished };
    GameState state;
 
-   Image levelComp, smallShip;
-   Image starImage, gameOver;
+   Image starImage;
+   Texture m_gridTexture;   // Plain white for the debug grid
 
    Fade fade;
 
-   Font normalFont, scoreFont, bigFont;
-
    SoundEffect impactSound, collectSound;
 
    // Stars
    static const int MAX_GAME_STARS = 2048;
-   struct Star {
-      double scale;
-      int xpos, ypos;
-   } stars[MAX_GAME_STARS];
-   int nStarCount;
+   vector<LevelDesc::Star> stars;
 
    // Landing pads
    static const int MAX_PADS = 3;
@@ -173,4 +261,52 @@ private:
    typedef vector<Missile> MissileList;
    typedef MissileList::iterator MissileListIt;
    MissileList missiles;
+
+   // Broadphase for collisions with the objects above
+   CollisionGrid collisionGrid;
+   vector<CollisionGrid::Handle> nearby;
+};
+
+//
+// Calls f with the bounds of every object that can destroy the ship.
+//
+template <typename F>
+void GameSim::ForEachHazard(F f) const
+{
+   for (const Asteroid& a : asteroids_)
+      f(a.GetBounds());
+   for (const ElectricGate& g : gateways)
+      f(g.GetBounds());
+   for (const Mine& m : mines)
+      f(m.GetBounds());
+   for (const Missile& m : missiles)
+      f(m.GetBounds());
+}
+
+//
+// The screen that plays a GameSim using the keyboard or joystick and
+// draws the score, fuel, lives, etc. over it.
+//
+class Game : public Screen {
+public:
+   Game();
+   virtual ~Game();
+
+   void Load();
+   void Process();
+   void Display();
+   void NewGame();
+
+   const char *GetName() const override { return "GAME"; }
+
+private:
+   static const int SCORE_Y;
+
+   GameSim m_sim;
+   bool bDebugMode;
+   int newscore_width;
+
+   Image levelComp, smallShip, gameOver;
+
+   Font normalFont, scoreFont, bigFont;
 };
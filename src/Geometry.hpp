@@ -21,4 +21,9 @@ struct LineSegment
     Point p1, p2;
 };
 
+struct Rect
+{
+    int x, y, w, h;
+};
+
 #endif
@@ -16,9 +16,9 @@ const float HighScores::FADE_OUT_SPEED(-0.02f);
 
 HighScores::HighScores()
    : hscoreImage("images/hscore.png"),
-     largeFont(LocateResource("fonts/VeraBd.ttf"), 15),
-     scoreNameFont(LocateResource("fonts/VeraBd.ttf"), 14),
-     fwBang(LocateResource("sounds/firework_1.wav"))
+     largeFont("fonts/VeraBd.ttf", 15),
+     scoreNameFont("fonts/VeraBd.ttf", 14),
+     fwBang("sounds/firework_1.wav")
 {
 
 }
@@ -8,19 +8,24 @@
 #include "Texture.hpp"
 
 Image::Image(const string& fileName)
-   : m_texture(Texture::Load(fileName))
+   : m_texture(Texture::LoadSprite(fileName))
 {
    const int width = GetWidth();
    const int height = GetHeight();
 
+   const float tex_l = m_texture.MapU(0.0f);
+   const float tex_r = m_texture.MapU(1.0f);
+   const float tex_t = m_texture.MapV(0.0f);
+   const float tex_b = m_texture.MapV(1.0f);
+
    const VertexI vertices[4] = {
-      { -(width/2), -(height/2), 0.0f, 0.0f },
-      { -(width/2), height/2, 0.0f, 1.0f },
-      { width/2, height/2, 1.0f, 1.0f },
-      { width/2, -height/2, 1.0f, 0.0f }
+      { -(width/2), -(height/2), tex_l, tex_t },
+      { -(width/2), height/2, tex_l, tex_b },
+      { width/2, height/2, tex_r, tex_b },
+      { width/2, -height/2, tex_r, tex_t }
    };
 
-   m_vbo = VertexBuffer::Make(vertices, 4);
+   copy(vertices, vertices + 4, m_quad);
 }
 
 void Image::Draw(int x, int y, float rotate, float scale,
@@ -29,15 +34,10 @@ void Image::Draw(int x, int y, float rotate, float scale,
    int width = GetWidth();
    int height = GetHeight();
 
-   OpenGL& opengl = OpenGL::GetInstance();
+   SpriteBatch& sprites = OpenGL::GetInstance().GetSpriteBatch();
 
-   opengl.Reset();
-   opengl.SetTexture(m_texture);
-   opengl.SetColour(white, white, white, alpha);
-   opengl.SetTranslation(x + width/2, y + height/2);
-   opengl.SetScale(scale);
-   opengl.SetRotation(rotate);
-   opengl.Draw(m_vbo);
+   sprites.Add(m_texture, m_quad, x + width/2, y + height/2, rotate, scale,
+               Colour::Make(white, white, white, alpha));
 }
 
 int Image::GetWidth() const
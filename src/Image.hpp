@@ -27,5 +27,5 @@ protected:
 
 private:
    Texture m_texture;
-   VertexBuffer m_vbo;
+   VertexI m_quad[4];
 };
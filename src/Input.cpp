@@ -64,7 +64,9 @@ Input& Input::GetInstance()
 //
 void Input::Update()
 {
-   m_fakeAction = NUM_ACTIONS;
+   m_fakeActions = 0;
+
+   const string oldText = text;
 
    SDL_Event e;
    while (SDL_PollEvent(&e))    {
@@ -76,7 +78,7 @@ void Input::Update()
 
       case SDL_KEYDOWN:
          // Type a character in text input mode
-         if (textinput) {
+         if (textinput && !m_replay.IsReading()) {
             if ((e.key.keysym.sym >= SDLK_a && e.key.keysym.sym <= SDLK_z)
                 || (e.key.keysym.sym >= SDLK_0 && e.key.keysym.sym <= SDLK_9)
                 || (e.key.keysym.sym == SDLK_SPACE)) {
@@ -157,6 +159,60 @@ void Input::Update()
       if (actionIgnore[i] > 0)
          actionIgnore[i]--;
    }
+
+   if (m_replay.IsWriting())
+      RecordTick(oldText);
+   else if (m_replay.IsReading())
+      ReplayTick();
+}
+
+//
+// Writes the device state for this step to the replay file.
+//
+void Input::RecordTick(const string& oldText)
+{
+   static_assert(NUM_ACTIONS < 16, "too many actions for replay mask");
+
+   uint16_t actions = 0;
+   for (int i = 0; i < NUM_ACTIONS; i++) {
+      if (QueryDevice((Action)i))
+         actions |= 1 << i;
+   }
+
+   m_replay.WriteTick(actions, text != oldText ? &text : nullptr);
+}
+
+//
+// Replaces the device state for this step with the recorded one. The
+// game stops at the end of the recording.
+//
+void Input::ReplayTick()
+{
+   uint16_t actions;
+   if (m_replay.ReadTick(actions, text))
+      m_fakeActions = actions;
+   else {
+      cout << "End of replay" << endl;
+      m_replay.Close();
+      OpenGL::GetInstance().Stop();
+   }
+}
+
+void Input::StartRecording(const string& fileName, const ReplayHeader& header)
+{
+   m_replay.OpenForWrite(fileName, header);
+
+   cout << "Recording input to " << fileName << endl;
+}
+
+const ReplayHeader& Input::StartReplay(const string& fileName)
+{
+   const ReplayHeader& header = m_replay.OpenForRead(fileName);
+
+   cout << "Replaying input from " << fileName << " (seed " << header.seed
+        << ")" << endl;
+
+   return header;
 }
 
 // Query an action and reset if fired.
@@ -172,16 +228,24 @@ bool Input::QueryResetAction(Action a)
 // Either on the keyboard on the first joystick.
 bool Input::QueryAction(Action a) const
 {
-   int numkeys;
-   const Uint8* keystate;
-
    if (actionIgnore[a] > 0)
       return false;
 
-   if (a == m_fakeAction)
+   if (m_fakeActions & (1 << a))
       return true;
 
-   keystate = SDL_GetKeyboardState(&numkeys);
+   // Only the recorded input is used during a replay
+   if (m_replay.IsReading())
+      return false;
+
+   return QueryDevice(a);
+}
+
+// Returns true if the keyboard or joystick is performing action a.
+bool Input::QueryDevice(Action a) const
+{
+   int numkeys;
+   const Uint8* keystate = SDL_GetKeyboardState(&numkeys);
 
    switch (a) {
    case UP:
@@ -219,9 +283,10 @@ void Input::ResetAction(Action a)
    actionIgnore[a] = RESET_TIMEOUT;
 }
 
+// Performs action a until the next update.
 void Input::FakeAction(Action a)
 {
-   m_fakeAction = a;
+   m_fakeActions |= 1 << a;
 }
 
 //
@@ -6,10 +6,14 @@
 #pragma once
 
 #include "Platform.hpp"
+#include "Replay.hpp"
 
 //
 // A singleton class to manage SDL input.
 //
+// The state of every action can be recorded at each simulation step
+// and later played back in place of the keyboard and joystick.
+//
 class Input {
 public:
    // Possible inputs
@@ -28,6 +32,9 @@ public:
    void Update();
    void FakeAction(Action a);
 
+   void StartRecording(const string& fileName, const ReplayHeader& header);
+   const ReplayHeader& StartReplay(const string& fileName);
+
    void OpenCharBuffer(int max=256);
    void CloseCharBuffer();
    string GetInput() const;
@@ -36,6 +43,10 @@ private:
    Input();
    ~Input();
 
+   bool QueryDevice(Action a) const;
+   void RecordTick(const string& oldText);
+   void ReplayTick();
+
    static const int RESET_TIMEOUT;		// Frames between key presses
 
    SDL_Joystick* joystick;
@@ -50,7 +61,10 @@ private:
    // Record joystick state
    bool joyLeft, joyRight, joyUp, joyDown, joyButton0, joyButton1;
 
-   Action m_fakeAction = NUM_ACTIONS;
+   // Bit mask of actions performed by the test driver or a replay
+   uint16_t m_fakeActions = 0;
+
+   ReplayFile m_replay;
 
    static const int JOYSTICK_DEADZONE = 3500;
 };
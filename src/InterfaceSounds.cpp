@@ -10,14 +10,14 @@
 
 void InterfaceSounds::PlayBleep()
 {
-   static SoundEffect bleepSound(LocateResource("sounds/bleep.wav"));
+   static SoundEffect bleepSound("sounds/bleep.wav");
 
    bleepSound.Play();
 }
 
 void InterfaceSounds::PlaySelect()
 {
-   static SoundEffect selectSound(LocateResource("sounds/select.wav"));
+   static SoundEffect selectSound("sounds/select.wav");
 
    selectSound.Play();
 }
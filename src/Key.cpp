@@ -4,6 +4,7 @@
 //
 
 #include "Key.hpp"
+#include "SimContext.hpp"
 #include "OpenGL.hpp"
 #include "Viewport.hpp"
 #include "ObjectGrid.hpp"
@@ -21,13 +22,11 @@ Key::Key(bool active, int xpos, int ypos, ArrowColour acol)
    alpha = active ? 1.0 : 0.0;
 }
 
-void Key::DrawKey(Viewport* viewport)
+void Key::Process()
 {
-   int draw_x = xpos*OBJ_GRID_SIZE - viewport->GetXAdjust();
-   int draw_y = ypos*OBJ_GRID_SIZE - viewport->GetYAdjust() + OBJ_GRID_TOP;
-   image.Draw(draw_x, draw_y, 0.0, 1.0, alpha);
+   const SimContext::TimeScale timeScale = SimContext::Current().GetTimeScale();
 
-   m_rotateAnim += KEY_ROTATION_SPEED * OpenGL::GetInstance().GetTimeScale();
+   m_rotateAnim += KEY_ROTATION_SPEED * timeScale;
 
    if (m_rotateAnim > 1.0f) {
       image.NextFrame();
@@ -35,7 +34,14 @@ void Key::DrawKey(Viewport* viewport)
    }
 
    if (!active && alpha > 0.0f)
-      alpha -= 0.02f;
+      alpha -= 0.02f * timeScale;
+}
+
+void Key::DrawKey(Viewport* viewport) const
+{
+   int draw_x = xpos*OBJ_GRID_SIZE - viewport->GetXAdjust();
+   int draw_y = ypos*OBJ_GRID_SIZE - viewport->GetYAdjust() + OBJ_GRID_TOP;
+   image.Draw(draw_x, draw_y, 0.0, 1.0, max(alpha, 0.0f));
 }
 
 void Key::DrawArrow(Viewport* viewport) const
@@ -16,7 +16,8 @@ class Key : public StaticObject {
 public:
    Key(bool active, int xpos, int ypos, ArrowColour acol);
 
-   void DrawKey(Viewport* viewport);
+   void Process();
+   void DrawKey(Viewport* viewport) const;
    void DrawArrow(Viewport* viewport) const;
    void DrawIcon(int offset, float minAlpha) const;
    bool CheckCollision(Ship& ship) const;
@@ -0,0 +1,183 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "LanderEnv.hpp"
+#include "OpenGL.hpp"
+#include "SoundEffect.hpp"
+#include "Input.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+const float LanderEnv::LAND_REWARD(1.0f);
+const float LanderEnv::CRASH_REWARD(-1.0f);
+const float LanderEnv::KEY_REWARD(0.1f);
+
+void LanderEnv::Initialise(int width, int height)
+{
+   OpenGL& opengl = OpenGL::GetInstance();
+   if (!opengl.IsHeadless()) {
+      SoundEffect::SetEnabled(false);
+      opengl.InitHeadless(width, height);
+   }
+}
+
+LanderEnv::LanderEnv()
+   : m_sim(false),
+     m_maxSteps(OpenGL::VIRTUAL_FRAME_RATE * 120)
+{
+   OpenGL& opengl = OpenGL::GetInstance();
+   if (!opengl.IsHeadless())
+      Die("LanderEnv::Initialise must be called first");
+
+   m_sim.GetContext().SetTimeScale(opengl.GetTimeScale());
+   m_sim.SetScreenSize(opengl.GetWidth(), opengl.GetHeight());
+}
+
+//
+// Starts a new episode. The level is generated from the seed so the
+// same seed and level always give the same game.
+//
+void LanderEnv::Reset(uint32_t seed, int level, EnvObservation& obs)
+{
+   m_sim.NewGame(level, seed);
+
+   // Skip the fade in as the ship cannot be controlled until it ends
+   while (!m_sim.IsPlaying())
+      m_sim.Process(0);
+
+   m_steps = 0;
+   m_keysRemaining = m_sim.GetKeysRemaining();
+
+   Observe(obs);
+}
+
+//
+// Advances the game by one step and returns the reward. An episode ends
+// when the ship lands, crashes, or runs out of time.
+//
+float LanderEnv::Step(unsigned actions, EnvObservation& obs, bool& done)
+{
+   unsigned mask = 0;
+   if (actions & THRUST)
+      mask |= GameSim::ActionBit(Input::THRUST);
+   if (actions & LEFT)
+      mask |= GameSim::ActionBit(Input::LEFT);
+   if (actions & RIGHT)
+      mask |= GameSim::ActionBit(Input::RIGHT);
+
+   m_sim.Process(mask);
+   m_steps++;
+
+   float reward = 0.0f;
+
+   const int keysRemaining = m_sim.GetKeysRemaining();
+   reward += (m_keysRemaining - keysRemaining) * KEY_REWARD;
+   m_keysRemaining = keysRemaining;
+
+   const FuelMeter& fuelmeter = m_sim.GetFuelMeter();
+   if (m_sim.HasLanded()) {
+      // Saving fuel is worth up to another landing
+      reward += LAND_REWARD
+         + LAND_REWARD * fuelmeter.GetFuel() / fuelmeter.GetMaxFuel();
+      done = true;
+   }
+   else if (m_sim.HasCrashed()) {
+      reward += CRASH_REWARD;
+      done = true;
+   }
+   else
+      done = m_steps >= m_maxSteps;
+
+   Observe(obs);
+   return reward;
+}
+
+void LanderEnv::Observe(EnvObservation& obs)
+{
+   const Ship& ship = m_sim.GetShip();
+   const FuelMeter& fuelmeter = m_sim.GetFuelMeter();
+
+   obs.x = ship.GetX() + ship.GetWidth()/2;
+   obs.y = ship.GetY() + ship.GetHeight()/2;
+   obs.speedX = ship.GetXSpeed();
+   obs.speedY = ship.GetYSpeed();
+   obs.angle = fmod(ship.GetAngle(), 360.0);
+   if (obs.angle < 0.0f)
+      obs.angle += 360.0f;
+   obs.fuel = (float)fuelmeter.GetFuel() / fuelmeter.GetMaxFuel();
+   obs.keysRemaining = m_sim.GetKeysRemaining();
+
+   // Nearest landing pad
+   float best = INFINITY;
+   obs.padX = obs.padY = 0.0f;
+   for (const LandingPad& pad : m_sim.GetPads()) {
+      const Rect r = pad.GetBounds();
+      const float dx = r.x + r.w/2 - obs.x;
+      const float dy = r.y - obs.y;
+      if (dx*dx + dy*dy < best) {
+         best = dx*dx + dy*dy;
+         obs.padX = dx;
+         obs.padY = dy;
+      }
+   }
+
+   // Nearest hazards measured from the ship to the centre of each box
+   m_hazards.clear();
+   m_sim.ForEachHazard([&](const Rect& r) {
+      if (r.w > 0 && r.h > 0)
+         m_hazards.push_back({ r.x - obs.x, r.y - obs.y,
+                               (float)r.w, (float)r.h });
+   });
+
+   auto distance = [](const EnvObservation::Hazard& h) {
+      const float cx = h.x + h.w/2, cy = h.y + h.h/2;
+      return cx*cx + cy*cy;
+   };
+
+   const int count = min<int>(m_hazards.size(), EnvObservation::MAX_HAZARDS);
+   partial_sort(m_hazards.begin(), m_hazards.begin() + count, m_hazards.end(),
+                [&](const EnvObservation::Hazard& a,
+                    const EnvObservation::Hazard& b) {
+                   return distance(a) < distance(b);
+                });
+
+   copy(m_hazards.begin(), m_hazards.begin() + count, obs.hazards);
+   obs.hazardCount = count;
+}
+
+VecEnv::VecEnv(int count)
+{
+   // Loading images and sounds is not worth doing in parallel
+   for (int i = 0; i < count; i++)
+      m_envs.emplace_back(new LanderEnv);
+}
+
+//
+// Starts every environment on the same level with consecutive seeds.
+//
+void VecEnv::Reset(uint32_t seed, int level, EnvObservation* obs)
+{
+   const int count = m_envs.size();
+   for (int i = 0; i < count; i++)
+      m_envs[i]->Reset(seed + i, level, obs[i]);
+}
+
+void VecEnv::Step(const unsigned* actions, EnvObservation* obs,
+                  float* rewards, bool* dones)
+{
+   // Each step is short so several environments go in each task
+   const int GRAIN = 4;
+
+   ThreadPool::GetInstance().ParallelFor(
+      0, m_envs.size(), GRAIN,
+      [=](int n) {
+         LanderEnv& env = *m_envs[n];
+         rewards[n] = env.Step(actions[n], obs[n], dones[n]);
+         if (dones[n])
+            env.Reset(env.NextSeed(), env.GetLevel(), obs[n]);
+      });
+}
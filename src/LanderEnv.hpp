@@ -0,0 +1,88 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#pragma once
+
+#include "Platform.hpp"
+#include "Game.hpp"
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+//
+// What an agent sees after each step. Positions are in level pixels
+// and hazards are relative to the centre of the ship.
+//
+struct EnvObservation {
+   float x, y;               // Centre of the ship
+   float speedX, speedY;
+   float angle;              // Degrees clockwise from upright
+   float fuel;               // Fraction of a full tank
+   int keysRemaining;
+   float padX, padY;         // Offset to the centre of the nearest pad
+
+   static const int MAX_HAZARDS = 8;
+   struct Hazard {
+      float x, y, w, h;      // Offset to the top left and size
+   } hazards[MAX_HAZARDS];
+   int hazardCount;          // Nearest first
+};
+
+//
+// A single game driven one step at a time for training landing agents.
+// Nothing is drawn and no sound is played.
+//
+class LanderEnv {
+public:
+   LanderEnv();
+   LanderEnv(const LanderEnv&) = delete;
+
+   // Must be called once before creating any environments
+   static void Initialise(int width=1024, int height=768);
+
+   // Action bits passed to Step
+   static const unsigned THRUST = 1, LEFT = 2, RIGHT = 4;
+
+   void Reset(uint32_t seed, int level, EnvObservation& obs);
+   float Step(unsigned actions, EnvObservation& obs, bool& done);
+
+   void SetMaxSteps(int steps) { m_maxSteps = steps; }
+   int GetLevel() const { return m_sim.GetLevel(); }
+   uint32_t NextSeed() { return m_sim.GetContext().Rand(); }
+
+   static const float LAND_REWARD, CRASH_REWARD, KEY_REWARD;
+
+private:
+   void Observe(EnvObservation& obs);
+
+   GameSim m_sim;
+   int m_steps = 0;
+   int m_maxSteps;
+   int m_keysRemaining = 0;
+
+   // Reused to avoid allocating on every step
+   vector<EnvObservation::Hazard> m_hazards;
+};
+
+//
+// Many environments stepped together on the thread pool. An
+// environment that finishes is reset with a new seed straight away so
+// the observation returned for it is the first of the next episode.
+//
+class VecEnv {
+public:
+   explicit VecEnv(int count);
+   VecEnv(const VecEnv&) = delete;
+
+   void Reset(uint32_t seed, int level, EnvObservation* obs);
+   void Step(const unsigned* actions, EnvObservation* obs,
+             float* rewards, bool* dones);
+
+   int GetCount() const { return m_envs.size(); }
+
+private:
+   vector<unique_ptr<LanderEnv>> m_envs;
+};
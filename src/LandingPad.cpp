@@ -11,8 +11,8 @@
 
 #include <string>
 
-LandingPad::LandingPad(Viewport* v, int index, int length)
-   : index(index), length(length), viewport(v),
+LandingPad::LandingPad(Viewport* v, const PadDesc& desc)
+   : index(desc.index), length(desc.length), ypos(desc.ypos), viewport(v),
      m_landTexture(Texture::Load("images/landingpad.png")),
      m_noLandTexture(Texture::Load("images/landingpadred.png"))
 {
@@ -29,6 +29,17 @@ LandingPad::LandingPad(Viewport* v, int index, int length)
    m_vbo = VertexBuffer::Make(vertices, 4);
 }
 
+//
+// The landing surface in level pixels.
+//
+Rect LandingPad::GetBounds() const
+{
+   return { index * Surface::SURFACE_SIZE,
+            viewport->GetLevelHeight() - Surface::MAX_SURFACE_HEIGHT + ypos,
+            length * Surface::SURFACE_SIZE,
+            16 };
+}
+
 //
 // Draws the landing pad in the current frame.
 //	locked -> If true, pads a drawn with the red texture.
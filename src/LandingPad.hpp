@@ -8,18 +8,26 @@
 
 #include "GameObjFwd.hpp"
 #include "OpenGL.hpp"
+#include "Geometry.hpp"
 
 #include <vector>
 
+//
+// Where a landing pad goes on the surface.
+//
+struct PadDesc {
+   int index, length, ypos;
+};
+
 class LandingPad {
 public:
-   LandingPad(Viewport* v, int index, int length);
+   LandingPad(Viewport* v, const PadDesc& desc);
 
    void Draw(bool locked) const;
-   void SetYPos(int ypos) { this->ypos = ypos; }
 
    int GetLength() const { return length; }
    int GetIndex() const { return index; }
+   Rect GetBounds() const;
 
 private:
    int index, length, ypos;
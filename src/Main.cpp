@@ -10,9 +10,16 @@
 #include "Options.hpp"
 #include "ConfigFile.hpp"
 #include "SoundEffect.hpp"
+#include "AssetLoader.hpp"
+#include "ThreadPool.hpp"
+#include "Input.hpp"
+#include "SimRunner.hpp"
+#include "SimContext.hpp"
 
 #include <iostream>
 #include <filesystem>
+#include <ctime>
+#include <chrono>
 
 #include <SDL_main.h>
 
@@ -52,6 +59,41 @@ static void RecreateScreens()
    sm.AddScreen(options);
 }
 
+//
+// Plays many games at once with a trivial bot and reports how fast they
+// ran. This is to measure how well the simulation scales with cores.
+//
+static void RunSimulation(int count, unsigned seed)
+{
+   const int STEPS = OpenGL::VIRTUAL_FRAME_RATE * 60;
+
+   int level;
+   {
+      ConfigFile cfile;
+      level = cfile.get_int("level", 1);
+   }
+
+   SimRunner runner(count, seed, level);
+
+   // Hover by thrusting whenever falling too fast
+   auto hover = [](const GameSim& sim) {
+      unsigned actions = GameSim::ActionBit(Input::SKIP);
+      if (sim.GetShip().GetYSpeed() > 1.0)
+         actions |= GameSim::ActionBit(Input::THRUST);
+      return actions;
+   };
+
+   using namespace chrono;
+   const steady_clock::time_point start = steady_clock::now();
+   runner.Run(STEPS, hover);
+   const double secs =
+      duration<double>(steady_clock::now() - start).count();
+
+   cout << "Simulated " << count << " games for " << STEPS << " steps in "
+        << secs << "s (" << (int)(count * STEPS / secs) << " steps/s, "
+        << runner.GetGamesFinished() << " games finished)" << endl;
+}
+
 #ifdef UNIX
 static void MigrateConfigFiles()
 {
@@ -82,6 +124,11 @@ int main(int argc, char **argv)
 {
    int width, height, depth;
    bool fullscreen;
+   int simRate;
+   bool test = false, headless = false;
+   int simulateCount = 0;
+   int threads = -1;
+   const char *recordFile = NULL, *replayFile = NULL;
 
 #ifdef LOCALEDIR
    setlocale(LC_ALL, "");
@@ -102,6 +149,23 @@ int main(int argc, char **argv)
         << "See the GNU" << endl
         << "General Public Licence for details." << endl << endl;
 
+   for (int i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "test") == 0)
+         test = true;
+      else if (strcmp(argv[i], "--headless") == 0)
+         headless = true;
+      else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+         recordFile = argv[++i];
+      else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+         replayFile = argv[++i];
+      else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+         threads = max(atoi(argv[++i]), 0);
+      else if (strcmp(argv[i], "--simulate") == 0 && i + 1 < argc) {
+         simulateCount = max(atoi(argv[++i]), 1);
+         headless = true;
+      }
+   }
+
 #ifdef UNIX
    MigrateConfigFiles();
 #endif
@@ -112,8 +176,38 @@ int main(int argc, char **argv)
       height = cfile.get_int("vres", DEFAULT_VRES);
       fullscreen = cfile.get_bool("fullscreen", DEFAULT_FSCREEN);
       SoundEffect::SetEnabled(cfile.get_bool("sound", DEFAULT_SOUND));
+      simRate = cfile.get_int("simrate", OpenGL::VIRTUAL_FRAME_RATE);
+
+      // Zero means one worker per processor
+      if (threads < 0)
+         threads = cfile.get_int("threads", 0);
+   }
+
+   ThreadPool::Initialise(threads);
+
+   // A replay must start from the same seed and with the same screen
+   // size and simulation rate as the recording
+   unsigned seed = (unsigned)time(NULL);
+   if (replayFile != NULL) {
+      const ReplayHeader& header =
+         Input::GetInstance().StartReplay(replayFile);
+      seed = header.seed;
+      simRate = header.simRate;
+      width = header.width;
+      height = header.height;
+   }
+   else if (recordFile != NULL) {
+      ReplayHeader header = {};
+      header.seed = seed;
+      header.simRate = simRate;
+      header.width = width;
+      header.height = height;
+      Input::GetInstance().StartRecording(recordFile, header);
    }
 
+   srand(seed);
+   SimContext::Default().Seed(seed);
+
 #ifdef WIN32
    // Work out colour depth
    HDC hDesktopDC = GetDC(GetDesktopWindow());
@@ -126,11 +220,29 @@ int main(int argc, char **argv)
 
    // Create the game window
    OpenGL& opengl = OpenGL::GetInstance();
-   opengl.Init(width, height, depth, fullscreen);
+   if (headless) {
+      SoundEffect::SetEnabled(false);
+      opengl.InitHeadless(width, height);
+   }
+   else
+      opengl.Init(width, height, depth, fullscreen);
+   opengl.SetSimulationRate(simRate);
 
+   // Decode assets on worker threads while the screens are created
+   AssetLoader& loader = AssetLoader::GetInstance();
+   loader.Start();
    RecreateScreens();
+   loader.Finish();
 
-   if (argc == 2 && strcmp(argv[1], "test") == 0)
+   if (simulateCount > 0) {
+      RunSimulation(simulateCount, seed);
+
+      DestroyScreens();
+      Texture::UnloadAll();
+      return 0;
+   }
+
+   if (test)
       ScreenManager::GetInstance().SetTestDriver(makeSanityTestDriver());
 
    // Run the game
@@ -142,130 +254,3 @@ int main(int argc, char **argv)
 
    return 0;
 }
-
-//
-// Find a filename in the installation tree.
-//
-string LocateResource(const string& file)
-{
-#ifdef MACOSX
-   using namespace CF;
-
-   static char path[PATH_MAX];
-
-   CFURLRef resURL;
-   CFBundleRef mainBundle;
-   CFStringRef cfBase, cfExt, cfPath;
-
-   const char* ext = "";
-   char* copy = strdup(file.c_str());
-   if (char* p = strrchr(copy, '.')) {
-      *p = '\0';
-      ext = ++p;
-   }
-
-   cfBase = CFStringCreateWithCString(NULL, copy, kCFStringEncodingASCII);
-   cfExt = CFStringCreateWithCString(NULL, ext, kCFStringEncodingASCII);
-
-   free(copy);
-
-   mainBundle = CFBundleGetMainBundle();
-
-   resURL = CFBundleCopyResourceURL(mainBundle, cfBase, cfExt, NULL);
-
-   if (resURL == NULL)
-      Die("Failed to locate %s", file);
-
-   cfPath = CFURLCopyPath(resURL);
-
-   CFStringGetCString(cfPath, path, PATH_MAX, kCFStringEncodingASCII);
-
-   return path;
-#endif
-
-#ifdef DATADIR
-   using filesystem::path;
-
-   static path datadir;
-
-   if (datadir.empty()) {
-      const char *meson_src = getenv("MESON_SOURCE_ROOT");
-      if (meson_src != NULL) {
-         cout << "Using data from source directory: " << meson_src << endl;
-         datadir = path(meson_src) / "data";
-      }
-      else {
-         cout << "Using data from installation directory: " << DATADIR << endl;
-         datadir = DATADIR;
-      }
-   }
-
-   return (datadir / file).string();
-#else
-   return file;
-#endif
-}
-
-string GetConfigDir()
-{
-#if defined UNIX
-   using filesystem::path;
-
-   path p;
-   const char *config = getenv("XDG_CONFIG_HOME");
-   if (config == NULL || *config == '\0') {
-      const char *home = getenv("HOME");
-      if (home == NULL)
-         Die("HOME not set");
-
-      p = home;
-      p /= ".config";
-   }
-   else
-      p = config;
-
-   p /= "lander";
-   create_directories(p);
-
-   return p.string() + "/";
-#elif defined WIN32
-   using filesystem::path;
-
-   path appdata(getenv("APPDATA"));
-   appdata /= "doof.me.uk";
-   appdata /= "Lander";
-   create_directories(appdata);
-   return appdata.string() + "\\";
-#elif defined EMSCRIPTEN
-   return "";
-#else
-#error "Need to port GetConfigDir to this platform"
-#endif
-}
-
-void Die(const char *fmt, ...)
-{
-   va_list ap;
-   va_start(ap, fmt);
-
-#ifdef WIN32
-   int len = _vscprintf(fmt, ap);
-   char *buf = new char[len + 1];
-   vsprintf_s(buf, len + 1, fmt, ap);
-
-   fputs(buf, stderr);
-   fputs("\r\n", stderr);
-   fflush(stderr);
-
-   MessageBox(NULL, buf, "Runtime Error", MB_OK | MB_ICONSTOP);
-
-   delete[] buf;
-#else
-   vfprintf(stderr, fmt, ap);
-   fprintf(stderr, "\n");
-   fflush(stderr);
-#endif
-
-   va_end(ap);
-   exit(EXIT_FAILURE);
-}
@@ -31,7 +31,7 @@ MainMenu::MainMenu()
      optionsOpt("images/options_option.png", OPTIONS_OFFSET, 2),
      exitOpt("images/exit_option.png", OPTIONS_OFFSET, 3),
      titleImage("images/title.png"),
-     hintFont(LocateResource("fonts/VeraBd.ttf"), 11)
+     hintFont("fonts/VeraBd.ttf", 11)
 {
 
 }
@@ -183,6 +183,14 @@ void MainMenu::Process()
    }
 
    MoveStars();
+
+   // Pick a new hint text when the current one has been shown long enough
+   if (m_hintTimeout <= 0.0f) {
+      hintidx = rand() % NUM_HINTS;
+      m_hintTimeout = HINT_DISPLAY_TIME;
+   }
+   else
+      m_hintTimeout -= timeScale;
 }
 
 void MainMenu::MoveStars()
@@ -228,8 +236,7 @@ void MainMenu::Display()
    titleImage.Draw(title_x, title_y, 0.0, 1.0, fade);
 
    // Draw some hint texts
-   const int numhints = 7;
-   const char* hints[] = {
+   const char* hints[NUM_HINTS] = {
       i18n("Use the arrow keys to rotate the ship"),
       i18n("Press the up arrow to fire the thruster"),
       i18n("Smaller landing pads give you more points"),
@@ -239,13 +246,6 @@ void MainMenu::Display()
       i18n("Collect the spinning rings to unlock the landing pads")
    };
 
-   if (m_hintTimeout <= 0.0f) {
-      hintidx = rand() % numhints;
-      m_hintTimeout = HINT_DISPLAY_TIME;
-   }
-   else
-      m_hintTimeout -= opengl.GetTimeScale();
-
    int x = (opengl.GetWidth() - hintFont.GetStringWidth(hints[hintidx])) / 2;
    int y = opengl.GetHeight() - 120;
    hintFont.SetColour(0.0f, 1.0f, 0.0f, fade);
@@ -70,6 +70,7 @@ private:
 
    static const int OPTIONS_OFFSET;
    static constexpr float HINT_DISPLAY_TIME = 140.0f;
+   static const int NUM_HINTS = 7;
    static constexpr double MENU_FADE_SPEED = 0.1;
 
    static const unsigned MAX_STARS;
@@ -4,6 +4,7 @@
 //
 
 #include "Mine.hpp"
+#include "SimContext.hpp"
 #include "OpenGL.hpp"
 #include "Ship.hpp"
 
@@ -18,11 +19,7 @@ Mine::Mine(ObjectGrid* o, Viewport* v, int x, int y)
    dir = dirNone;
    movetimeout = 1;
 
-   // Free space on object grid
-   objgrid->UnlockSpace(xpos, ypos);
-   objgrid->UnlockSpace(xpos + 1, ypos);
-   objgrid->UnlockSpace(xpos + 1, ypos + 1);
-   objgrid->UnlockSpace(xpos, ypos + 1);
+   SavePosition();
 }
 
 void Mine::Move()
@@ -56,7 +53,7 @@ void Mine::Move()
       int nextx = 0, nexty = 0, timeout = 5;
       do {
          if (timeout < 5 || movetimeout == 0) {
-            dir = (Direction)(rand() % 4);
+            dir = (Direction)(SimContext::Current().Rand() % 4);
             movetimeout = 5;
          }
          else {
@@ -87,12 +84,7 @@ void Mine::Move()
          }
 
          // Check if this is ok
-         ok = !(nextx + 1 >= objgrid->GetWidth() || nextx < 0
-                || nexty + 1 >= objgrid->GetHeight() || nexty < 0
-                || objgrid->IsFilled(nextx, nexty)
-                || objgrid->IsFilled(nextx + 1, nexty)
-                || objgrid->IsFilled(nextx + 1, nexty + 1)
-                || objgrid->IsFilled(nextx, nexty + 1));
+         ok = objgrid->IsFree(nextx, nexty, 2, 2);
          timeout--;
       } while (!ok && timeout > 0);
 
@@ -100,7 +92,7 @@ void Mine::Move()
          dir = dirNone;
    }
 
-   const OpenGL::TimeScale timeScale = OpenGL::GetInstance().GetTimeScale();
+   const SimContext::TimeScale timeScale = SimContext::Current().GetTimeScale();
    const float delta = MINE_MOVE_SPEED * timeScale;
 
    switch(dir) {
@@ -124,18 +116,36 @@ void Mine::Move()
 
 bool Mine::CheckCollision(const Ship& ship) const
 {
-   return ship.BoxCollision
-      (xpos*OBJ_GRID_SIZE + 3 + static_cast<int>(m_displaceX),
-       ypos*OBJ_GRID_SIZE + OBJ_GRID_TOP + 6 + static_cast<int>(m_displaceY),
-       OBJ_GRID_SIZE*2 - 6,
-       OBJ_GRID_SIZE*2 - 12);
+   const Rect r = GetBounds();
+   return ship.BoxCollision(r.x, r.y, r.w, r.h);
+}
+
+//
+// The area in level pixels that collides with the ship.
+//
+Rect Mine::GetBounds() const
+{
+   return { xpos*OBJ_GRID_SIZE + 3 + static_cast<int>(m_displaceX),
+            ypos*OBJ_GRID_SIZE + OBJ_GRID_TOP + 6 + static_cast<int>(m_displaceY),
+            OBJ_GRID_SIZE*2 - 6,
+            OBJ_GRID_SIZE*2 - 12 };
+}
+
+void Mine::SavePosition()
+{
+   m_lastX = xpos*OBJ_GRID_SIZE + static_cast<int>(m_displaceX);
+   m_lastY = ypos*OBJ_GRID_SIZE + static_cast<int>(m_displaceY);
 }
 
 void Mine::Draw() const
 {
-   int draw_x = xpos*OBJ_GRID_SIZE + static_cast<int>(m_displaceX)
-      - viewport->GetXAdjust();
-   int draw_y = ypos*OBJ_GRID_SIZE + static_cast<int>(m_displaceY)
+   OpenGL& opengl = OpenGL::GetInstance();
+
+   int x = xpos*OBJ_GRID_SIZE + static_cast<int>(m_displaceX);
+   int y = ypos*OBJ_GRID_SIZE + static_cast<int>(m_displaceY);
+
+   int draw_x = opengl.Interpolate(m_lastX, x) - viewport->GetXAdjust();
+   int draw_y = opengl.Interpolate(m_lastY, y)
       - viewport->GetYAdjust() + OBJ_GRID_TOP;
    image.Draw(draw_x, draw_y);
 }
@@ -16,8 +16,10 @@ public:
    Mine(ObjectGrid* o, Viewport* v, int x, int y);
 
    void Move();
+   void SavePosition();
    void Draw() const;
    bool CheckCollision(const Ship& ship) const;
+   Rect GetBounds() const;
 
    static const int MINE_FRAME_COUNT = 18;
 
@@ -33,6 +35,7 @@ private:
    int movetimeout;
    float m_displaceX = 0.0f, m_displaceY = 0.0f;
    float m_rotateAnim = 0.0f;
+   int m_lastX = 0, m_lastY = 0;
 
    AnimatedImage image;
 };
@@ -9,37 +9,44 @@
 #include "ObjectGrid.hpp"
 #include "Ship.hpp"
 #include "OpenGL.hpp"
+#include "SimContext.hpp"
 
 #include <cmath>
 #include <string>
 
-SoundEffect* Missile::fireSound(NULL);
 
 const double Missile::ACCEL(0.1);
 const double Missile::MAX_SPEED(5.0);
 const int Missile::HORIZ_FIRE_RANGE(600);
 const int Missile::VERT_FIRE_RANGE(50);
 
-Missile::Missile(ObjectGrid* o, Viewport* v, Side s)
-   : viewport(v), speed(0.0), state(FIXED),
+Missile::Missile(const ObjectGrid* o, Viewport* v, Side s, int y)
+   : viewport(v), y(y), speed(0.0), state(FIXED),
      image("images/missile.png")
 {
    // This constructor builds a missile attached to the side of the screen
 
-   if (NULL == fireSound)
-      fireSound = new SoundEffect(LocateResource("sounds/missile.wav"),
-                                  60); // Volume
+   FireSound();   // Load it now rather than on first use
 
    x = (s == SIDE_LEFT) ? 0 : o->GetWidth() - 1;
 
-   // Pick spaces at random until we find one that's empty
-   do {
-      y = rand() % o->GetHeight();
-   } while (o->IsFilled(x, y));
-
    ObjectGrid::Offset(x, y, &dx, &dy);
 
    angle = (s == SIDE_LEFT) ? 90 : 270;
+
+   SavePosition();
+}
+
+//
+// Shared by all missiles. Games on different threads may create the
+// first missile at the same time so this relies on the thread safe
+// initialisation of local statics.
+//
+SoundEffect& Missile::FireSound()
+{
+   static SoundEffect* fireSound =
+      new SoundEffect("sounds/missile.wav", 60); // Volume
+   return *fireSound;
 }
 
 void Missile::Draw() const
@@ -47,7 +54,10 @@ void Missile::Draw() const
    if (viewport->PointInScreen(dx, dy, ObjectGrid::OBJ_GRID_SIZE,
                                ObjectGrid::OBJ_GRID_SIZE)
        && state != DESTROYED) {
-      image.Draw(dx - viewport->GetXAdjust(), dy - viewport->GetYAdjust(), angle);
+      OpenGL& opengl = OpenGL::GetInstance();
+      image.Draw(opengl.Interpolate(lastX, dx) - viewport->GetXAdjust(),
+                 opengl.Interpolate(lastY, dy) - viewport->GetYAdjust(),
+                 angle);
    }
 
    exhaust.Draw((double)viewport->GetXAdjust(),
@@ -64,6 +74,24 @@ bool Missile::CheckCollison(const Ship& ship)
    return collided;
 }
 
+//
+// The area in level pixels that collides with the ship. This is empty
+// once the missile has been destroyed.
+//
+Rect Missile::GetBounds() const
+{
+   if (state == DESTROYED)
+      return { dx, dy, 0, 0 };
+   else
+      return { dx, dy, image.GetWidth(), image.GetHeight() };
+}
+
+void Missile::SavePosition()
+{
+   lastX = dx;
+   lastY = dy;
+}
+
 void Missile::Move(const Ship& ship)
 {
    switch (state) {
@@ -84,7 +112,7 @@ void Missile::MoveFixed(const Ship& ship)
 
    if (xDistance <= HORIZ_FIRE_RANGE && yDistance <= VERT_FIRE_RANGE) {
       state = FLYING;
-      fireSound->Play();
+      FireSound().Play();
    }
 
    exhaust.Process(false);
@@ -92,7 +120,7 @@ void Missile::MoveFixed(const Ship& ship)
 
 void Missile::MoveFlying()
 {
-   const OpenGL::TimeScale timeScale = OpenGL::GetInstance().GetTimeScale();
+   const SimContext::TimeScale timeScale = SimContext::Current().GetTimeScale();
 
    dx += speed * timeScale * sin(angle * M_PI/180);
    dy += speed * timeScale * cos(angle * M_PI/180);
@@ -104,7 +132,7 @@ void Missile::MoveFlying()
    exhaust.Process(true);
 
    if (speed < MAX_SPEED)
-      speed += ACCEL;
+      speed += ACCEL * timeScale;
 
    if (dx > viewport->GetLevelWidth() || dy > viewport->GetLevelHeight()
        || dx + image.GetWidth() < 0 || dy < 0)
@@ -9,16 +9,19 @@
 #include "Emitter.hpp"
 #include "SoundEffect.hpp"
 #include "Image.hpp"
+#include "Geometry.hpp"
 
 class Missile {
 public:
    enum Side { SIDE_LEFT, SIDE_RIGHT };
 
-   Missile(ObjectGrid* o, Viewport* v, Side s);
+   Missile(const ObjectGrid* o, Viewport* v, Side s, int y);
 
    void Draw() const;
    void Move(const Ship& ship);
+   void SavePosition();
    bool CheckCollison(const Ship& ship);
+   Rect GetBounds() const;
 private:
    void MoveFixed(const Ship& ship);
    void MoveFlying();
@@ -26,12 +29,13 @@ private:
 
    Viewport* viewport;
    int x, y, dx, dy;
+   int lastX, lastY;
    double angle, speed;
 
    enum State { FIXED, FLYING, DESTROYED };
    State state;
    OrangeSmokeTrail exhaust;
-   static SoundEffect* fireSound;
+   static SoundEffect& FireSound();
    Image image;
    static const double ACCEL;
    static const double MAX_SPEED;
@@ -4,81 +4,90 @@
 //
 
 #include "ObjectGrid.hpp"
+#include "SimContext.hpp"
 
 #include <cassert>
 
 
 ObjectGrid::ObjectGrid()
-  : grid(NULL), width(0), height(0)
+  : stride(0), width(0), height(0)
 {
 
 }
 
-ObjectGrid::~ObjectGrid()
-{
-   if (grid)
-      delete[] grid;
-}
-
 //
 // Allocates a free space in the object grid.
 //	x, y -> Output x, y, co-ordinates.
-// Returns falce if area could not be allocated.
+// Returns false if the grid is full.
 //
 bool ObjectGrid::AllocFreeSpace(int& x, int& y)
 {
-   int timeout = 10000;
-
-   // Keep generating points until we find a free space
-   do {
-      if (--timeout == 0)
-         return false;
-
-      x = rand() % width;
-      y = rand() % height;
-   } while (grid[x + (y * width)]);
-
-   grid[x + (y * width)] = true;
+   if (!PickFreeSpace(x, y, 1, 1, width, height))
+      return false;
 
+   SetSpace(x, y, 1, 1, true);
    return true;
 }
 
 //
-// Allocates a free space in the object grid.
+// Allocates a free space in the object grid. As before the space never
+// includes the last row or column.
 //	x, y -> Output x, y co-ordinates.
 //	width, height -> Size of desired space.
-// Returns false if area could not be allocated.
+// Returns false only if there is no space that size left.
 //
 bool ObjectGrid::AllocFreeSpace(int& x, int& y, int width, int height)
 {
-   bool isOk;
-   int counter_x, counter_y;
-   int timeout = 10000;
-
-   // Keep generating points until we find a free space
-   do {
-      if (--timeout == 0)
-         return false;
-
-      x = rand() % (this->width - width);
-      y = rand() % (this->height - height);
-
-      // Check this position
-      isOk = true;
-      for (counter_x = x; counter_x < x + width; counter_x++) {
-         for (counter_y = y; counter_y < y + height; counter_y++) {
-            if (grid[counter_x + (counter_y * this->width)])
-               isOk = false;
-         }
+   if (!PickFreeSpace(x, y, width, height,
+                      this->width - width, this->height - height))
+      return false;
+
+   SetSpace(x, y, width, height, true);
+   return true;
+}
+
+//
+// Chooses a free space uniformly from the positions with x < rangeX and
+// y < rangeY. Checking a position takes constant time and the grid is
+// mostly empty so a few random probes usually find one. Failing that
+// every free position is counted and one picked at random.
+//
+bool ObjectGrid::PickFreeSpace(int& x, int& y, int width, int height,
+                               int rangeX, int rangeY) const
+{
+   if (rangeX <= 0 || rangeY <= 0)
+      return false;
+
+   SimContext& context = SimContext::Current();
+
+   for (int i = 0; i < MAX_PROBES; i++) {
+      x = context.Rand() % rangeX;
+      y = context.Rand() % rangeY;
+      if (IsFree(x, y, width, height))
+         return true;
+   }
+
+   int count = 0;
+   for (int j = 0; j < rangeY; j++) {
+      for (int i = 0; i < rangeX; i++) {
+         if (IsFree(i, j, width, height))
+            count++;
       }
-   } while (!isOk);
+   }
 
-   for (counter_x = x; counter_x < x + width; counter_x++) {
-      for (counter_y = y; counter_y < y + height; counter_y++)
-         grid[counter_x + (counter_y * this->width)] = true;
+   if (count == 0)
+      return false;
+
+   int n = context.Rand() % count;
+   for (y = 0; y < rangeY; y++) {
+      for (x = 0; x < rangeX; x++) {
+         if (IsFree(x, y, width, height) && n-- == 0)
+            return true;
+      }
    }
 
-   return true;
+   assert(false);
+   return false;
 }
 
 //
@@ -86,9 +95,51 @@ bool ObjectGrid::AllocFreeSpace(int& x, int& y, int width, int height)
 //
 void ObjectGrid::UnlockSpace(int x, int y)
 {
-   assert(x < width);
-   assert(y < height);
-   grid[x + (y * width)] = false;
+   SetSpace(x, y, 1, 1, false);
+}
+
+//
+// Marks a rectangle of squares as no longer in use.
+//
+void ObjectGrid::UnlockSpace(int x, int y, int width, int height)
+{
+   SetSpace(x, y, width, height, false);
+}
+
+void ObjectGrid::SetSpace(int x, int y, int width, int height, bool filled)
+{
+   assert(x >= 0 && x + width <= this->width);
+   assert(y >= 0 && y + height <= this->height);
+
+   for (int j = y; j < y + height; j++) {
+      for (int i = x; i < x + width; i++) {
+         uint64_t& word = rows[j * stride + i / 64];
+         const uint64_t bit = uint64_t(1) << (i % 64);
+         if (filled)
+            word |= bit;
+         else
+            word &= ~bit;
+      }
+   }
+
+   RebuildSums(y);
+}
+
+//
+// Updates the summed area table from the given row down. This is cheap
+// compared to the number of queries as the grid is small.
+//
+void ObjectGrid::RebuildSums(int fromRow)
+{
+   const int sumStride = width + 1;
+   for (int y = fromRow; y < height; y++) {
+      int rowSum = 0;
+      for (int x = 0; x < width; x++) {
+         rowSum += IsFilled(x, y);
+         sums[(x + 1) + (y + 1) * sumStride] =
+            sums[(x + 1) + y * sumStride] + rowSum;
+      }
+   }
 }
 
 //
@@ -99,15 +150,12 @@ void ObjectGrid::Reset(int width, int height)
    assert(width > 0);
    assert(height > 0);
 
-   if (grid)
-      delete[] grid;
-
    this->width = width;
    this->height = height;
 
-   grid = new bool[width * height];
-
-   memset(grid, 0, width * height * sizeof(bool));
+   stride = (width + 63) / 64;
+   rows.assign(stride * height, 0);
+   sums.assign((width + 1) * (height + 1), 0);
 }
 
 //
@@ -117,7 +165,20 @@ bool ObjectGrid::IsFilled(int x, int y) const
 {
    assert(x < width);
    assert(y < height);
-   return grid[x + (width * y)];
+   return (rows[y * stride + x / 64] >> (x % 64)) & 1;
+}
+
+//
+// Returns true if the rectangle is inside the grid and has nothing in
+// it. This takes constant time.
+//
+bool ObjectGrid::IsFree(int x, int y, int width, int height) const
+{
+   if (x < 0 || y < 0 || x + width > this->width || y + height > this->height)
+      return false;
+
+   return Sum(x + width, y + height) - Sum(x + width, y)
+      - Sum(x, y + height) + Sum(x, y) == 0;
 }
 
 void ObjectGrid::Offset(int ox, int oy, int* x, int* y)
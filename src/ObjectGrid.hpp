@@ -10,17 +10,21 @@
 #include "Geometry.hpp"
 #include "Viewport.hpp"
 
+#include <vector>
+#include <cstdint>
+
 class ObjectGrid {
 public:
    ObjectGrid();
-   ~ObjectGrid();
 
    void Reset(int width, int height);
    bool AllocFreeSpace(int& x, int& y);
    bool AllocFreeSpace(int& x, int& y, int width, int height);
    void UnlockSpace(int x, int y);
+   void UnlockSpace(int x, int y, int width, int height);
 
    bool IsFilled(int x, int y) const;
+   bool IsFree(int x, int y, int width, int height) const;
    int GetWidth() const { return width; }
    int GetHeight() const { return height; }
 
@@ -30,7 +34,22 @@ public:
    static const int OBJ_GRID_TOP  = 100;
 
 private:
-   bool* grid;
+   bool PickFreeSpace(int& x, int& y, int width, int height,
+                      int rangeX, int rangeY) const;
+   void SetSpace(int x, int y, int width, int height, bool filled);
+   void RebuildSums(int fromRow);
+   int Sum(int x, int y) const { return sums[x + y * (width + 1)]; }
+
+   // Random probes before searching every position
+   static const int MAX_PROBES = 8;
+
+   // One bit per square
+   vector<uint64_t> rows;
+   int stride;
+
+   // Number of filled squares above and to the left of each corner
+   vector<int> sums;
+
    int width, height;
 };
 
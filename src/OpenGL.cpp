@@ -4,13 +4,17 @@
 //
 
 #include "OpenGL.hpp"
+#include "SimContext.hpp"
 #include "Input.hpp"
 #include "ScreenManager.hpp"
 
-#include <ctime>
 #include <iostream>
 #include <cassert>
 #include <set>
+#include <cmath>
+#include <cstddef>
+#include <climits>
+#include <algorithm>
 
 #define WINDOW_TITLE "Lunar Lander"
 
@@ -46,6 +50,62 @@ static const char *g_fragmentShader =
    "   FragColor = texture2D(Sampler, TexCoord0.st) * vec4(Colour);\n"
    "}\n";
 
+static const char *g_spriteVertexShader =
+   "#version 130\n"
+   "in vec2 Position;\n"
+   "in vec2 TexCoord;\n"
+   "in vec4 Colour;\n"
+   "uniform vec2 WindowSize;\n"
+   "out vec2 TexCoord0;\n"
+   "out vec4 Colour0;\n"
+   "void main()\n"
+   "{\n"
+   "   vec2 winscale = vec2(WindowSize.x / 2, WindowSize.y / 2);\n"
+   "   vec2 tmp = (Position - winscale) / winscale;\n"
+   "   gl_Position = vec4(tmp.x, -tmp.y, 0.0, 1.0);\n"
+   "   TexCoord0 = TexCoord;\n"
+   "   Colour0 = Colour;\n"
+   "}\n";
+
+static const char *g_spriteFragmentShader =
+   "#version 130\n"
+   "in vec2 TexCoord0;\n"
+   "in vec4 Colour0;\n"
+   "out vec4 FragColor;\n"
+   "uniform sampler2D Sampler;\n"
+   "void main()\n"
+   "{\n"
+   "   FragColor = texture2D(Sampler, TexCoord0.st) * Colour0;\n"
+   "}\n";
+
+static const char *g_particleVertexShader =
+   "#version 130\n"
+   "in vec2 Position;\n"
+   "in vec2 TexCoord;\n"
+   "in vec2 Offset;\n"
+   "in vec4 Colour;\n"
+   "uniform vec2 WindowSize;\n"
+   "uniform float Size;\n"
+   "uniform vec4 TexRect;\n"
+   "out vec2 TexCoord0;\n"
+   "out vec4 Colour0;\n"
+   "void main()\n"
+   "{\n"
+   "   vec2 winscale = vec2(WindowSize.x / 2, WindowSize.y / 2);\n"
+   "   vec2 tmp = (Position * Size + Offset - winscale) / winscale;\n"
+   "   gl_Position = vec4(tmp.x, -tmp.y, 0.0, 1.0);\n"
+   "   TexCoord0 = TexRect.xy + TexCoord * TexRect.zw;\n"
+   "   Colour0 = Colour;\n"
+   "}\n";
+
+static const char *const g_attribs[] = { "Position", "TexCoord", NULL };
+static const char *const g_spriteAttribs[] = {
+   "Position", "TexCoord", "Colour", NULL
+};
+static const char *const g_particleAttribs[] = {
+   "Position", "TexCoord", "Offset", "Colour", NULL
+};
+
 const Colour Colour::WHITE = Colour::Make(1.0f, 1.0f, 1.0f);
 const Colour Colour::BLACK = Colour::Make(0.0f, 0.0f, 0.0f);
 
@@ -56,11 +116,11 @@ OpenGL::OpenGL()
      m_window(NULL),
      m_glcontext(NULL),
      fps_lastcheck(0), fps_framesdrawn(0), fps_rate(0),
-     m_timeScale(0.0),
+     m_timeScale(1.0),
      deferredScreenShot(false)
 {
-   // Start random number generator
-   srand((unsigned)time(NULL));
+   InvalidateState();
+   Reset();
 }
 
 //
@@ -89,6 +149,21 @@ void OpenGL::Init(int width, int height, int depth, bool fullscreen)
    SDL_ShowCursor(SDL_DISABLE);
 }
 
+//
+// Used instead of Init to run the game without a window or GL context.
+// Nothing is drawn and the simulation runs as fast as possible. Screen
+// size is still needed for the viewport.
+//
+void OpenGL::InitHeadless(int width, int height)
+{
+   if (SDL_Init(SDL_INIT_EVENTS) < 0)
+      Die("Unable to initialise SDL: %s", SDL_GetError());
+   atexit(SDL_Quit);
+
+   m_headless = true;
+   SetVideoMode(false, width, height);
+}
+
 bool OpenGL::SetVideoMode(bool fullscreen, int width, int height)
 {
    bool resized = !(width == screen_width && height == screen_height);
@@ -97,6 +172,9 @@ bool OpenGL::SetVideoMode(bool fullscreen, int width, int height)
    screen_width = width;
    this->fullscreen = fullscreen;
 
+   if (m_headless)
+      return resized;
+
    sdl_flags = SDL_WINDOW_OPENGL;
    if (fullscreen)
       sdl_flags |= SDL_WINDOW_FULLSCREEN_DESKTOP;
@@ -125,8 +203,8 @@ bool OpenGL::SetVideoMode(bool fullscreen, int width, int height)
       SDL_SetWindowFullscreen(m_window, sdl_flags);
    }
 
-   ResizeGLScene(screen_width, screen_height);
-
+   // The render thread resizes its viewport when it draws the first
+   // frame recorded at the new size
    return resized;
 }
 
@@ -154,77 +232,387 @@ void OpenGL::AddShader(GLuint program, const char* text, GLenum type)
    glAttachShader(program, obj);
 }
 
-void OpenGL::CompileShaders()
+GLuint OpenGL::LinkProgram(const char *vertex, const char *fragment,
+                           const char *const *attribs)
 {
-   m_program = glCreateProgram();
-   if (m_program == 0)
+   GLuint program = glCreateProgram();
+   if (program == 0)
       Die("Error creating shader program");
 
-   AddShader(m_program, g_vertexShader, GL_VERTEX_SHADER);
-   AddShader(m_program, g_fragmentShader, GL_FRAGMENT_SHADER);
+   AddShader(program, vertex, GL_VERTEX_SHADER);
+   AddShader(program, fragment, GL_FRAGMENT_SHADER);
+
+   // Attribute indices match the order in the NULL-terminated list
+   for (int i = 0; attribs[i] != NULL; i++)
+      glBindAttribLocation(program, i, attribs[i]);
 
    GLint success = 0;
    GLchar errorLog[1024] = { 0 };
 
-   glLinkProgram(m_program);
-   glGetProgramiv(m_program, GL_LINK_STATUS, &success);
+   glLinkProgram(program);
+   glGetProgramiv(program, GL_LINK_STATUS, &success);
    if (success == 0) {
-      glGetProgramInfoLog(m_program, sizeof(errorLog), NULL, errorLog);
+      glGetProgramInfoLog(program, sizeof(errorLog), NULL, errorLog);
       Die("Error linking shader program: %s", errorLog);
    }
 
-   glValidateProgram(m_program);
-   glGetProgramiv(m_program, GL_VALIDATE_STATUS, &success);
+   glValidateProgram(program);
+   glGetProgramiv(program, GL_VALIDATE_STATUS, &success);
    if (!success) {
-      glGetProgramInfoLog(m_program, sizeof(errorLog), NULL, errorLog);
+      glGetProgramInfoLog(program, sizeof(errorLog), NULL, errorLog);
       Die("Invalid shader program: %s", errorLog);
    }
 
+   return program;
+}
+
+void OpenGL::CompileShaders()
+{
+   m_program = LinkProgram(g_vertexShader, g_fragmentShader, g_attribs);
+   m_spriteProgram = LinkProgram(g_spriteVertexShader,
+                                 g_spriteFragmentShader,
+                                 g_spriteAttribs);
+   m_particleProgram = LinkProgram(g_particleVertexShader,
+                                   g_spriteFragmentShader,
+                                   g_particleAttribs);
+   m_particleSizeLocation = GetUniformLocation(m_particleProgram, "Size");
+   m_particleTexRectLocation =
+      GetUniformLocation(m_particleProgram, "TexRect");
+
    glUseProgram(m_program);
 
-   m_translateLocation = GetUniformLocation("Translate");
-   m_scaleLocation = GetUniformLocation("Scale");
-   m_colourLocation = GetUniformLocation("Colour");
-   m_angleLocation = GetUniformLocation("Angle");
+   m_translateLocation = GetUniformLocation(m_program, "Translate");
+   m_scaleLocation = GetUniformLocation(m_program, "Scale");
+   m_colourLocation = GetUniformLocation(m_program, "Colour");
+   m_angleLocation = GetUniformLocation(m_program, "Angle");
+}
+
+//
+// Creates the buffers, vertex arrays, and other state belonging to the
+// context frames are drawn with. Called on the render thread.
+//
+void OpenGL::InitRenderer()
+{
+   m_renderThreadId = this_thread::get_id();
+
+   // Set options
+   glShadeModel(GL_SMOOTH);			        // Enable smooth shading
+   glClearColor(0.0f, 0.0f, 0.0f, 0.0f);		// Black background
+   glClearDepth(1.0f);					// Depth buffer setup
+   glHint(GL_PERSPECTIVE_CORRECTION_HINT, GL_FASTEST);
+   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);	// Basic blending function
+   glEnable(GL_ALPHA_TEST);				// Enable alpha testing
+   glAlphaFunc(GL_GREATER, 0.0);			// Alpha testing function
+   glDisable(GL_NORMALIZE);
+   glDisable(GL_DEPTH_TEST);
+   glEnable(GL_BLEND);
+
+   typedef SpriteBatch::SpriteVertex SpriteVertex;
+
+   glGenVertexArrays(1, &m_spriteVao);
+   glBindVertexArray(m_spriteVao);
+
+   // Sprites are streamed through the persistently mapped buffer when
+   // it is available
+   if (m_hasBufferStorage)
+      m_stream.Init(STREAM_FRAME_SIZE);
+
+   glGenBuffers(1, &m_spriteVbo);
+   glBindBuffer(GL_ARRAY_BUFFER,
+                m_stream.IsValid() ? m_stream.GetBuffer() : m_spriteVbo);
+   glEnableVertexAttribArray(0);
+   glEnableVertexAttribArray(1);
+   glEnableVertexAttribArray(2);
+   glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(SpriteVertex),
+                         (GLvoid*)offsetof(SpriteVertex, x));
+   glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(SpriteVertex),
+                         (GLvoid*)offsetof(SpriteVertex, tx));
+   glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+                         sizeof(SpriteVertex),
+                         (GLvoid*)offsetof(SpriteVertex, r));
+
+   // Dynamic vertex buffers are copied here for each draw when there is
+   // no stream buffer
+   glGenBuffers(1, &m_vertexVbo);
+
+   // Unit quad scaled and offset for each particle instance
+   const VertexF quad[4] = {
+      { 0.0f, 1.0f, 0.0f, 0.0f },
+      { 0.0f, 0.0f, 0.0f, 1.0f },
+      { 1.0f, 0.0f, 1.0f, 1.0f },
+      { 1.0f, 1.0f, 1.0f, 0.0f }
+   };
+
+   glGenVertexArrays(1, &m_particleVao);
+   glBindVertexArray(m_particleVao);
+
+   glGenBuffers(1, &m_particleQuadVbo);
+   glBindBuffer(GL_ARRAY_BUFFER, m_particleQuadVbo);
+   glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+   glEnableVertexAttribArray(0);
+   glEnableVertexAttribArray(1);
+   glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(VertexF),
+                         (GLvoid*)offsetof(VertexF, x));
+   glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(VertexF),
+                         (GLvoid*)offsetof(VertexF, tx));
+
+   glGenBuffers(1, &m_particleVbo);
+   glBindBuffer(GL_ARRAY_BUFFER, m_particleVbo);
+   glEnableVertexAttribArray(2);
+   glEnableVertexAttribArray(3);
+   glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(ParticleInstance),
+                         (GLvoid*)offsetof(ParticleInstance, x));
+   glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+                         sizeof(ParticleInstance),
+                         (GLvoid*)offsetof(ParticleInstance, r));
+   if (m_hasInstancing) {
+      glVertexAttribDivisor(2, 1);
+      glVertexAttribDivisor(3, 1);
+   }
+
+   glBindVertexArray(0);
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+   InvalidateState();
+
+   // The viewport is set from the size of the first frame drawn
+   m_viewWidth = m_viewHeight = 0;
+
+   CheckError("InitRenderer");
+}
+
+//
+// Deletes everything created by InitRenderer along with any objects
+// still waiting to be released.
+//
+void OpenGL::FreeRenderer()
+{
+   ReleaseObjects(UINT_MAX);
+
+   for (const auto& it : m_vertexArrays)
+      glDeleteVertexArrays(1, &it.second);
+   m_vertexArrays.clear();
+
+   const GLuint buffers[] = {
+      m_spriteVbo, m_particleVbo, m_particleQuadVbo, m_vertexVbo
+   };
+   for (GLuint buffer : buffers) {
+      if (buffer != 0)
+         glDeleteBuffers(1, &buffer);
+   }
+   m_spriteVbo = m_particleVbo = m_particleQuadVbo = m_vertexVbo = 0;
+
+   const GLuint vaos[] = { m_spriteVao, m_particleVao };
+   for (GLuint vao : vaos) {
+      if (vao != 0)
+         glDeleteVertexArrays(1, &vao);
+   }
+   m_spriteVao = m_particleVao = 0;
+
+   for (GLsync& fence : m_frameFences) {
+      if (fence != 0) {
+         glDeleteSync(fence);
+         fence = 0;
+      }
+   }
+
+   m_stream.Destroy();
 }
 
-GLuint OpenGL::GetUniformLocation(const char *name)
+GLuint OpenGL::GetUniformLocation(GLuint program, const char *name)
 {
-   GLuint location = glGetUniformLocation(m_program, name);
+   GLuint location = glGetUniformLocation(program, name);
    if (location == 0xffffffff)
       Die("Failed to get uniform location: %s", name);
 
    return location;
 }
 
+//
+// Runs the game until Stop is called. The simulation is stepped on the
+// calling thread, which also handles input and records a snapshot of
+// each frame. Frames are drawn on a separate render thread where the
+// driver allows it, so that neither waiting for vertical sync nor a
+// slow frame holds up the simulation, and a slow step only means the
+// render thread draws fewer new frames.
+//
 void OpenGL::Run()
 {
    running = true;
    active = true;
 
-   unsigned lastTick = 0;
+   // The game is simulated in steps of a fixed length and drawn as often
+   // as possible in between
+   const Uint64 freq = SDL_GetPerformanceFrequency();
+   const Uint64 step = freq / m_simRate;
+
+   if (m_headless) {
+      // There is nothing to draw so run one step after another
+      while (running) {
+         Input::GetInstance().Update();
+         ScreenManager::GetInstance().Process();
+      }
+      return;
+   }
+
+   m_drawing = true;
+
+   const bool threaded = StartRenderThread();
+   if (!threaded)
+      InitRenderer();
+
+   Uint64 lastTick = SDL_GetPerformanceCounter();
+   Uint64 accumulator = step;
 
    // Loop until program ends
    do {
-      const unsigned tickStart = SDL_GetTicks();
-      if (lastTick == 0)
-         m_timeScale = 1.0;
-      else {
-         const float delta = tickStart - lastTick;
-         m_timeScale = delta / (1000.0f / VIRTUAL_FRAME_RATE);
+      const Uint64 tickStart = SDL_GetPerformanceCounter();
+      accumulator += tickStart - lastTick;
+      lastTick = tickStart;
+
+      // Drop time rather than trying to catch up after a long stall
+      if (accumulator > MAX_STEPS_PER_FRAME * step)
+         accumulator = MAX_STEPS_PER_FRAME * step;
+
+      while (accumulator >= step && running) {
+         Input::GetInstance().Update();
+
+         // Process user input
+         ScreenManager::GetInstance().Process();
+
+         accumulator -= step;
       }
 
-      Input::GetInstance().Update();
+      if (!running || !active)
+         continue;
+
+      if (threaded && !m_snapshots.IsConsumed()) {
+         // Nothing to do until either the next step is due or the render
+         // thread takes the last frame
+         const Uint64 wait = step - min(accumulator, step);
+         m_snapshots.WaitUntilConsumed(
+            chrono::steady_clock::now()
+            + chrono::microseconds(wait * 1000000 / freq));
+         continue;
+      }
 
-      // Process user input
-      ScreenManager::GetInstance().Process();
+      m_interpolation = (float)accumulator / step;
 
-      // Draw the next frame
-      if (active)
-         DrawGLScene();
+      // Record the next frame
+      if (!RecordFrame())
+         continue;
 
-      lastTick = tickStart;
+      m_snapshots.Publish();
+
+      if (!threaded)
+         DrawGLScene(*m_snapshots.Acquire());
    } while (running);
+
+   if (threaded)
+      StopRenderThread();
+   else
+      FreeRenderer();
+
+   m_drawing = false;
+}
+
+//
+// Creates a second context sharing objects with the main one and starts
+// drawing frames with it on a new thread. Returns false if this is not
+// possible, in which case frames are drawn on the main thread.
+//
+bool OpenGL::StartRenderThread()
+{
+   // Fences are needed to know when objects created in one context may
+   // be used in the other
+   if (!GLEW_VERSION_3_2 && !GLEW_ARB_sync) {
+      cout << "Sync objects not supported: drawing on main thread" << endl;
+      return false;
+   }
+
+   SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+   m_renderContext = SDL_GL_CreateContext(m_window);
+   SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+
+   if (m_renderContext == NULL) {
+      cout << "Failed to create render context: " << SDL_GetError()
+           << ": drawing on main thread" << endl;
+      return false;
+   }
+
+   // Creating the context also made it current on this thread
+   if (SDL_GL_MakeCurrent(m_window, m_glcontext) != 0)
+      Die("Failed to restore GL context: %s", SDL_GetError());
+
+   m_renderThread = thread(&OpenGL::RenderThread, this);
+   return true;
+}
+
+void OpenGL::StopRenderThread()
+{
+   m_snapshots.Close();
+   m_renderThread.join();
+
+   // Deletes the fences of any frames that were never drawn
+   m_snapshots.Reset();
+
+   SDL_GL_DeleteContext(m_renderContext);
+   m_renderContext = NULL;
+}
+
+void OpenGL::RenderThread()
+{
+   if (SDL_GL_MakeCurrent(m_window, m_renderContext) != 0)
+      Die("Failed to make render context current: %s", SDL_GetError());
+
+   SDL_GL_SetSwapInterval(1);
+
+   InitRenderer();
+
+   while (RenderSnapshot *snapshot = m_snapshots.Acquire())
+      DrawGLScene(*snapshot);
+
+   FreeRenderer();
+
+   SDL_GL_MakeCurrent(m_window, NULL);
+}
+
+//
+// Records everything the active screen draws into the back snapshot.
+// Returns false if no frame should be drawn this time.
+//
+bool OpenGL::RecordFrame()
+{
+   if (!dodisplay) {
+      dodisplay = true;
+      return false;
+   }
+
+   RenderSnapshot& snapshot = m_snapshots.GetBack();
+   snapshot.Clear();
+   snapshot.m_serial = ++m_serial;
+   snapshot.m_width = screen_width;
+   snapshot.m_height = screen_height;
+   snapshot.m_screenShot = deferredScreenShot;
+
+   deferredScreenShot = false;
+
+   m_recording = &snapshot;
+
+   Reset();
+   ScreenManager::GetInstance().Display();
+   FlushSprites();
+
+   m_recording = nullptr;
+
+   if (m_renderThread.joinable()) {
+      // Textures and buffers created while recording must be complete
+      // before the render thread uses them
+      snapshot.m_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      glFlush();
+   }
+
+   return true;
 }
 
 OpenGL::TimeScale OpenGL::GetTimeScale() const
@@ -232,18 +620,41 @@ OpenGL::TimeScale OpenGL::GetTimeScale() const
    return m_timeScale;
 }
 
+//
+// Sets the number of simulation steps per second. Must be called before
+// Run. Rates other than VIRTUAL_FRAME_RATE scale each step so the game
+// runs at the same speed.
+//
+void OpenGL::SetSimulationRate(int hz)
+{
+   m_simRate = max(hz, 1);
+   m_timeScale = (float)VIRTUAL_FRAME_RATE / m_simRate;
+
+   SimContext::Default().SetTimeScale(m_timeScale);
+}
+
+int OpenGL::Interpolate(int from, int to) const
+{
+   return from + (int)lround((to - from) * m_interpolation);
+}
+
+double OpenGL::Interpolate(double from, double to) const
+{
+   return from + (to - from) * m_interpolation;
+}
+
 // Take a screenshot at the end of this frame
 void OpenGL::DeferScreenShot()
 {
    deferredScreenShot = true;
 }
 
-void OpenGL::TakeScreenShot() const
+void OpenGL::TakeScreenShot(int width, int height) const
 {
    const string fileName("Lander.bmp");
 
    SDL_Surface* temp = SDL_CreateRGBSurface
-      (SDL_SWSURFACE, screen_width, screen_height, 24,
+      (SDL_SWSURFACE, width, height, 24,
 #if SDL_BYTEORDER == SDL_LIL_ENDIAN
        0x000000FF, 0x0000FF00, 0x00FF0000, 0
 #else
@@ -252,8 +663,8 @@ void OpenGL::TakeScreenShot() const
        );
    assert(temp);
 
-   const int w = screen_width;
-   const int h = screen_height;
+   const int w = width;
+   const int h = height;
    unsigned char* pixels = new unsigned char[3 * w * h];
 
    glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, pixels);
@@ -287,31 +698,67 @@ void OpenGL::CheckError(const char *text)
    }
 }
 
-void OpenGL::DrawGLScene()
+//
+// Draws a recorded frame. Called on the render thread, or on the main
+// thread straight after recording if there is no render thread.
+//
+void OpenGL::DrawGLScene(RenderSnapshot& snapshot)
 {
-   // Render the scene
-   if (dodisplay) {
-      // Clear the screen
-      glClear(GL_COLOR_BUFFER_BIT);
+   if (snapshot.m_fence != 0) {
+      glWaitSync(snapshot.m_fence, 0, GL_TIMEOUT_IGNORED);
+      glDeleteSync(snapshot.m_fence);
+      snapshot.m_fence = 0;
+   }
 
-      glUseProgram(m_program);
-      Reset();
+   if (snapshot.m_width != m_viewWidth || snapshot.m_height != m_viewHeight)
+      ResizeGLScene(snapshot.m_width, snapshot.m_height);
 
-      ScreenManager::GetInstance().Display();
+   // Clear the screen
+   glClear(GL_COLOR_BUFFER_BIT);
 
-      CheckError("DrawGLScene");
+   m_stats = StateStats();
 
-      SDL_GL_SwapWindow(m_window);
+   // Anything may have touched the GL state between frames
+   InvalidateState();
 
-      if (deferredScreenShot) {
-         TakeScreenShot();
-         deferredScreenShot = false;
+   BeginFrame();
+
+   for (const RenderSnapshot::Command& command : snapshot.m_commands) {
+      switch (command.kind) {
+      case RenderSnapshot::DRAW:
+         DrawVertices(snapshot, command);
+         break;
+      case RenderSnapshot::SPRITES:
+         DrawSprites(snapshot, command);
+         break;
+      case RenderSnapshot::PARTICLES:
+         DrawParticles(snapshot, command);
+         break;
       }
+   }
 
-      fps_framesdrawn++;
+   EndFrame();
+
+   {
+      lock_guard<mutex> lock(m_statsLock);
+      m_lastStats = m_stats;
    }
-   else
-      dodisplay = true;
+
+   CheckError("DrawGLScene");
+
+   SDL_GL_SwapWindow(m_window);
+
+   if (snapshot.m_screenShot)
+      TakeScreenShot(snapshot.m_width, snapshot.m_height);
+
+   if (m_frame == FRAMES_IN_FLIGHT + 1)
+      cout << "First frame drawn after " << SDL_GetTicks() << " ms" << endl;
+
+   fps_framesdrawn++;
+
+   // Nothing drawn from now on can use objects deleted before this
+   // frame was recorded
+   ReleaseObjects(snapshot.m_serial);
 
    // Calculate frame rate
    if (SDL_GetTicks() - fps_lastcheck >= 1000)	{
@@ -324,7 +771,8 @@ void OpenGL::DrawGLScene()
       char buf[TITLE_BUF_LEN];
 
       if (!fullscreen) {
-         snprintf(buf, TITLE_BUF_LEN, "%s {%dfps}", WINDOW_TITLE, fps_rate);
+         snprintf(buf, TITLE_BUF_LEN, "%s {%dfps}", WINDOW_TITLE,
+                  fps_rate.load());
          SDL_WM_SetCaption(buf, NULL);
       }
 #endif /* #ifdef SHOW_FPS */
@@ -335,8 +783,96 @@ void OpenGL::Draw(const VertexBuffer& vbo, int first, int count)
 {
    assert(first + count <= vbo.m_count);
 
-   BindVertexBuffer bind(vbo);
-   glDrawArrays(vbo.m_mode, first, count);
+   // Sprites added earlier must appear underneath this geometry
+   FlushSprites();
+
+   if (!vbo.IsValid())
+      Die("Attempt to draw invalid VBO");
+
+   assert(m_recording != nullptr);
+
+   RenderSnapshot::Command command = {};
+   command.kind = RenderSnapshot::DRAW;
+   command.state = m_desired;
+   command.mode = vbo.m_mode;
+   command.vertType = vbo.m_vertType;
+   command.count = count;
+
+   if (vbo.m_dynamic) {
+      // Copy the vertices as the buffer may change before this is drawn
+      vector<GLubyte>& vertices = m_recording->m_vertices;
+      const GLubyte *data = vbo.m_shadow.data() + first * vbo.m_stride;
+
+      command.name = 0;
+      command.first = vertices.size() / vbo.m_stride;
+      vertices.insert(vertices.end(), data, data + count * vbo.m_stride);
+   }
+   else {
+      command.name = vbo.m_vbo;
+      command.first = first;
+   }
+
+   m_recording->m_commands.push_back(command);
+}
+
+//
+// Draws vertices from a static buffer or copied into the snapshot from
+// a dynamic buffer.
+//
+void OpenGL::DrawVertices(const RenderSnapshot& snapshot,
+                          const RenderSnapshot::Command& command)
+{
+   CommitState(command.state);
+
+   GLuint buffer = command.name;
+   int first = command.first;
+
+   if (buffer == 0) {
+      const size_t stride = sizeof(VertexF);
+      const GLubyte *data = snapshot.m_vertices.data() + first * stride;
+      const size_t size = command.count * stride;
+
+      if (m_stream.IsValid()) {
+         buffer = m_stream.GetBuffer();
+         first = m_stream.Write(data, size, stride) / stride;
+      }
+      else {
+         buffer = m_vertexVbo;
+         first = 0;
+         glBindBuffer(GL_ARRAY_BUFFER, buffer);
+         glBufferData(GL_ARRAY_BUFFER, size, data, GL_STREAM_DRAW);
+      }
+   }
+
+   BindVertexArray(GetVertexArray(buffer, command.vertType));
+   glDrawArrays(command.mode, first, command.count);
+}
+
+//
+// The attribute bindings for a buffer are set up the first time it is
+// drawn so later draws only need to bind the vertex array.
+//
+GLuint OpenGL::GetVertexArray(GLuint buffer, GLenum vertType)
+{
+   const auto key = make_pair(buffer, vertType);
+
+   auto it = m_vertexArrays.find(key);
+   if (it != m_vertexArrays.end())
+      return it->second;
+
+   GLuint vao;
+   glGenVertexArrays(1, &vao);
+   BindVertexArray(vao);
+
+   glBindBuffer(GL_ARRAY_BUFFER, buffer);
+   glEnableVertexAttribArray(0);
+   glEnableVertexAttribArray(1);
+   glVertexAttribPointer(0, 2, vertType, GL_FALSE, sizeof(VertexF), 0);
+   glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(VertexF),
+                         (GLvoid*)offsetof(VertexF, tx));
+
+   m_vertexArrays[key] = vao;
+   return vao;
 }
 
 void OpenGL::Draw(const VertexBuffer& vbo)
@@ -349,6 +885,12 @@ OpenGL::~OpenGL()
    if (m_program != 0)
       glDeleteProgram(m_program);
 
+   if (m_spriteProgram != 0)
+      glDeleteProgram(m_spriteProgram);
+
+   if (m_particleProgram != 0)
+      glDeleteProgram(m_particleProgram);
+
    if (m_glcontext != NULL)
       SDL_GL_DeleteContext(m_glcontext);
 
@@ -377,19 +919,19 @@ bool OpenGL::InitGL()
    // Clear any error bit (this seems to be required on Windows??)
    glGetError();
 
-   CompileShaders();
+   // Attribute divisors for instanced drawing are core in 3.3
+   m_hasInstancing = GLEW_VERSION_3_3;
+   if (!m_hasInstancing)
+      cout << "Instanced rendering not supported" << endl;
 
-   // Set options
-   glShadeModel(GL_SMOOTH);			        // Enable smooth shading
-   glClearColor(0.0f, 0.0f, 0.0f, 0.0f);		// Black background
-   glClearDepth(1.0f);					// Depth buffer setup
-   glHint(GL_PERSPECTIVE_CORRECTION_HINT, GL_FASTEST);
-   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);	// Basic blending function
-   glEnable(GL_ALPHA_TEST);				// Enable alpha testing
-   glAlphaFunc(GL_GREATER, 0.0);			// Alpha testing function
-   glDisable(GL_NORMALIZE);
-   glDisable(GL_DEPTH_TEST);
-   glEnable(GL_BLEND);
+   m_hasBufferStorage = GLEW_ARB_buffer_storage;
+   if (!m_hasBufferStorage)
+      cout << "Persistent buffer mapping not supported" << endl;
+
+   // Cached so textures can be checked without a GL context
+   glGetIntegerv(GL_MAX_TEXTURE_SIZE, &m_maxTextureSize);
+
+   CompileShaders();
 
    CheckError("InitGL");
 
@@ -399,41 +941,323 @@ bool OpenGL::InitGL()
 
 GLvoid OpenGL::ResizeGLScene(GLsizei width, GLsizei height)
 {
+   m_viewWidth = width;
+   m_viewHeight = height;
+
    if (height == 0) height = 1;
 
-   glUseProgram(m_program);
+   glUseProgram(m_spriteProgram);
+   glUniform2f(GetUniformLocation(m_spriteProgram, "WindowSize"),
+               width, height);
+
+   glUseProgram(m_particleProgram);
+   glUniform2f(GetUniformLocation(m_particleProgram, "WindowSize"),
+               width, height);
 
-   GLuint windowSizeU = GetUniformLocation("WindowSize");
-   glUniform2f(windowSizeU, width, height);
+   glUseProgram(m_program);
+   glUniform2f(GetUniformLocation(m_program, "WindowSize"), width, height);
 
    glViewport(0, 0, width, height);
 
+   InvalidateState();
+
    CheckError("ResizeGLScene");
 }
 
-void OpenGL::Reset()
+//
+// Forgets what the GL state is believed to be so that the next draw sets
+// everything again. Must be called on the render thread after changing
+// GL state directly.
+//
+void OpenGL::InvalidateState()
 {
-   SetTranslation(0.0f, 0.0f);
-   SetScale(1.0f);
-   SetColour(1.0f, 1.0f, 1.0f);
-   SetRotation(0.0f);
-   SetTexture(0);
-   SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+   const float nan = NAN;
+
+   m_current.translateX = m_current.translateY = nan;
+   m_current.scaleX = m_current.scaleY = nan;
+   m_current.angle = nan;
+   m_current.colour = Colour::Make(nan, nan, nan, nan);
+   m_current.texture = INVALID_TEXTURE;
+   m_current.sfactor = m_current.dfactor = GL_NONE;
+   m_current.program = 0;
+   m_current.vao = INVALID_VAO;
 }
 
-void OpenGL::SetTranslation(float x, float y)
+//
+// Waits for the GPU to finish the frame whose fence is about to be
+// reused so that its region of the stream buffer may be overwritten.
+//
+void OpenGL::BeginFrame()
 {
-   glUniform2f(m_translateLocation, x, y);
-}
+   GLsync& fence = m_frameFences[m_frame % FRAMES_IN_FLIGHT];
+   if (fence != 0) {
+      WaitForSync(fence);
+      glDeleteSync(fence);
+      fence = 0;
+   }
 
-void OpenGL::SetRotation(float angle)
-{
-   glUniform1f(m_angleLocation, angle * (M_PI / 180));
+   m_stream.BeginFrame(m_frame);
+}
+
+void OpenGL::EndFrame()
+{
+   if (m_hasBufferStorage) {
+      GLsync& fence = m_frameFences[m_frame % FRAMES_IN_FLIGHT];
+      assert(fence == 0);
+      fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+   }
+
+   m_frame++;
+}
+
+//
+// Blocks until the GPU has finished all commands issued in the given
+// frame. If this is the current frame then wait for everything issued
+// so far. The frame fences belong to the render thread's context so this
+// must only be called on that thread.
+//
+void OpenGL::WaitForFrame(unsigned frame)
+{
+   assert(this_thread::get_id() == m_renderThreadId);
+
+   if (!m_hasBufferStorage || frame + FRAMES_IN_FLIGHT <= m_frame)
+      return;
+   else if (frame < m_frame) {
+      GLsync fence = m_frameFences[frame % FRAMES_IN_FLIGHT];
+      if (fence != 0)
+         WaitForSync(fence);
+   }
+   else {
+      GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      WaitForSync(fence);
+      glDeleteSync(fence);
+   }
+}
+
+void OpenGL::WaitForSync(GLsync fence)
+{
+   const GLuint64 timeout = 1000000000;   // One second in nanoseconds
+
+   for (;;) {
+      switch (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout)) {
+      case GL_ALREADY_SIGNALED:
+      case GL_CONDITION_SATISFIED:
+         return;
+      case GL_WAIT_FAILED:
+         Die("Failed to wait for GPU fence");
+      default:
+         break;
+      }
+   }
+}
+
+void OpenGL::BindVertexArray(GLuint vao)
+{
+   if (m_current.vao != vao) {
+      glBindVertexArray(vao);
+      m_current.vao = vao;
+      m_stats.issued++;
+   }
+   else
+      m_stats.elided++;
+}
+
+//
+// Deleting the bound vertex array reverts the binding to zero.
+//
+void OpenGL::DeleteVertexArray(GLuint vao)
+{
+   glDeleteVertexArrays(1, &vao);
+
+   if (m_current.vao == vao)
+      m_current.vao = 0;
+}
+
+//
+// Returns the state change counts for the last frame drawn.
+//
+OpenGL::StateStats OpenGL::GetStateStats() const
+{
+   lock_guard<mutex> lock(m_statsLock);
+   return m_lastStats;
+}
+
+//
+// Buffers and textures may still be used by frames that have not been
+// drawn yet so they are only deleted once the render thread has drawn
+// every frame recorded before this point.
+//
+void OpenGL::DeleteBuffer(GLuint buffer)
+{
+   Release(buffer, false);
+}
+
+void OpenGL::DeleteTexture(GLuint texture)
+{
+   Release(texture, true);
+}
+
+void OpenGL::Release(GLuint name, bool texture)
+{
+   if (name == 0)
+      return;
+
+   {
+      lock_guard<mutex> lock(m_releaseLock);
+      m_releases.push_back(PendingRelease { m_serial, name, texture });
+   }
+
+   // Nothing can still be using it when frames are not being drawn
+   if (!m_drawing)
+      ReleaseObjects(UINT_MAX);
+}
+
+//
+// Deletes objects released before the snapshot with the given serial
+// number was recorded, along with any vertex arrays made for them.
+//
+void OpenGL::ReleaseObjects(unsigned serial)
+{
+   vector<PendingRelease> ready;
+   {
+      lock_guard<mutex> lock(m_releaseLock);
+
+      auto it = partition(m_releases.begin(), m_releases.end(),
+                          [serial](const PendingRelease& r) {
+                             return r.serial > serial;
+                          });
+
+      ready.assign(it, m_releases.end());
+      m_releases.erase(it, m_releases.end());
+   }
+
+   for (const PendingRelease& r : ready) {
+      if (r.texture) {
+         glDeleteTextures(1, &r.name);
+         continue;
+      }
+
+      for (GLenum vertType : { GL_INT, GL_FLOAT }) {
+         auto it = m_vertexArrays.find(make_pair(r.name, vertType));
+         if (it != m_vertexArrays.end()) {
+            DeleteVertexArray(it->second);
+            m_vertexArrays.erase(it);
+         }
+      }
+
+      glDeleteBuffers(1, &r.name);
+   }
+}
+
+void OpenGL::UseProgram(GLuint program)
+{
+   if (m_current.program != program) {
+      glUseProgram(program);
+      m_current.program = program;
+      m_stats.issued++;
+   }
+   else
+      m_stats.elided++;
+}
+
+void OpenGL::BindTexture(GLuint texture)
+{
+   if (m_current.texture != texture) {
+      glBindTexture(GL_TEXTURE_2D, texture);
+      m_current.texture = texture;
+      m_stats.issued++;
+   }
+   else
+      m_stats.elided++;
+}
+
+void OpenGL::BlendFunc(GLenum sfactor, GLenum dfactor)
+{
+   if (m_current.sfactor != sfactor || m_current.dfactor != dfactor) {
+      glBlendFunc(sfactor, dfactor);
+      m_current.sfactor = sfactor;
+      m_current.dfactor = dfactor;
+      m_stats.issued++;
+   }
+   else
+      m_stats.elided++;
+}
+
+//
+// Applies the state recorded with a draw to the main shader program.
+//
+void OpenGL::CommitState(const DrawState& want)
+{
+   UseProgram(m_program);
+
+   State& cur = m_current;
+
+   if (cur.translateX != want.translateX
+       || cur.translateY != want.translateY) {
+      glUniform2f(m_translateLocation, want.translateX, want.translateY);
+      cur.translateX = want.translateX;
+      cur.translateY = want.translateY;
+      m_stats.issued++;
+   }
+   else
+      m_stats.elided++;
+
+   if (cur.scaleX != want.scaleX || cur.scaleY != want.scaleY) {
+      glUniform2f(m_scaleLocation, want.scaleX, want.scaleY);
+      cur.scaleX = want.scaleX;
+      cur.scaleY = want.scaleY;
+      m_stats.issued++;
+   }
+   else
+      m_stats.elided++;
+
+   if (cur.angle != want.angle) {
+      glUniform1f(m_angleLocation, want.angle);
+      cur.angle = want.angle;
+      m_stats.issued++;
+   }
+   else
+      m_stats.elided++;
+
+   if (cur.colour.r != want.colour.r || cur.colour.g != want.colour.g
+       || cur.colour.b != want.colour.b || cur.colour.a != want.colour.a) {
+      glUniform4f(m_colourLocation, want.colour.r, want.colour.g,
+                  want.colour.b, want.colour.a);
+      cur.colour = want.colour;
+      m_stats.issued++;
+   }
+   else
+      m_stats.elided++;
+
+   BindTexture(want.texture);
+   BlendFunc(want.sfactor, want.dfactor);
+}
+
+void OpenGL::Reset()
+{
+   SetTranslation(0.0f, 0.0f);
+   SetScale(1.0f);
+   SetColour(1.0f, 1.0f, 1.0f);
+   SetRotation(0.0f);
+   SetTexture(0);
+   SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+void OpenGL::SetTranslation(float x, float y)
+{
+   m_desired.translateX = x;
+   m_desired.translateY = y;
+}
+
+void OpenGL::SetRotation(float angle)
+{
+   m_desired.angle = angle * (M_PI / 180);
 }
 
 void OpenGL::SetScale(float scaleX, float scaleY)
 {
-   glUniform2f(m_scaleLocation, scaleX, scaleY);
+   m_desired.scaleX = scaleX;
+   m_desired.scaleY = scaleY;
 }
 
 void OpenGL::SetScale(float scale)
@@ -443,7 +1267,7 @@ void OpenGL::SetScale(float scale)
 
 void OpenGL::SetColour(float r, float g, float b, float a)
 {
-   glUniform4f(m_colourLocation, r, g, b, a);
+   m_desired.colour = Colour::Make(r, g, b, a);
 }
 
 void OpenGL::SetColour(const Colour& colour)
@@ -453,17 +1277,174 @@ void OpenGL::SetColour(const Colour& colour)
 
 void OpenGL::SetTexture(GLuint texture)
 {
-   glBindTexture(GL_TEXTURE_2D, texture);
+   m_desired.texture = texture;
 }
 
 void OpenGL::SetTexture(const Texture& texture)
 {
-   glBindTexture(GL_TEXTURE_2D, texture.GetGLTexture());
+   SetTexture(texture.GetGLTexture());
 }
 
 void OpenGL::SetBlendFunc(GLenum sfactor, GLenum dfactor)
 {
-   glBlendFunc(sfactor, dfactor);
+   m_desired.sfactor = sfactor;
+   m_desired.dfactor = dfactor;
+}
+
+//
+// Records all the quads queued in the sprite batch to be drawn together.
+//
+void OpenGL::FlushSprites()
+{
+   if (m_sprites.IsEmpty())
+      return;
+
+   assert(m_recording != nullptr);
+
+   RenderSnapshot& snapshot = *m_recording;
+   const int base = snapshot.m_spriteVertices.size();
+
+   RenderSnapshot::Command command = {};
+   command.kind = RenderSnapshot::SPRITES;
+   command.first = snapshot.m_spriteRuns.size();
+   command.count = m_sprites.m_runs.size();
+   snapshot.m_commands.push_back(command);
+
+   for (SpriteBatch::Run run : m_sprites.m_runs) {
+      run.first += base;
+      snapshot.m_spriteRuns.push_back(run);
+   }
+
+   snapshot.m_spriteVertices.insert(snapshot.m_spriteVertices.end(),
+                                    m_sprites.m_vertices.begin(),
+                                    m_sprites.m_vertices.end());
+
+   m_sprites.Clear();
+}
+
+void OpenGL::DrawSprites(const RenderSnapshot& snapshot,
+                         const RenderSnapshot::Command& command)
+{
+   typedef SpriteBatch::SpriteVertex SpriteVertex;
+
+   const SpriteBatch::Run *runs = &snapshot.m_spriteRuns[command.first];
+   const SpriteBatch::Run& last = runs[command.count - 1];
+
+   const int first = runs[0].first;
+   const int count = last.first + last.count - first;
+
+   UseProgram(m_spriteProgram);
+   BindVertexArray(m_spriteVao);
+
+   const SpriteVertex *vertices = &snapshot.m_spriteVertices[first];
+   const size_t size = count * sizeof(SpriteVertex);
+
+   int base = -first;
+   if (m_stream.IsValid()) {
+      const GLintptr offset = m_stream.Write(vertices, size,
+                                             sizeof(SpriteVertex));
+      base += offset / sizeof(SpriteVertex);
+   }
+   else {
+      glBindBuffer(GL_ARRAY_BUFFER, m_spriteVbo);
+      glBufferData(GL_ARRAY_BUFFER, size, vertices, GL_STREAM_DRAW);
+   }
+
+   for (int i = 0; i < command.count; i++) {
+      BindTexture(runs[i].texture);
+      BlendFunc(runs[i].sfactor, runs[i].dfactor);
+      glDrawArrays(GL_QUADS, base + runs[i].first, runs[i].count);
+   }
+}
+
+//
+// Draws count particles as additively blended squares of the given size
+// with a single instanced draw call. Falls back to the sprite batch when
+// instancing is not available.
+//
+void OpenGL::DrawParticles(const Texture& texture, int size,
+                           const ParticleInstance *instances, int count)
+{
+   if (count == 0)
+      return;
+
+   const float tex_l = texture.MapU(0.0f);
+   const float tex_r = texture.MapU(1.0f);
+   const float tex_t = texture.MapV(0.0f);
+   const float tex_b = texture.MapV(1.0f);
+
+   if (!m_hasInstancing) {
+      const VertexI quad[4] = {
+         { 0, size, tex_l, tex_t },
+         { 0, 0, tex_l, tex_b },
+         { size, 0, tex_r, tex_b },
+         { size, size, tex_r, tex_t }
+      };
+
+      for (int i = 0; i < count; i++) {
+         const ParticleInstance& p = instances[i];
+         const Colour colour = Colour::Make(p.r / 255.0f, p.g / 255.0f,
+                                            p.b / 255.0f, p.a / 255.0f);
+         m_sprites.Add(texture, quad, p.x, p.y, 0.0f, 1.0f, colour,
+                       GL_SRC_ALPHA, GL_ONE);
+      }
+
+      return;
+   }
+
+   FlushSprites();
+
+   RenderSnapshot& snapshot = *m_recording;
+
+   RenderSnapshot::Command command = {};
+   command.kind = RenderSnapshot::PARTICLES;
+   command.name = texture.GetGLTexture();
+   command.size = size;
+   command.texRect[0] = tex_l;
+   command.texRect[1] = tex_t;
+   command.texRect[2] = tex_r - tex_l;
+   command.texRect[3] = tex_b - tex_t;
+   command.first = snapshot.m_particles.size();
+   command.count = count;
+   snapshot.m_commands.push_back(command);
+
+   snapshot.m_particles.insert(snapshot.m_particles.end(),
+                               instances, instances + count);
+}
+
+void OpenGL::DrawParticles(const RenderSnapshot& snapshot,
+                           const RenderSnapshot::Command& command)
+{
+   UseProgram(m_particleProgram);
+   glUniform1f(m_particleSizeLocation, command.size);
+   glUniform4fv(m_particleTexRectLocation, 1, command.texRect);
+
+   BindVertexArray(m_particleVao);
+
+   // The instance attributes are pointed at wherever this batch was
+   // written as the stream buffer offset changes with every draw
+   const ParticleInstance *instances = &snapshot.m_particles[command.first];
+   const size_t bytes = command.count * sizeof(ParticleInstance);
+
+   GLintptr offset = 0;
+   if (m_stream.IsValid()) {
+      offset = m_stream.Write(instances, bytes, sizeof(ParticleInstance));
+      glBindBuffer(GL_ARRAY_BUFFER, m_stream.GetBuffer());
+   }
+   else {
+      glBindBuffer(GL_ARRAY_BUFFER, m_particleVbo);
+      glBufferData(GL_ARRAY_BUFFER, bytes, instances, GL_STREAM_DRAW);
+   }
+
+   glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(ParticleInstance),
+                         (GLvoid*)(offset + offsetof(ParticleInstance, x)));
+   glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+                         sizeof(ParticleInstance),
+                         (GLvoid*)(offset + offsetof(ParticleInstance, r)));
+
+   BindTexture(command.name);
+   BlendFunc(GL_SRC_ALPHA, GL_ONE);
+   glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, command.count);
 }
 
 int OpenGL::GetFPS()
@@ -499,73 +1480,165 @@ void OpenGL::EnumResolutions(ResolutionList& out) const
    }
 }
 
-OpenGL::BindVertexBuffer::BindVertexBuffer(const VertexBuffer& vbo)
-   : m_didBind(false)
+Colour Colour::Make(float r, float g, float b, float a)
 {
-   if (vbo.m_vbo == 0)
-      Die("Attempt to bind invalid VBO");
-
-   GLuint bound;
-   glGetIntegerv(GL_ARRAY_BUFFER_BINDING, (GLint *)&bound);
-
-   if (bound == vbo.m_vbo)
-      return;
+   Colour c = { r, g, b, a };
+   return c;
+}
 
-   glEnableVertexAttribArray(0);
-   glEnableVertexAttribArray(1);
-   glBindBuffer(GL_ARRAY_BUFFER, vbo.m_vbo);
-   glVertexAttribPointer(0, 2, vbo.m_vertType, GL_FALSE, vbo.m_stride, 0);
-   glVertexAttribPointer(1, 2, vbo.m_texType, GL_FALSE, vbo.m_stride,
-                         vbo.m_texOffset);
+//
+// Converts a colour component to an unsigned byte clamped to [0, 255].
+//
+GLubyte Colour::ToByte(float f)
+{
+   if (f <= 0.0f)
+      return 0;
+   else if (f >= 1.0f)
+      return 255;
+   else
+      return (GLubyte)(f * 255.0f + 0.5f);
+}
 
-   m_didBind = true;
+void SpriteBatch::Add(const Texture& texture, const VertexI *quad,
+                      float x, float y, float angle, float scale,
+                      const Colour& colour, GLenum sfactor, GLenum dfactor)
+{
+   Add(texture.GetGLTexture(), quad, x, y, angle, scale, scale,
+       colour, sfactor, dfactor);
 }
 
-OpenGL::BindVertexBuffer::~BindVertexBuffer()
+//
+// Queues a quad for drawing. The vertices are rotated by angle degrees,
+// scaled, and then translated by (x, y) exactly as the main shader would.
+//
+void SpriteBatch::Add(GLuint texture, const VertexI *quad,
+                      float x, float y, float angle, float scaleX,
+                      float scaleY, const Colour& colour,
+                      GLenum sfactor, GLenum dfactor)
 {
-   if (m_didBind) {
-      glBindBuffer(GL_ARRAY_BUFFER, 0);
-      glDisableVertexAttribArray(0);
-      glDisableVertexAttribArray(1);
+   if (m_runs.empty()
+       || m_runs.back().texture != texture
+       || m_runs.back().sfactor != sfactor
+       || m_runs.back().dfactor != dfactor) {
+      Run run = { texture, sfactor, dfactor, (int)m_vertices.size(), 0 };
+      m_runs.push_back(run);
    }
+
+   const float radians = angle * (M_PI / 180);
+   const float cosA = cosf(radians);
+   const float sinA = sinf(radians);
+
+   const GLubyte r = Colour::ToByte(colour.r);
+   const GLubyte g = Colour::ToByte(colour.g);
+   const GLubyte b = Colour::ToByte(colour.b);
+   const GLubyte a = Colour::ToByte(colour.a);
+
+   for (int i = 0; i < 4; i++) {
+      const float px = quad[i].x;
+      const float py = quad[i].y;
+
+      SpriteVertex v = {
+         (px * cosA - py * sinA) * scaleX + x,
+         (px * sinA + py * cosA) * scaleY + y,
+         quad[i].tx, quad[i].ty,
+         r, g, b, a
+      };
+      m_vertices.push_back(v);
+   }
+
+   m_runs.back().count += 4;
 }
 
-Colour Colour::Make(float r, float g, float b, float a)
+void SpriteBatch::Clear()
 {
-   Colour c = { r, g, b, a };
-   return c;
+   m_vertices.clear();
+   m_runs.clear();
 }
 
 VertexBuffer VertexBuffer::Make(const VertexF *vertices, int count, GLenum mode)
 {
-   VertexBuffer vb(sizeof(VertexF), GL_FLOAT, GL_FLOAT,
-                   (GLvoid*)offsetof(VertexF, tx), count, mode);
+   VertexBuffer vb(sizeof(VertexF), GL_FLOAT, count, mode);
    vb.Upload(vertices, count, mode);
 
    return vb;
 }
 
+VertexBuffer VertexBuffer::MakeDynamic(const VertexF *vertices, int count,
+                                       GLenum mode)
+{
+   VertexBuffer vb(sizeof(VertexF), GL_FLOAT, count, mode);
+   vb.AllocateDynamic(vertices);
+
+   return vb;
+}
+
 void VertexBuffer::Upload(const VertexF *vertices, int count, GLenum mode)
 {
-   glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-   glBufferData(GL_ARRAY_BUFFER, count * sizeof(VertexF),
-                vertices, GL_STATIC_DRAW);
+   assert(m_stride == sizeof(VertexF));
+
+   if (m_dynamic)
+      UpdateDynamic(vertices, 0, count);
+   else if (!OpenGL::GetInstance().IsHeadless()) {
+      // Only the size is tracked when there is no GL context
+      if (m_vbo == 0)
+         glGenBuffers(1, &m_vbo);
+
+      glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+      glBufferData(GL_ARRAY_BUFFER, count * sizeof(VertexF),
+                   vertices, GL_STATIC_DRAW);
+   }
+
+   m_count = count;
+   m_mode = mode;
+}
+
+void VertexBuffer::Update(const VertexF *vertices, int first, int count)
+{
+   assert(m_stride == sizeof(VertexF));
+   UpdateDynamic(vertices, first, count);
 }
 
 VertexBuffer VertexBuffer::Make(const VertexI *vertices, int count, GLenum mode)
 {
-   VertexBuffer vb(sizeof(VertexI), GL_INT, GL_FLOAT,
-                   (GLvoid*)offsetof(VertexI, tx), count, mode);
+   VertexBuffer vb(sizeof(VertexI), GL_INT, count, mode);
    vb.Upload(vertices, count, mode);
 
    return vb;
 }
 
+VertexBuffer VertexBuffer::MakeDynamic(const VertexI *vertices, int count,
+                                       GLenum mode)
+{
+   VertexBuffer vb(sizeof(VertexI), GL_INT, count, mode);
+   vb.AllocateDynamic(vertices);
+
+   return vb;
+}
+
 void VertexBuffer::Upload(const VertexI *vertices, int count, GLenum mode)
 {
-   glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-   glBufferData(GL_ARRAY_BUFFER, count * sizeof(VertexI),
-                vertices, GL_STATIC_DRAW);
+   assert(m_stride == sizeof(VertexI));
+
+   if (m_dynamic)
+      UpdateDynamic(vertices, 0, count);
+   else if (!OpenGL::GetInstance().IsHeadless()) {
+      // Only the size is tracked when there is no GL context
+      if (m_vbo == 0)
+         glGenBuffers(1, &m_vbo);
+
+      glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+      glBufferData(GL_ARRAY_BUFFER, count * sizeof(VertexI),
+                   vertices, GL_STATIC_DRAW);
+   }
+
+   m_count = count;
+   m_mode = mode;
+}
+
+void VertexBuffer::Update(const VertexI *vertices, int first, int count)
+{
+   assert(m_stride == sizeof(VertexI));
+   UpdateDynamic(vertices, first, count);
 }
 
 VertexBuffer VertexBuffer::MakeQuad(int width, int height)
@@ -580,52 +1653,253 @@ VertexBuffer VertexBuffer::MakeQuad(int width, int height)
    return VertexBuffer::Make(vertices, 4);
 }
 
-VertexBuffer::VertexBuffer(GLuint stride, GLuint vertType, GLuint texType,
-                           GLvoid *texOffset, int count, GLenum mode)
-   : m_stride(stride),
-     m_vertType(vertType),
-     m_texType(texType),
-     m_texOffset(texOffset),
-     m_count(count),
-     m_mode(mode)
+// Both vertex types share the same layout apart from the position type
+static_assert(sizeof(VertexI) == sizeof(VertexF)
+              && offsetof(VertexI, tx) == offsetof(VertexF, tx),
+              "vertex layouts differ");
+
+VertexBuffer::VertexBuffer(GLuint stride, GLenum vertType, int count,
+                           GLenum mode)
+   : m_count(count),
+     m_mode(mode),
+     m_stride(stride),
+     m_vertType(vertType)
+{
+}
+
+//
+// Allocates storage for m_count vertices which may later be replaced
+// with Update. The initial contents are copied from data.
+//
+void VertexBuffer::AllocateDynamic(const void *data)
 {
-   glGenBuffers(1, &m_vbo);
+   m_dynamic = true;
+   m_capacity = m_count;
+
+   m_shadow.assign(static_cast<const GLubyte*>(data),
+                   static_cast<const GLubyte*>(data) + m_count * m_stride);
+}
+
+//
+// Replaces count vertices starting at first. Frames that have already
+// been recorded keep their own copy of the old contents.
+//
+void VertexBuffer::UpdateDynamic(const void *data, int first, int count)
+{
+   if (!m_dynamic)
+      Die("Cannot update static vertex buffer");
+   else if (first + count > m_capacity)
+      Die("Vertex buffer update of %d vertices exceeds capacity %d",
+          first + count, m_capacity);
+
+   memcpy(m_shadow.data() + first * m_stride, data, count * m_stride);
 }
 
 VertexBuffer::VertexBuffer(VertexBuffer&& other)
    : m_vbo(other.m_vbo),
+     m_count(other.m_count),
+     m_mode(other.m_mode),
      m_stride(other.m_stride),
      m_vertType(other.m_vertType),
-     m_texType(other.m_texType),
-     m_texOffset(other.m_texOffset),
-     m_count(other.m_count),
-     m_mode(other.m_mode)
+     m_capacity(other.m_capacity),
+     m_dynamic(other.m_dynamic),
+     m_shadow(std::move(other.m_shadow))
 {
    other.m_vbo = 0;
+   other.m_dynamic = false;
 }
 
 VertexBuffer::~VertexBuffer()
 {
-   if (m_vbo != 0)
-      glDeleteBuffers(1, &m_vbo);
+   Destroy();
+}
+
+void VertexBuffer::Destroy()
+{
+   OpenGL::GetInstance().DeleteBuffer(m_vbo);
 }
 
 VertexBuffer& VertexBuffer::operator=(VertexBuffer&& other)
 {
    if (this != &other) {
-      if (m_vbo != 0)
-         glDeleteBuffers(1, &m_vbo);
+      Destroy();
 
       m_vbo = other.m_vbo;
-      m_stride = other.m_stride;
-      m_vertType = other.m_vertType;
-      m_texType = other.m_texType;
-      m_texOffset = other.m_texOffset;
       m_count = other.m_count;
       m_mode = other.m_mode;
+      m_stride = other.m_stride;
+      m_vertType = other.m_vertType;
+      m_capacity = other.m_capacity;
+      m_dynamic = other.m_dynamic;
+      m_shadow = std::move(other.m_shadow);
 
       other.m_vbo = 0;
+      other.m_dynamic = false;
    }
 
    return *this;
 }
+
+StreamBuffer::~StreamBuffer()
+{
+   Destroy();
+}
+
+void StreamBuffer::Init(size_t frameSize)
+{
+   const GLbitfield flags =
+      GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+   glGenBuffers(1, &m_buffer);
+   glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+   glBufferStorage(GL_ARRAY_BUFFER, frameSize * FRAMES_IN_FLIGHT,
+                   NULL, flags);
+
+   m_mapped = static_cast<GLubyte*>(
+      glMapBufferRange(GL_ARRAY_BUFFER, 0, frameSize * FRAMES_IN_FLIGHT,
+                       flags));
+   if (m_mapped == nullptr)
+      Die("Failed to map stream buffer");
+
+   m_frameSize = frameSize;
+}
+
+void StreamBuffer::Destroy()
+{
+   if (m_buffer != 0) {
+      glDeleteBuffers(1, &m_buffer);
+      m_buffer = 0;
+      m_mapped = nullptr;
+   }
+}
+
+//
+// The caller must already have waited for the frame that last used
+// this frame's region.
+//
+void StreamBuffer::BeginFrame(unsigned frame)
+{
+   m_region = frame % FRAMES_IN_FLIGHT;
+   m_used = 0;
+}
+
+//
+// Copies data into this frame's region and returns its offset from the
+// start of the buffer, which is a multiple of align.
+//
+GLintptr StreamBuffer::Write(const void *data, size_t size, size_t align)
+{
+   assert(IsValid());
+
+   const size_t base = m_region * m_frameSize;
+
+   size_t offset = (base + m_used + align - 1) / align * align;
+   if (offset + size > base + m_frameSize) {
+      if (size + align > m_frameSize)
+         Die("Stream buffer too small for %zu bytes", size);
+
+      // Out of space: wait for everything written so far this frame to
+      // be consumed and start again from the beginning of the region
+      OpenGL& opengl = OpenGL::GetInstance();
+      opengl.WaitForFrame(opengl.GetFrameNumber());
+
+      offset = (base + align - 1) / align * align;
+   }
+
+   memcpy(m_mapped + offset, data, size);
+   m_used = offset + size - base;
+
+   return offset;
+}
+
+RenderSnapshot::~RenderSnapshot()
+{
+   Clear();
+}
+
+void RenderSnapshot::Clear()
+{
+   // A frame replaced before it was drawn still has its fence
+   if (m_fence != 0) {
+      glDeleteSync(m_fence);
+      m_fence = 0;
+   }
+
+   m_commands.clear();
+   m_vertices.clear();
+   m_spriteVertices.clear();
+   m_spriteRuns.clear();
+   m_particles.clear();
+
+   m_screenShot = false;
+}
+
+//
+// Makes the back snapshot the newest one ready to be drawn. A frame
+// published earlier which the render thread has not taken yet becomes
+// the next back snapshot and is never drawn.
+//
+void SnapshotQueue::Publish()
+{
+   lock_guard<mutex> lock(m_lock);
+
+   swap(m_back, m_ready);
+   m_fresh = true;
+
+   m_cond.notify_all();
+}
+
+bool SnapshotQueue::IsConsumed()
+{
+   lock_guard<mutex> lock(m_lock);
+   return !m_fresh;
+}
+
+//
+// Waits until the render thread takes the last published snapshot or
+// the deadline passes. Returns true in the first case.
+//
+bool SnapshotQueue::WaitUntilConsumed(chrono::steady_clock::time_point deadline)
+{
+   unique_lock<mutex> lock(m_lock);
+   return m_cond.wait_until(lock, deadline, [this] { return !m_fresh; });
+}
+
+//
+// Waits for a newly published snapshot and returns it. Returns null once
+// the queue is closed.
+//
+RenderSnapshot *SnapshotQueue::Acquire()
+{
+   unique_lock<mutex> lock(m_lock);
+   m_cond.wait(lock, [this] { return m_fresh || m_closed; });
+
+   if (m_closed)
+      return nullptr;
+
+   swap(m_front, m_ready);
+   m_fresh = false;
+
+   m_cond.notify_all();
+
+   return &m_snapshots[m_front];
+}
+
+void SnapshotQueue::Close()
+{
+   lock_guard<mutex> lock(m_lock);
+
+   m_closed = true;
+   m_cond.notify_all();
+}
+
+void SnapshotQueue::Reset()
+{
+   lock_guard<mutex> lock(m_lock);
+
+   for (RenderSnapshot& snapshot : m_snapshots)
+      snapshot.Clear();
+
+   m_fresh = false;
+   m_closed = false;
+}
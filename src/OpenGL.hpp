@@ -10,6 +10,12 @@
 #include "Texture.hpp"
 
 #include <vector>
+#include <map>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
 
 template <typename T>
 struct Vertex {
@@ -20,12 +26,28 @@ struct Vertex {
 typedef Vertex<int> VertexI;
 typedef Vertex<float> VertexF;
 
+// Number of frames the GPU may lag behind the CPU before we wait for it
+const int FRAMES_IN_FLIGHT = 3;
+
+//
+// A GL vertex buffer and the type of its vertices. The render thread
+// sets up a vertex array for each buffer the first time it is drawn.
+//
+// Buffers created with MakeDynamic have a fixed capacity and may be
+// changed with Update as often as required. Their contents are only
+// kept in memory and copied into each frame that draws them, so an
+// update never waits for, or changes, a frame still being drawn.
+//
 class VertexBuffer {
 public:
    static VertexBuffer Make(const VertexI *vertices, int count,
                             GLenum mode=GL_QUADS);
    static VertexBuffer Make(const VertexF *vertices, int count,
                             GLenum mode=GL_QUADS);
+   static VertexBuffer MakeDynamic(const VertexI *vertices, int count,
+                                   GLenum mode=GL_QUADS);
+   static VertexBuffer MakeDynamic(const VertexF *vertices, int count,
+                                   GLenum mode=GL_QUADS);
    static VertexBuffer MakeQuad(int width, int height);
    static VertexBuffer Invalid();
 
@@ -37,34 +59,211 @@ public:
                GLenum mode=GL_QUADS);
    void Upload(const VertexF *vertices, int count,
                GLenum mode=GL_QUADS);
+   void Update(const VertexI *vertices, int first, int count);
+   void Update(const VertexF *vertices, int first, int count);
+
+   bool IsValid() const { return m_vbo != 0 || m_dynamic; }
+   int GetCapacity() const { return m_capacity; }
 
    VertexBuffer& operator=(VertexBuffer&& other);
 
 private:
    friend class OpenGL;
 
-   VertexBuffer(GLuint stride, GLuint vertType, GLuint texType,
-                GLvoid *texOffset, int count, GLenum mode);
+   VertexBuffer(GLuint stride, GLenum vertType, int count, GLenum mode);
    VertexBuffer(const VertexBuffer&) = delete;
 
+   void AllocateDynamic(const void *data);
+   void UpdateDynamic(const void *data, int first, int count);
+   void Destroy();
+
    GLuint m_vbo = 0;
-   GLuint m_stride = 0;
-   GLuint m_vertType = 0;
-   GLuint m_texType = 0;
-   GLvoid *m_texOffset = nullptr;
    int m_count = 0;
    GLenum m_mode = GL_QUADS;
+   GLuint m_stride = 0;
+   GLenum m_vertType = GL_FLOAT;
+
+   // Only used by dynamic buffers
+   int m_capacity = 0;
+   bool m_dynamic = false;
+   vector<GLubyte> m_shadow;
+};
+
+//
+// A persistently mapped buffer for data written once and drawn in the
+// same frame. Each frame writes to its own region and the region is not
+// reused until the GPU has finished the frame that last used it.
+//
+class StreamBuffer {
+public:
+   StreamBuffer() = default;
+   ~StreamBuffer();
+
+   void Init(size_t frameSize);
+   void Destroy();
+   void BeginFrame(unsigned frame);
+   GLintptr Write(const void *data, size_t size, size_t align);
+
+   bool IsValid() const { return m_mapped != nullptr; }
+   GLuint GetBuffer() const { return m_buffer; }
+
+private:
+   StreamBuffer(const StreamBuffer&) = delete;
+
+   GLuint m_buffer = 0;
+   GLubyte *m_mapped = nullptr;
+   size_t m_frameSize = 0;
+   size_t m_used = 0;
+   int m_region = 0;
 };
 
 struct Colour {
    float r, g, b, a;
 
    static Colour Make(float r, float g, float b, float a=1.0f);
+   static GLubyte ToByte(float f);
 
    static const Colour WHITE;
    static const Colour BLACK;
 };
 
+//
+// Collects textured and coloured quads which are transformed on the CPU
+// and then drawn together from a single streaming vertex buffer. Quads
+// are drawn in the order they were added; consecutive quads that share
+// a texture and blend function are drawn with one call.
+//
+class SpriteBatch {
+public:
+   void Add(const Texture& texture, const VertexI *quad,
+            float x, float y, float angle=0.0f, float scale=1.0f,
+            const Colour& colour=Colour::WHITE,
+            GLenum sfactor=GL_SRC_ALPHA,
+            GLenum dfactor=GL_ONE_MINUS_SRC_ALPHA);
+   void Add(GLuint texture, const VertexI *quad,
+            float x, float y, float angle, float scaleX, float scaleY,
+            const Colour& colour, GLenum sfactor, GLenum dfactor);
+
+   bool IsEmpty() const { return m_runs.empty(); }
+
+private:
+   friend class OpenGL;
+   friend class RenderSnapshot;
+
+   struct SpriteVertex {
+      float x, y;
+      float tx, ty;
+      GLubyte r, g, b, a;
+   };
+
+   struct Run {
+      GLuint texture;
+      GLenum sfactor, dfactor;
+      int first, count;
+   };
+
+   void Clear();
+
+   vector<SpriteVertex> m_vertices;
+   vector<Run> m_runs;
+};
+
+//
+// Per-instance data for a particle drawn with OpenGL::DrawParticles.
+//
+struct ParticleInstance {
+   float x, y;
+   GLubyte r, g, b, a;
+};
+
+//
+// The state used for drawing a vertex buffer with the main shader.
+//
+struct DrawState {
+   float translateX, translateY;
+   float scaleX, scaleY;
+   float angle;
+   Colour colour;
+   GLuint texture;
+   GLenum sfactor, dfactor;
+};
+
+//
+// Everything needed to draw one frame. The simulation thread records
+// the draw calls made by the active screen into a snapshot, copying any
+// vertex or particle data that may change before it is drawn, and the
+// render thread later replays it. A published snapshot only refers to
+// GL objects that are not modified again, so the render thread never
+// reads any game state.
+//
+class RenderSnapshot {
+public:
+   RenderSnapshot() = default;
+   ~RenderSnapshot();
+
+   void Clear();
+
+   unsigned GetSerial() const { return m_serial; }
+
+private:
+   friend class OpenGL;
+
+   RenderSnapshot(const RenderSnapshot&) = delete;
+
+   enum Kind { DRAW, SPRITES, PARTICLES };
+
+   struct Command {
+      Kind kind;
+      int first, count;   // Vertices, sprite runs, or particles
+      DrawState state;
+      GLuint name;        // Buffer or particle texture
+      GLenum mode, vertType;
+      float size;
+      float texRect[4];
+   };
+
+   vector<Command> m_commands;
+   vector<GLubyte> m_vertices;   // Contents of dynamic buffers
+   vector<SpriteBatch::SpriteVertex> m_spriteVertices;
+   vector<SpriteBatch::Run> m_spriteRuns;
+   vector<ParticleInstance> m_particles;
+
+   unsigned m_serial = 0;
+   int m_width = 0, m_height = 0;
+   bool m_screenShot = false;
+
+   // Signalled once objects created while recording are ready for use
+   // in the render thread's context
+   GLsync m_fence = 0;
+};
+
+//
+// Passes snapshots from the simulation thread to the render thread
+// through three buffers: one being recorded, one being drawn, and the
+// most recently published one in between. Neither thread waits for the
+// other to finish with a buffer and the render thread always draws the
+// newest frame, skipping any it did not get to in time.
+//
+class SnapshotQueue {
+public:
+   RenderSnapshot& GetBack() { return m_snapshots[m_back]; }
+   void Publish();
+   bool IsConsumed();
+   bool WaitUntilConsumed(chrono::steady_clock::time_point deadline);
+
+   RenderSnapshot *Acquire();
+   void Close();
+   void Reset();
+
+private:
+   RenderSnapshot m_snapshots[3];
+   int m_back = 0, m_ready = 1, m_front = 2;
+   bool m_fresh = false;
+   bool m_closed = false;
+   mutex m_lock;
+   condition_variable m_cond;
+};
+
 //
 // A wrapper around common 2D OpenGL functions.
 //
@@ -73,6 +272,7 @@ public:
    static OpenGL& GetInstance();
 
    void Init(int width, int height, int depth, bool fullscreen);
+   void InitHeadless(int width, int height);
    void Stop();
    void Run();
    void SkipDisplay();
@@ -91,27 +291,46 @@ public:
    void SetTexture(const Texture& texture);
    void SetBlendFunc(GLenum sfactor, GLenum dfactor);
 
+   void DeleteBuffer(GLuint buffer);
+   void DeleteTexture(GLuint texture);
+
+   // Number of GL state changes made and skipped in the last frame
+   struct StateStats {
+      unsigned issued = 0;
+      unsigned elided = 0;
+   };
+
+   StateStats GetStateStats() const;
+   void InvalidateState();
+
+   bool HasBufferStorage() const { return m_hasBufferStorage; }
+   bool IsHeadless() const { return m_headless; }
+
+   SpriteBatch& GetSpriteBatch() { return m_sprites; }
+   void FlushSprites();
+
+   void DrawParticles(const Texture& texture, int size,
+                      const ParticleInstance *instances, int count);
+
    int GetWidth() const { return screen_width; }
    int GetHeight() const { return screen_height; }
 
    typedef float TimeScale;
 
    TimeScale GetTimeScale() const;
+   void SetSimulationRate(int hz);
+
+   // Fraction of a simulation step elapsed since the last one was
+   // processed, used to draw moving objects between their previous and
+   // current positions
+   float GetInterpolation() const { return m_interpolation; }
+   int Interpolate(int from, int to) const;
+   double Interpolate(double from, double to) const;
 
    void DeferScreenShot();
 
    bool SetVideoMode(bool fullscreen, int width, int height);
 
-   class BindVertexBuffer {
-   public:
-      explicit BindVertexBuffer(const VertexBuffer& vbo);
-      ~BindVertexBuffer();
-      BindVertexBuffer(const BindVertexBuffer&) = delete;
-
-   private:
-      bool m_didBind;
-   };
-
    struct Resolution {
       const int width, height;
       const bool allow_fullscreen;
@@ -121,24 +340,58 @@ public:
 
    bool IsTextureSizeSupported(int width, int height, int ncols=4,
                                GLenum format=GL_RGBA);
+   int GetMaxTextureSize() const { return m_maxTextureSize; }
 
    static void CheckError(const char *text=NULL);
 
    static const GLuint INVALID_TEXTURE = 0xFFFFFFFF;
+   static const GLuint INVALID_VAO = 0xFFFFFFFF;
    static const int VIRTUAL_FRAME_RATE = 35;
+   static const int MAX_STEPS_PER_FRAME = 5;
+   static const size_t STREAM_FRAME_SIZE = 1024 * 1024;
 
 private:
+   friend class StreamBuffer;
+
    OpenGL();
    OpenGL(const OpenGL&) = delete;
    ~OpenGL();
 
    GLvoid ResizeGLScene(GLsizei width, GLsizei height);
    bool InitGL();
-   void DrawGLScene();
-   void TakeScreenShot() const;
+   void InitRenderer();
+   void FreeRenderer();
+   bool StartRenderThread();
+   void StopRenderThread();
+   void RenderThread();
+   bool RecordFrame();
+   void DrawGLScene(RenderSnapshot& snapshot);
+   void DrawVertices(const RenderSnapshot& snapshot,
+                     const RenderSnapshot::Command& command);
+   void DrawSprites(const RenderSnapshot& snapshot,
+                    const RenderSnapshot::Command& command);
+   void DrawParticles(const RenderSnapshot& snapshot,
+                      const RenderSnapshot::Command& command);
+   GLuint GetVertexArray(GLuint buffer, GLenum vertType);
+   void Release(GLuint name, bool texture);
+   void ReleaseObjects(unsigned serial);
+   void TakeScreenShot(int width, int height) const;
    void AddShader(GLuint program, const char* text, GLenum type);
+   GLuint LinkProgram(const char *vertex, const char *fragment,
+                      const char *const *attribs);
    void CompileShaders();
-   GLuint GetUniformLocation(const char *name);
+   GLuint GetUniformLocation(GLuint program, const char *name);
+   void CommitState(const DrawState& want);
+   void BeginFrame();
+   void EndFrame();
+   unsigned GetFrameNumber() const { return m_frame; }
+   void WaitForFrame(unsigned frame);
+   static void WaitForSync(GLsync fence);
+   void BindVertexArray(GLuint vao);
+   void DeleteVertexArray(GLuint vao);
+   void UseProgram(GLuint program);
+   void BindTexture(GLuint texture);
+   void BlendFunc(GLenum sfactor, GLenum dfactor);
 
    // Window related variables
    int screen_width, screen_height;
@@ -147,15 +400,82 @@ private:
    int sdl_flags;
    SDL_Window *m_window;
    SDL_GLContext m_glcontext;
+   SDL_GLContext m_renderContext = NULL;
    GLuint m_program = 0;
    GLuint m_translateLocation = 0;
    GLuint m_scaleLocation = 0;
    GLuint m_colourLocation = 0;
    GLuint m_angleLocation = 0;
+   GLuint m_spriteProgram = 0;
+   GLuint m_spriteVbo = 0;
+   GLuint m_spriteVao = 0;
+   GLuint m_particleProgram = 0;
+   GLuint m_particleSizeLocation = 0;
+   GLuint m_particleTexRectLocation = 0;
+   GLuint m_particleQuadVbo = 0;
+   GLuint m_particleVbo = 0;
+   GLuint m_particleVao = 0;
+   GLuint m_vertexVbo = 0;
+   bool m_hasInstancing = false;
+   bool m_headless = false;
+   bool m_hasBufferStorage = false;
+   int m_maxTextureSize = 1024;
+
+   // Frames are numbered from FRAMES_IN_FLIGHT so that frame zero is
+   // always complete
+   unsigned m_frame = FRAMES_IN_FLIGHT;
+   GLsync m_frameFences[FRAMES_IN_FLIGHT] = {};
+   StreamBuffer m_stream;
+
+   // The state requested through the Set* functions is recorded with
+   // each draw and only applied by the render thread where it differs
+   // from the state the GL already has
+   struct State : DrawState {
+      GLuint program;
+      GLuint vao;
+   };
+
+   DrawState m_desired;
+   State m_current;
+   StateStats m_stats;
+
+   // Copied from m_stats by the render thread when it finishes a frame
+   mutable mutex m_statsLock;
+   StateStats m_lastStats;
+
+   SpriteBatch m_sprites;
+
+   // Snapshots are recorded on the thread running the simulation and
+   // drawn on the render thread when there is one
+   SnapshotQueue m_snapshots;
+   RenderSnapshot *m_recording = nullptr;
+   atomic<unsigned> m_serial {0};
+   thread m_renderThread;
+   thread::id m_renderThreadId;
+   int m_viewWidth = 0, m_viewHeight = 0;
+
+   // Vertex arrays are not shared between contexts so the render thread
+   // makes its own for each buffer and vertex type
+   map<pair<GLuint, GLenum>, GLuint> m_vertexArrays;
+
+   // Buffers and textures deleted while frames that use them may still
+   // be waiting to be drawn
+   struct PendingRelease {
+      unsigned serial;
+      GLuint name;
+      bool texture;
+   };
+
+   mutex m_releaseLock;
+   vector<PendingRelease> m_releases;
+   atomic<bool> m_drawing {false};
 
    // Frame rate variables
-   int fps_lastcheck, fps_framesdrawn, fps_rate;
+   int fps_lastcheck, fps_framesdrawn;
+   atomic<int> fps_rate;
    TimeScale m_timeScale;
+   int m_simRate = VIRTUAL_FRAME_RATE;
+   float m_interpolation = 0.0f;
 
    bool deferredScreenShot;
 };
@@ -17,8 +17,8 @@ const double Options::FADE_SPEED = 0.1;
 
 Options::Options()
    : state(optFadeIn),
-     helpFont(LocateResource("fonts/VeraBd.ttf"), 12),
-     itemFont(LocateResource("fonts/VeraBd.ttf"), 16),
+     helpFont("fonts/VeraBd.ttf", 12),
+     itemFont("fonts/VeraBd.ttf", 16),
      fadeAlpha(0.0),
      selected(0)
 {
@@ -0,0 +1,196 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+//
+// Build time tool which decodes the images, sounds and fonts under the
+// data directory into a single asset pack loaded by AssetPack.
+//
+
+#define SDL_MAIN_HANDLED
+
+#include "Platform.hpp"
+#include "AssetPack.hpp"
+#include "FontData.hpp"
+#include "AssetDecode.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <cstdarg>
+
+using filesystem::path;
+
+namespace {
+
+   struct PendingEntry {
+      string name;
+      PackEntry entry;
+   };
+
+}
+
+//
+// Accumulates asset data and writes it followed by the directory.
+//
+class PackWriter {
+public:
+   void Add(const string& name, PackKind kind, const void *data,
+            size_t size, uint32_t p0=0, uint32_t p1=0, uint32_t p2=0);
+   void Write(const string& fileName);
+
+private:
+   static const size_t ALIGN = 16;
+
+   vector<uint8_t> m_data;
+   vector<PendingEntry> m_entries;
+};
+
+void PackWriter::Add(const string& name, PackKind kind, const void *data,
+                     size_t size, uint32_t p0, uint32_t p1, uint32_t p2)
+{
+   // Offsets are relative to the start of the file
+   const size_t offset =
+      (sizeof(PackHeader) + m_data.size() + ALIGN - 1) / ALIGN * ALIGN;
+   m_data.resize(offset - sizeof(PackHeader));
+
+   const uint8_t *bytes = static_cast<const uint8_t*>(data);
+   m_data.insert(m_data.end(), bytes, bytes + size);
+
+   PendingEntry pending;
+   pending.name = name;
+   pending.entry.hash = AssetPack::Hash(name);
+   pending.entry.offset = offset;
+   pending.entry.size = size;
+   pending.entry.kind = kind;
+   pending.entry.params[0] = p0;
+   pending.entry.params[1] = p1;
+   pending.entry.params[2] = p2;
+
+   m_entries.push_back(pending);
+}
+
+void PackWriter::Write(const string& fileName)
+{
+   sort(m_entries.begin(), m_entries.end(),
+        [](const PendingEntry& a, const PendingEntry& b) {
+           return a.entry.hash < b.entry.hash;
+        });
+
+   for (size_t i = 1; i < m_entries.size(); i++) {
+      if (m_entries[i].entry.hash == m_entries[i - 1].entry.hash)
+         Die("Hash collision between %s and %s",
+             m_entries[i].name.c_str(), m_entries[i - 1].name.c_str());
+   }
+
+   m_data.resize((m_data.size() + ALIGN - 1) / ALIGN * ALIGN);
+
+   PackHeader header;
+   memcpy(header.magic, AssetPack::MAGIC, sizeof(header.magic));
+   header.version = AssetPack::FORMAT_VERSION;
+   header.entryCount = m_entries.size();
+   header.directoryOffset = sizeof(PackHeader) + m_data.size();
+
+   ofstream out(fileName, ios::binary);
+   if (!out)
+      Die("Cannot open %s for writing", fileName.c_str());
+
+   out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+   out.write(reinterpret_cast<const char*>(m_data.data()), m_data.size());
+
+   for (const PendingEntry& pending : m_entries)
+      out.write(reinterpret_cast<const char*>(&pending.entry),
+                sizeof(PackEntry));
+
+   if (!out)
+      Die("Error writing %s", fileName.c_str());
+}
+
+static void PackImage(PackWriter& writer, const path& file, const string& name)
+{
+   ImageData image;
+   DecodeImage(file.string(), image);
+
+   writer.Add(name, PACK_TEXTURE, image.texels.data(), image.texels.size(),
+              image.width, image.height);
+}
+
+static void PackSound(PackWriter& writer, const path& file, const string& name)
+{
+   SoundData sound;
+   DecodeSound(file.string(), sound);
+
+   writer.Add(name, PACK_SOUND, sound.samples.data(), sound.samples.size(),
+              sound.rate, sound.format, sound.channels);
+}
+
+static void PackFont(PackWriter& writer, const path& file,
+                     const string& name, unsigned size)
+{
+   RasterFont raster;
+   raster.Rasterize(file.string(), size);
+
+   // Glyph table followed by the texels
+   vector<uint8_t> data(sizeof(raster.glyphs) + raster.texels.size());
+   memcpy(data.data(), raster.glyphs, sizeof(raster.glyphs));
+   copy(raster.texels.begin(), raster.texels.end(),
+        data.begin() + sizeof(raster.glyphs));
+
+   writer.Add(AssetPack::FontName(name, size), PACK_FONT, data.data(),
+              data.size(), raster.cellSize, raster.textureWidth);
+}
+
+//
+// Returns the files in a data subdirectory with the given extension in
+// a stable order.
+//
+static vector<path> ListFiles(const path& dir, const string& extension)
+{
+   vector<path> files;
+   for (const auto& entry : filesystem::directory_iterator(dir)) {
+      if (entry.is_regular_file() && entry.path().extension() == extension)
+         files.push_back(entry.path());
+   }
+
+   sort(files.begin(), files.end());
+   return files;
+}
+
+int main(int argc, char **argv)
+{
+   if (argc != 3) {
+      cerr << "Usage: " << argv[0] << " OUTPUT DATADIR" << endl;
+      return EXIT_FAILURE;
+   }
+
+   const path datadir(argv[2]);
+
+   PackWriter writer;
+
+   for (const path& file : ListFiles(datadir / "images", ".png"))
+      PackImage(writer, file, "images/" + file.filename().string());
+
+   for (const path& file : ListFiles(datadir / "sounds", ".wav"))
+      PackSound(writer, file, "sounds/" + file.filename().string());
+
+   for (unsigned size : FONT_SIZES)
+      PackFont(writer, datadir / FONT_FILE, FONT_FILE, size);
+
+   writer.Write(argv[1]);
+
+   return EXIT_SUCCESS;
+}
+
+void Die(const char *fmt, ...)
+{
+   va_list ap;
+   va_start(ap, fmt);
+   vfprintf(stderr, fmt, ap);
+   fprintf(stderr, "\n");
+   va_end(ap);
+
+   exit(EXIT_FAILURE);
+}
@@ -0,0 +1,70 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "Platform.hpp"
+#include "LanderEnv.hpp"
+#include "Emitter.hpp"
+#include "SimContext.hpp"
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstdlib>
+
+#include <SDL_main.h>
+
+//
+// Measures how fast explosions and high score fireworks are updated.
+//   lander-particle-bench [EMITTERS] [STEPS]
+//
+int main(int argc, char **argv)
+{
+   const int count = argc > 1 ? max(atoi(argv[1]), 1) : 64;
+   const int steps = argc > 2 ? max(atoi(argv[2]), 1) : 2000;
+
+   // Only to load textures without a window
+   LanderEnv::Initialise();
+
+   vector<unique_ptr<Emitter>> emitters;
+   for (int i = 0; i < count; i++) {
+      if (i % 2 == 0)
+         emitters.emplace_back(new Explosion);
+      else {
+         // Same settings as a firework that has gone off
+         Emitter *em = new Emitter(0, 0, 1.0f, 1.0f, 1.0f, false);
+         em->maxspeed = 200;
+         em->createrate = 2.0f;
+         em->life = 0.5f;
+         emitters.emplace_back(em);
+      }
+   }
+
+   long updates = 0;
+
+   using namespace chrono;
+   const steady_clock::time_point start = steady_clock::now();
+
+   for (int n = 0; n < steps; n++) {
+      // Keep the emitters busy in bursts like the real effects
+      const bool create = n % 100 < 50;
+      for (unique_ptr<Emitter>& em : emitters) {
+         em->Process(create);
+         updates += MAX_PARTICLES;
+      }
+   }
+
+   const double secs =
+      duration<double>(steady_clock::now() - start).count();
+
+   cout << count << " emitters ran " << steps << " steps in " << secs
+        << "s (" << (long)(updates / secs) << " particle slots/s)" << endl;
+
+   const ParticlePool& pool = SimContext::Default().GetParticles();
+   cout << "Pool grew to " << pool.GetBlockCount() * ParticlePool::BLOCK_SIZE
+        << " particles for " << count * MAX_PARTICLES << " slots" << endl;
+
+   return 0;
+}
@@ -0,0 +1,49 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "ParticlePool.hpp"
+
+// Emitters load blocks with aligned SSE instructions
+static_assert(__STDCPP_DEFAULT_NEW_ALIGNMENT__ >= 16,
+              "vector storage is not aligned for SSE");
+static_assert(ParticlePool::BLOCK_SIZE % 4 == 0,
+              "blocks must hold whole groups of four");
+
+//
+// Returns the number of an unused block, growing the pool if there are
+// none. This may move the arrays.
+//
+int ParticlePool::Allocate()
+{
+   if (!m_free.empty()) {
+      const int block = m_free.back();
+      m_free.pop_back();
+      return block;
+   }
+
+   const size_t size = (m_blockCount + 1) * BLOCK_SIZE;
+   for (vector<float>* v : { &x, &y, &xi, &yi, &life, &fade, &r, &g, &b })
+      v->resize(size);
+
+   return m_blockCount++;
+}
+
+void ParticlePool::Release(int block)
+{
+   m_free.push_back(block);
+}
+
+void ParticlePool::Copy(int from, int to)
+{
+   x[to] = x[from];
+   y[to] = y[from];
+   xi[to] = xi[from];
+   yi[to] = yi[from];
+   life[to] = life[from];
+   fade[to] = fade[from];
+   r[to] = r[from];
+   g[to] = g[from];
+   b[to] = b[from];
+}
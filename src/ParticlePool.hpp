@@ -0,0 +1,42 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#pragma once
+
+#include "Platform.hpp"
+
+#include <vector>
+
+//
+// Storage for the particles of every emitter in one game. Emitters take
+// blocks of particles as they need them and give them back when their
+// particles die out, so memory follows how many are alive rather than
+// how many each emitter could ever have. Each property is a separate
+// array indexed by particle so several can be updated at once.
+//
+class ParticlePool {
+public:
+   static const int BLOCK_SIZE = 64;
+
+   ParticlePool() = default;
+   ParticlePool(const ParticlePool&) = delete;
+
+   int Allocate();
+   void Release(int block);
+
+   // Index of the first particle in a block
+   static int First(int block) { return block * BLOCK_SIZE; }
+
+   void Copy(int from, int to);
+
+   int GetBlockCount() const { return m_blockCount; }
+   int GetBlocksInUse() const { return m_blockCount - m_free.size(); }
+
+   vector<float> x, y, xi, yi, life, fade, r, g, b;
+
+private:
+   int m_blockCount = 0;
+   vector<int> m_free;
+};
@@ -0,0 +1,138 @@
+//
+// Copyright (C) 2006-2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "Platform.hpp"
+
+#include <iostream>
+#include <filesystem>
+#include <cstdarg>
+#include <cstdio>
+
+//
+// Find a filename in the installation tree.
+//
+string LocateResource(const string& file)
+{
+#ifdef MACOSX
+   using namespace CF;
+
+   static char path[PATH_MAX];
+
+   CFURLRef resURL;
+   CFBundleRef mainBundle;
+   CFStringRef cfBase, cfExt, cfPath;
+
+   const char* ext = "";
+   char* copy = strdup(file.c_str());
+   if (char* p = strrchr(copy, '.')) {
+      *p = '\0';
+      ext = ++p;
+   }
+
+   cfBase = CFStringCreateWithCString(NULL, copy, kCFStringEncodingASCII);
+   cfExt = CFStringCreateWithCString(NULL, ext, kCFStringEncodingASCII);
+
+   free(copy);
+
+   mainBundle = CFBundleGetMainBundle();
+
+   resURL = CFBundleCopyResourceURL(mainBundle, cfBase, cfExt, NULL);
+
+   if (resURL == NULL)
+      Die("Failed to locate %s", file);
+
+   cfPath = CFURLCopyPath(resURL);
+
+   CFStringGetCString(cfPath, path, PATH_MAX, kCFStringEncodingASCII);
+
+   return path;
+#endif
+
+#ifdef DATADIR
+   using filesystem::path;
+
+   static path datadir;
+
+   if (datadir.empty()) {
+      const char *meson_src = getenv("MESON_SOURCE_ROOT");
+      if (meson_src != NULL) {
+         cout << "Using data from source directory: " << meson_src << endl;
+         datadir = path(meson_src) / "data";
+      }
+      else {
+         cout << "Using data from installation directory: " << DATADIR << endl;
+         datadir = DATADIR;
+      }
+   }
+
+   return (datadir / file).string();
+#else
+   return file;
+#endif
+}
+
+string GetConfigDir()
+{
+#if defined UNIX
+   using filesystem::path;
+
+   path p;
+   const char *config = getenv("XDG_CONFIG_HOME");
+   if (config == NULL || *config == '\0') {
+      const char *home = getenv("HOME");
+      if (home == NULL)
+         Die("HOME not set");
+
+      p = home;
+      p /= ".config";
+   }
+   else
+      p = config;
+
+   p /= "lander";
+   create_directories(p);
+
+   return p.string() + "/";
+#elif defined WIN32
+   using filesystem::path;
+
+   path appdata(getenv("APPDATA"));
+   appdata /= "doof.me.uk";
+   appdata /= "Lander";
+   create_directories(appdata);
+   return appdata.string() + "\\";
+#elif defined EMSCRIPTEN
+   return "";
+#else
+#error "Need to port GetConfigDir to this platform"
+#endif
+}
+
+void Die(const char *fmt, ...)
+{
+   va_list ap;
+   va_start(ap, fmt);
+
+#ifdef WIN32
+   int len = _vscprintf(fmt, ap);
+   char *buf = new char[len + 1];
+   vsprintf_s(buf, len + 1, fmt, ap);
+
+   fputs(buf, stderr);
+   fputs("\r\n", stderr);
+   fflush(stderr);
+
+   MessageBox(NULL, buf, "Runtime Error", MB_OK | MB_ICONSTOP);
+
+   delete[] buf;
+#else
+   vfprintf(stderr, fmt, ap);
+   fprintf(stderr, "\n");
+   fflush(stderr);
+#endif
+
+   va_end(ap);
+   exit(EXIT_FAILURE);
+}
@@ -0,0 +1,116 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "Platform.hpp"
+#include "ThreadPool.hpp"
+
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+
+#include <SDL_main.h>
+
+using namespace chrono;
+
+static double Seconds(steady_clock::time_point start)
+{
+   return duration<double>(steady_clock::now() - start).count();
+}
+
+//
+// Forks a task for each branch of the recursion like a divide and
+// conquer algorithm would.
+//
+static long Fib(int n)
+{
+   if (n < 2)
+      return n;
+
+   long a = 0, b = 0;
+   TaskGroup group(ThreadPool::GetInstance());
+   group.Run([&a, n] { a = Fib(n - 1); });
+   b = Fib(n - 2);
+   group.Wait();
+
+   return a + b;
+}
+
+//
+// Measures how long the shared pool takes to schedule tasks that do no
+// work and checks they all ran.
+//   lander-pool-bench [TASKS] [THREADS]
+//
+int main(int argc, char **argv)
+{
+   const int tasks = argc > 1 ? max(atoi(argv[1]), 1) : 100000;
+   ThreadPool::Initialise(argc > 2 ? atoi(argv[2]) : 0);
+
+   ThreadPool& pool = ThreadPool::GetInstance();
+   cout << "Pool has " << pool.GetThreadCount() << " workers" << endl;
+
+   bool ok = true;
+
+   {
+      // Round trip from a thread outside the pool
+      const int count = min(tasks, 10000);
+      const steady_clock::time_point start = steady_clock::now();
+      for (int i = 0; i < count; i++)
+         pool.Submit([] {}).get();
+      cout << "Submit and wait: " << Seconds(start) / count * 1e6
+           << "us per task" << endl;
+   }
+
+   {
+      atomic<int> ran(0);
+      const steady_clock::time_point start = steady_clock::now();
+      TaskGroup group(pool);
+      for (int i = 0; i < tasks; i++)
+         group.Run([&ran] { ran++; });
+      group.Wait();
+      cout << "Task group: " << Seconds(start) / tasks * 1e9
+           << "ns per task" << endl;
+      ok = ok && ran == tasks;
+   }
+
+   {
+      atomic<long> sum(0);
+      const steady_clock::time_point start = steady_clock::now();
+      pool.ParallelFor(0, tasks, 1, [&sum](int i) { sum += i; });
+      cout << "Parallel for: " << Seconds(start) / tasks * 1e9
+           << "ns per iteration" << endl;
+      ok = ok && sum == (long)tasks * (tasks - 1) / 2;
+   }
+
+   {
+      // Every level of the recursion waits from inside a task
+      const steady_clock::time_point start = steady_clock::now();
+      const long result = Fib(20);
+      cout << "Fork join Fib(20): " << Seconds(start) * 1e3 << "ms" << endl;
+      ok = ok && result == 6765;
+   }
+
+   {
+      atomic<bool> after(false);
+      atomic<int> ran(0);
+      promise<void> done;
+      {
+         TaskGroup group(pool);
+         for (int i = 0; i < 100; i++)
+            group.Run([&ran] { ran++; });
+         group.Then([&] {
+            after = ran == 100;
+            done.set_value();
+         });
+      }
+      done.get_future().wait();
+      ok = ok && after;
+   }
+
+   if (!ok)
+      cout << "Some tasks did not run correctly" << endl;
+
+   return ok ? 0 : 1;
+}
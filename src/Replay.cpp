@@ -0,0 +1,134 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "Replay.hpp"
+
+#include <cstring>
+#include <cassert>
+
+constexpr char ReplayFile::MAGIC[9];
+
+ReplayFile::~ReplayFile()
+{
+   Close();
+}
+
+void ReplayFile::OpenForWrite(const string& fileName, ReplayHeader header)
+{
+   assert(!IsWriting() && !IsReading());
+
+   m_out.open(fileName, ios::binary);
+   if (!m_out)
+      Die("Cannot create replay file %s", fileName.c_str());
+
+   memcpy(header.magic, MAGIC, sizeof(header.magic));
+   header.version = FORMAT_VERSION;
+
+   m_out.write((const char*)&header, sizeof(header));
+   m_header = header;
+   m_repeat = 0;
+}
+
+const ReplayHeader& ReplayFile::OpenForRead(const string& fileName)
+{
+   assert(!IsWriting() && !IsReading());
+
+   m_in.open(fileName, ios::binary);
+   if (!m_in)
+      Die("Cannot open replay file %s", fileName.c_str());
+
+   m_in.read((char*)&m_header, sizeof(m_header));
+   if (!m_in || memcmp(m_header.magic, MAGIC, sizeof(m_header.magic)) != 0)
+      Die("%s is not a replay file", fileName.c_str());
+   else if (m_header.version != FORMAT_VERSION)
+      Die("Replay file %s has version %u but expected %u",
+          fileName.c_str(), m_header.version, FORMAT_VERSION);
+
+   m_repeat = 0;
+   return m_header;
+}
+
+void ReplayFile::Close()
+{
+   if (IsWriting()) {
+      FlushRun();
+      m_out.close();
+   }
+
+   if (IsReading())
+      m_in.close();
+}
+
+void ReplayFile::FlushRun()
+{
+   if (m_repeat > 0) {
+      m_out.write((const char*)&m_actions, sizeof(m_actions));
+      m_out.write((const char*)&m_repeat, sizeof(m_repeat));
+      m_repeat = 0;
+   }
+}
+
+//
+// Records the input for one simulation step. Text is only passed when
+// it changed during the step.
+//
+void ReplayFile::WriteTick(uint16_t actions, const string *text)
+{
+   assert(IsWriting());
+
+   if (text != nullptr) {
+      FlushRun();
+
+      const uint16_t flagged = actions | TEXT_CHANGED;
+      const uint16_t repeat = 1;
+      const uint16_t length = min<size_t>(text->size(), UINT16_MAX);
+      m_out.write((const char*)&flagged, sizeof(flagged));
+      m_out.write((const char*)&repeat, sizeof(repeat));
+      m_out.write((const char*)&length, sizeof(length));
+      m_out.write(text->data(), length);
+   }
+   else if (m_repeat > 0 && actions == m_actions && m_repeat < UINT16_MAX)
+      m_repeat++;
+   else {
+      FlushRun();
+      m_actions = actions;
+      m_repeat = 1;
+   }
+}
+
+//
+// Reads the input for the next simulation step. The text buffer is only
+// changed if it was changed at this step when recording. Returns false
+// at the end of the recording.
+//
+bool ReplayFile::ReadTick(uint16_t& actions, string& text)
+{
+   assert(IsReading());
+
+   if (m_repeat > 0) {
+      m_repeat--;
+      actions = m_actions;
+      return true;
+   }
+
+   uint16_t flagged, repeat;
+   m_in.read((char*)&flagged, sizeof(flagged));
+   m_in.read((char*)&repeat, sizeof(repeat));
+   if (!m_in || repeat == 0)
+      return false;
+
+   if (flagged & TEXT_CHANGED) {
+      uint16_t length;
+      m_in.read((char*)&length, sizeof(length));
+      text.resize(length);
+      m_in.read(&text[0], length);
+      if (!m_in)
+         return false;
+   }
+
+   m_actions = actions = flagged & ~TEXT_CHANGED;
+   m_repeat = repeat - 1;
+   return true;
+}
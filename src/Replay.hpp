@@ -0,0 +1,61 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#pragma once
+
+#include "Platform.hpp"
+
+#include <fstream>
+#include <cstdint>
+
+//
+// Everything other than the input that must match for a recorded
+// session to play back the same way.
+//
+struct ReplayHeader {
+   char magic[8];
+   uint32_t version;
+   uint32_t seed;
+   uint32_t simRate;
+   uint32_t width, height;
+};
+
+//
+// A file holding the input for each simulation step of a session. Steps
+// are stored as runs of identical action masks. Any text typed during a
+// step is stored after its mask.
+//
+class ReplayFile {
+public:
+   ReplayFile() = default;
+   ~ReplayFile();
+
+   void OpenForWrite(const string& fileName, ReplayHeader header);
+   const ReplayHeader& OpenForRead(const string& fileName);
+   void Close();
+
+   void WriteTick(uint16_t actions, const string *text);
+   bool ReadTick(uint16_t& actions, string& text);
+
+   bool IsWriting() const { return m_out.is_open(); }
+   bool IsReading() const { return m_in.is_open(); }
+
+   static constexpr char MAGIC[9] = "LNDRRPL1";
+   static const uint32_t FORMAT_VERSION = 2;
+
+   // Set in the action mask when the step also changed the text buffer
+   static const uint16_t TEXT_CHANGED = 0x8000;
+
+private:
+   ReplayFile(const ReplayFile&) = delete;
+
+   void FlushRun();
+
+   ofstream m_out;
+   ifstream m_in;
+   ReplayHeader m_header;
+   uint16_t m_actions = 0;
+   uint16_t m_repeat = 0;
+};
@@ -4,6 +4,7 @@
 //
 
 #include "Ship.hpp"
+#include "SimContext.hpp"
 #include "OpenGL.hpp"
 
 #include <string>
@@ -19,19 +20,22 @@ const Point Ship::hotspots[] = {
 
 Ship::Ship(Viewport* v)
    : shipImage("images/ship.png"),
-     xpos(0), ypos(0), speedX(0), speedY(0), angle(0), viewport(v),
+     xpos(0), ypos(0), speedX(0), speedY(0), angle(0),
+     lastX(0), lastY(0), lastAngle(0), viewport(v),
      thrusting(false),
-     boingSound(LocateResource("sounds/boing1.wav"))
+     boingSound("sounds/boing1.wav")
 {
 
 }
 
 void Ship::Display() const
 {
-   int dx = (int)xpos - viewport->GetXAdjust();
-   int dy = (int)ypos - viewport->GetYAdjust();
+   OpenGL& opengl = OpenGL::GetInstance();
+
+   int dx = opengl.Interpolate((int)lastX, (int)xpos) - viewport->GetXAdjust();
+   int dy = opengl.Interpolate((int)lastY, (int)ypos) - viewport->GetYAdjust();
 
-   shipImage.Draw(dx, dy, angle);
+   shipImage.Draw(dx, dy, opengl.Interpolate(lastAngle, angle));
 }
 
 void Ship::DrawExhaust()
@@ -50,7 +54,7 @@ void Ship::Move()
 {
    RotatePoints(hotspots, points, NUM_HOTSPOTS, angle*M_PI/180, -16, 16);
 
-   const OpenGL::TimeScale timeScale = OpenGL::GetInstance().GetTimeScale();
+   const SimContext::TimeScale timeScale = SimContext::Current().GetTimeScale();
 
    xpos += speedX * timeScale;
    ypos += speedY * timeScale;
@@ -108,18 +112,20 @@ void Ship::ThrustOff()
 
 void Ship::Thrust(double speed)
 {
-   speedX += speed * sin(angle*(M_PI/180));
-   speedY -= speed * cos(angle*(M_PI/180));
+   const SimContext::TimeScale timeScale = SimContext::Current().GetTimeScale();
+
+   speedX += speed * timeScale * sin(angle*(M_PI/180));
+   speedY -= speed * timeScale * cos(angle*(M_PI/180));
 }
 
 void Ship::Turn(double delta)
 {
-   angle += delta * OpenGL::GetInstance().GetTimeScale();
+   angle += delta * SimContext::Current().GetTimeScale();
 }
 
 void Ship::ApplyGravity(double gravity)
 {
-   speedY += gravity;
+   speedY += gravity * SimContext::Current().GetTimeScale();
 }
 
 void Ship::Bounce()
@@ -134,9 +140,19 @@ void Ship::CentreInViewport()
 {
    int centrex = (int)xpos + (shipImage.GetWidth()/2);
    int centrey = (int)ypos + (shipImage.GetHeight()/2);
-   OpenGL& opengl = OpenGL::GetInstance();
-   viewport->SetXAdjust(centrex - (opengl.GetWidth()/2));
-   viewport->SetYAdjust(centrey - (opengl.GetHeight()/2));
+   viewport->SetXAdjust(centrex - (viewport->GetScreenWidth()/2));
+   viewport->SetYAdjust(centrey - (viewport->GetScreenHeight()/2));
+}
+
+//
+// Remember the current position so the ship can be drawn between it and
+// the position after the next simulation step.
+//
+void Ship::SavePosition()
+{
+   lastX = xpos;
+   lastY = ypos;
+   lastAngle = angle;
 }
 
 //
@@ -153,6 +169,8 @@ void Ship::Reset()
    angle = 0.0f;
    speedX = 0.0f;
    speedY = 0.0f;
+
+   SavePosition();
 }
 
 void Ship::RotatePoints(const Point* pPoints, Point* pDest, int nCount,
@@ -170,16 +188,42 @@ void Ship::RotatePoints(const Point* pPoints, Point* pDest, int nCount,
 }
 
 //
-// Check for collision between the ship and a polygon.
+// The hot spots and how far each will move during the next step. The
+// movement is worked out from the moved position exactly as the single
+// point test used to so the results do not change.
 //
-bool Ship::HotSpotCollision(LineSegment& l, double dx, double dy) const
+SweptPoints Ship::GetSweptHotSpots() const
 {
+   static_assert(NUM_HOTSPOTS <= SweptPoints::MAX_POINTS,
+                 "too many hot spots");
+
+   const SimContext::TimeScale timeScale = SimContext::Current().GetTimeScale();
+
+   SweptPoints pts;
    for (int i = 0; i < NUM_HOTSPOTS; i++) {
-      if (CheckCollision(l, dx + points[i].x, dy + points[i].y))
-         return true;
+      const double x = xpos + (double)points[i].x;
+      const double y = ypos + (double)points[i].y;
+      const double cX = x + speedX * timeScale;
+      const double cY = y + speedY * timeScale;
+      pts.Set(i, x, y, cX - x, cY - y);
    }
+   return pts;
+}
 
-   return false;
+//
+// Check for collision between the ship and a line segment.
+//
+bool Ship::HotSpotCollision(const LineSegment& l) const
+{
+   return FirstSegmentHit(GetSweptHotSpots(), &l, 1) != -1;
+}
+
+//
+// Returns the index of the first segment the ship collides with or -1.
+//
+int Ship::FirstHotSpotCollision(const LineSegment* segs, int count) const
+{
+   return FirstSegmentHit(GetSweptHotSpots(), segs, count);
 }
 
 //
@@ -187,55 +231,47 @@ bool Ship::HotSpotCollision(LineSegment& l, double dx, double dy) const
 //
 bool Ship::BoxCollision(int x, int y, int w, int h) const
 {
-   if (!viewport->PointInScreen(x, y, w, h))
+   if (!IsNear(x, y, w, h))
       return false;
 
-   LineSegment l1(x, y, x + w, y);
-   LineSegment l2(x + w, y, x + w, y + h);
-   LineSegment l3(x + w, y + h, x, y + h);
-   LineSegment l4(x, y + h, x, y);
+   const LineSegment sides[] = {
+      LineSegment(x, y, x + w, y),
+      LineSegment(x + w, y, x + w, y + h),
+      LineSegment(x + w, y + h, x, y + h),
+      LineSegment(x, y + h, x, y)
+   };
 
-   return HotSpotCollision(l1) || HotSpotCollision(l2)
-      || HotSpotCollision(l3) || HotSpotCollision(l4);
+   return FirstHotSpotCollision(sides, 4) != -1;
 }
 
 //
-// Checks for collision between the ship and a line segment.
+// Returns true if any part of the ship could touch the box during the
+// next move. This is used to skip the detailed collision tests.
 //
-bool Ship::CheckCollision(LineSegment& l, double dx, double dy) const
+bool Ship::IsNear(int x, int y, int w, int h) const
 {
-   double xpos = this->xpos + dx;
-   double ypos = this->ypos + dy;
-
-   if (!viewport->PointInScreen
-       ((int)xpos, (int)ypos, shipImage.GetWidth(), shipImage.GetHeight()))
-      return false;
-
-   const OpenGL::TimeScale timeScale = OpenGL::GetInstance().GetTimeScale();
-
-   // Get position after next move
-   double cX = xpos + speedX * timeScale;
-   double cY = ypos + speedY * timeScale;
-
-   // Get displacement
-   double vecX = cX - xpos;
-   double vecY = cY - ypos;
-
-   // Get line position
-   double wallX = (double)(l.p2.x - l.p1.x);
-   double wallY = (double)(l.p2.y - l.p1.y);
+   const Rect r = GetSweptBounds();
+   return r.x + r.w > x && r.x < x + w && r.y + r.h > y && r.y < y + h;
+}
 
-   // Work out numerator and denominator (used parametric equations)
-   double numT = wallX * (ypos - l.p1.y) - wallY * (xpos - l.p1.x);
-   double numU = vecX * (ypos - l.p1.y) - vecY * (xpos - l.p1.x);
+//
+// The area any part of the ship could touch during the next move.
+//
+Rect Ship::GetSweptBounds() const
+{
+   const SimContext::TimeScale timeScale = SimContext::Current().GetTimeScale();
 
-   // Work out denominator
-   double denom = wallY * (cX - xpos) - wallX * (cY - ypos);
+   // The hot spots can stick out of the image when it is rotated
+   const double reach = max(shipImage.GetWidth(), shipImage.GetHeight());
+   const double reachX = reach + fabs(speedX * timeScale);
+   const double reachY = reach + fabs(speedY * timeScale);
 
-   // Work out u and t
-   double u = numU / denom;
-   double t = numT / denom;
+   const double centreX = xpos + shipImage.GetWidth()/2;
+   const double centreY = ypos + shipImage.GetHeight()/2;
 
-   // Collision occured if (0 < t < 1) and (0 < u < 1)
-   return (t > 0.0) && (t < 1.0) && (u > 0.0) && (u < 1.0);
+   const int left = (int)floor(centreX - reachX);
+   const int top = (int)floor(centreY - reachY);
+   return { left, top,
+            (int)ceil(centreX + reachX) - left,
+            (int)ceil(centreY + reachY) - top };
 }
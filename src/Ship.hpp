@@ -8,6 +8,7 @@
 
 #include "Platform.hpp"
 #include "Geometry.hpp"
+#include "Collision.hpp"
 #include "Viewport.hpp"
 #include "Emitter.hpp"
 #include "Image.hpp"
@@ -31,15 +32,21 @@ public:
    void Bounce();
    void ApplyGravity(double gravity);
    void CentreInViewport();
+   void SavePosition();
 
-   bool CheckCollision(LineSegment& l, double dx=0, double dy=0) const;
-   bool HotSpotCollision(LineSegment& l, double dx=0, double dy=0) const;
+   SweptPoints GetSweptHotSpots() const;
+   bool HotSpotCollision(const LineSegment& l) const;
+   int FirstHotSpotCollision(const LineSegment* segs, int count) const;
    bool BoxCollision(int x, int y, int w, int h) const;
+   bool IsNear(int x, int y, int w, int h) const;
+   Rect GetSweptBounds() const;
 
    double GetX() const { return xpos; }
    double GetY() const { return ypos; }
    double GetXSpeed() const { return speedX; }
    double GetYSpeed() const { return speedY; }
+   int GetWidth() const { return shipImage.GetWidth(); }
+   int GetHeight() const { return shipImage.GetHeight(); }
    double GetAngle() const { return angle; }
 
    static const int SHIP_START_Y = 100;
@@ -52,6 +59,7 @@ private:
 
    double xpos, ypos;
    double speedX, speedY, angle;
+   double lastX, lastY, lastAngle;
 
    Viewport* viewport;
    Explosion explosion;
@@ -0,0 +1,32 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "SimContext.hpp"
+
+namespace {
+   thread_local SimContext* current = nullptr;
+}
+
+SimContext& SimContext::Default()
+{
+   static SimContext context;
+   return context;
+}
+
+SimContext& SimContext::Current()
+{
+   return current != nullptr ? *current : Default();
+}
+
+SimContext::Scope::Scope(SimContext& context)
+   : m_saved(current)
+{
+   current = &context;
+}
+
+SimContext::Scope::~Scope()
+{
+   current = m_saved;
+}
@@ -0,0 +1,82 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#pragma once
+
+#include "Platform.hpp"
+#include "ParticlePool.hpp"
+
+#include <cstdint>
+
+//
+// Small xorshift generator. Unlike rand() each game owns its own
+// sequence so several games can run on different threads and still
+// repeat exactly from the same seed.
+//
+class Random {
+public:
+   explicit Random(uint32_t seed=1) { Seed(seed); }
+
+   void Seed(uint32_t seed) { m_state = seed != 0 ? seed : 0x9e3779b9; }
+
+   // Returns a value in the range [0, MAX]
+   int Next()
+   {
+      m_state ^= m_state << 13;
+      m_state ^= m_state >> 17;
+      m_state ^= m_state << 5;
+      return m_state & MAX;
+   }
+
+   static const int MAX = 0x7fffffff;
+
+private:
+   uint32_t m_state;
+};
+
+//
+// Per-game state that used to be global: the random number generator,
+// the length of a simulation step and the particle storage. Game objects
+// use whichever context is current on the calling thread.
+//
+class SimContext {
+public:
+   SimContext() = default;
+   SimContext(const SimContext&) = delete;
+
+   static SimContext& Current();
+   static SimContext& Default();
+
+   int Rand() { return m_random.Next(); }
+   void Seed(uint32_t seed) { m_random.Seed(seed); }
+
+   typedef float TimeScale;
+   TimeScale GetTimeScale() const { return m_timeScale; }
+   void SetTimeScale(TimeScale scale) { m_timeScale = scale; }
+
+   void Tick() { m_tick++; }
+   unsigned GetTick() const { return m_tick; }
+
+   ParticlePool& GetParticles() { return m_particles; }
+
+   //
+   // Makes a context current on this thread until the end of the block.
+   //
+   class Scope {
+   public:
+      explicit Scope(SimContext& context);
+      ~Scope();
+   private:
+      Scope(const Scope&) = delete;
+
+      SimContext* m_saved;
+   };
+
+private:
+   Random m_random;
+   TimeScale m_timeScale = 1.0f;
+   unsigned m_tick = 0;
+   ParticlePool m_particles;
+};
@@ -0,0 +1,63 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "SimRunner.hpp"
+#include "OpenGL.hpp"
+#include "ThreadPool.hpp"
+
+#include <atomic>
+
+//
+// Creates count games each seeded from seed plus its index. Nothing may
+// be drawn from the worker threads so this is only possible headless.
+//
+SimRunner::SimRunner(int count, uint32_t seed, int level)
+   : m_level(level)
+{
+   OpenGL& opengl = OpenGL::GetInstance();
+   if (!opengl.IsHeadless())
+      Die("Games can only be run in parallel in headless mode");
+
+   // Loading images and sounds is not worth doing in parallel
+   for (int i = 0; i < count; i++) {
+      unique_ptr<GameSim> sim(new GameSim(false));
+      sim->GetContext().SetTimeScale(opengl.GetTimeScale());
+      sim->SetScreenSize(opengl.GetWidth(), opengl.GetHeight());
+      sim->NewGame(level, seed + i);
+      m_sims.push_back(move(sim));
+   }
+}
+
+//
+// Advances every game by the given number of steps. Each game is a
+// separate task as each runs long enough to be worth scheduling.
+//
+void SimRunner::Run(int steps, const Policy& policy)
+{
+   atomic<int> finished(0);
+
+   ThreadPool::GetInstance().ParallelFor(
+      0, m_sims.size(), 1,
+      [&](int n) { finished += RunGame(n, steps, policy); });
+
+   m_finished += finished;
+}
+
+int SimRunner::RunGame(int n, int steps, const Policy& policy)
+{
+   GameSim& sim = *m_sims[n];
+
+   int finished = 0;
+   for (int i = 0; i < steps; i++) {
+      sim.Process(policy(sim));
+
+      if (sim.IsFinished()) {
+         sim.NewGame(m_level, sim.GetContext().Rand());
+         finished++;
+      }
+   }
+
+   return finished;
+}
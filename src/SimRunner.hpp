@@ -0,0 +1,42 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#pragma once
+
+#include "Platform.hpp"
+#include "Game.hpp"
+
+#include <vector>
+#include <memory>
+#include <functional>
+
+//
+// Steps many independent games at once for bulk testing of levels and
+// training bots. Each game only ever runs on one thread at a time so
+// the games are simply shared out over the thread pool. Games that end
+// are restarted at the same level with a new seed.
+//
+class SimRunner {
+public:
+   // Chooses the Input::Action bits for the next step of a game
+   typedef function<unsigned (const GameSim&)> Policy;
+
+   SimRunner(int count, uint32_t seed, int level);
+   SimRunner(const SimRunner&) = delete;
+
+   void Run(int steps, const Policy& policy);
+
+   int GetCount() const { return m_sims.size(); }
+   GameSim& GetSim(int n) { return *m_sims[n]; }
+
+   int GetGamesFinished() const { return m_finished; }
+
+private:
+   int RunGame(int n, int steps, const Policy& policy);
+
+   vector<unique_ptr<GameSim>> m_sims;
+   int m_level;
+   int m_finished = 0;
+};
@@ -5,23 +5,29 @@
 
 #include "SoundEffect.hpp"
 #include "ConfigFile.hpp"
+#include "AssetPack.hpp"
+#include "AssetLoader.hpp"
 
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
 
-int SoundEffect::loadCount(0);
+atomic<int> SoundEffect::loadCount(0);
 int SoundEffect::audioRate(44100);
 int SoundEffect::audioChannels(2);
 int SoundEffect::audioBuffers(1024);
 Uint16 SoundEffect::audioFormat(AUDIO_S16);
 bool SoundEffect::enabled(true);
+bool SoundEffect::audioOpen(false);
 
 SoundEffect::SoundEffect(const string& filename, Uint8 volume)
    : sound(NULL),
      channel(-1)
 {
-   if (++loadCount == 1) {
+   ++loadCount;
+
+   // The audio device is not opened at all while sound is disabled
+   if (enabled && !audioOpen) {
 
       if (Mix_OpenAudio(audioRate, audioFormat, audioChannels, audioBuffers)) {
          cerr << "Failed to open audio: " << Mix_GetError() << endl;
@@ -31,6 +37,8 @@ SoundEffect::SoundEffect(const string& filename, Uint8 volume)
          return;
       }
 
+      audioOpen = true;
+
       // Get the actual settings used
       Mix_QuerySpec(&audioRate, &audioFormat, &audioChannels);
 
@@ -39,7 +47,31 @@ SoundEffect::SoundEffect(const string& filename, Uint8 volume)
 
    if (!enabled) return;
 
-   if (!(sound = Mix_LoadWAV(filename.c_str())))
+   // Pre-decoded samples can be played straight from the asset pack
+   // if they match the format the mixer is using
+   const AssetPack& pack = AssetPack::GetInstance();
+   const PackEntry *entry = pack.Find(filename, PACK_SOUND);
+   if (entry != nullptr
+       && (int)entry->params[0] == audioRate
+       && entry->params[1] == audioFormat
+       && (int)entry->params[2] == audioChannels) {
+      Uint8 *data = (Uint8*)pack.GetData(entry);
+      sound = Mix_QuickLoad_RAW(data, entry->size);
+   }
+   else if ((m_samples = AssetLoader::GetInstance().TakeSound(filename))
+            && m_samples->rate == audioRate
+            && m_samples->format == audioFormat
+            && m_samples->channels == audioChannels) {
+      // Decoded ahead of time on a worker thread
+      Uint8 *data = const_cast<Uint8*>(m_samples->samples.data());
+      sound = Mix_QuickLoad_RAW(data, m_samples->samples.size());
+   }
+   else {
+      const string path = LocateResource(filename);
+      sound = Mix_LoadWAV(path.c_str());
+   }
+
+   if (sound == NULL)
       Die("Error loading %s: %s", filename.c_str(), Mix_GetError());
 
    sound->volume = volume;
@@ -53,8 +85,10 @@ SoundEffect::~SoundEffect()
    if (enabled)
       Mix_FreeChunk(sound);
 
-   if (--loadCount == 0)
+   if (--loadCount == 0 && audioOpen) {
       Mix_CloseAudio();
+      audioOpen = false;
+   }
 }
 
 void SoundEffect::Play()
@@ -7,6 +7,10 @@
 #define INC_SOUNDEFFECT_HPP
 
 #include "Platform.hpp"
+#include "AssetDecode.hpp"
+
+#include <memory>
+#include <atomic>
 
 #ifndef EMSCRIPTEN
 #include <SDL_mixer.h>
@@ -27,11 +31,15 @@ private:
    Mix_Chunk* sound;
    int channel;
 
-   static int loadCount;
+   // Owns the samples of a chunk decoded by AssetLoader
+   shared_ptr<const SoundData> m_samples;
+
+   static atomic<int> loadCount;
    static int audioChannels, audioBuffers, audioRate;
    static Uint16 audioFormat;
 
    static bool enabled;
+   static bool audioOpen;
 };
 
 #endif
@@ -4,6 +4,7 @@
 //
 
 #include "Surface.hpp"
+#include "SimContext.hpp"
 #include "Ship.hpp"
 
 #include <string>
@@ -14,8 +15,7 @@ const int Surface::MIN_SURFACE_HEIGHT(10);
 const int Surface::SURFACE_SIZE(20);
 
 Surface::Surface(Viewport* v)
-   : viewport(v),
-     surface(NULL)
+   : viewport(v)
 {
    surfTexture[0] = Texture::Load("images/dirt_surface.png");
    surfTexture[1] = Texture::Load("images/snow_surface.png");
@@ -23,21 +23,16 @@ Surface::Surface(Viewport* v)
    surfTexture[3] = Texture::Load("images/rock_surface.png");
 }
 
-Surface::~Surface()
-{
-   if (surface)
-      delete[] surface;
-}
-
-void Surface::Generate(int surftex, LandingPadList& pads)
+//
+// Generates the shape of the surface with flat sections under the landing
+// pads and sets the height of each pad. This does not use the GL so can
+// be called on any thread.
+//
+void Surface::Generate(int levelWidth, vector<PadDesc>& pads,
+                       SectionList& surface)
 {
-   if (surface)
-      delete[] surface;
-
-   int nPolys = viewport->GetLevelWidth()/SURFACE_SIZE;
-   surface = new SurfaceSection[nPolys];
-
-   texidx = surftex;
+   int nPolys = levelWidth/SURFACE_SIZE;
+   surface.resize(nPolys);
 
    int texloop = 0;
    for (int i = 0; i < nPolys; i++) {
@@ -50,11 +45,11 @@ void Surface::Generate(int surftex, LandingPadList& pads)
       surface[i].points[0].y = MAX_SURFACE_HEIGHT;
 
       // See if we want to place a landing pad here
-      LandingPad* padHere = NULL;
-      for (LandingPadListIt it = pads.begin(); it != pads.end(); ++it) {
-         for (int k = 0; k < (*it).GetLength(); k++) {
-            if ((*it).GetIndex() + k == i) {
-               padHere = &(*it);
+      PadDesc* padHere = NULL;
+      for (PadDesc& pad : pads) {
+         for (int k = 0; k < pad.length; k++) {
+            if (pad.index + k == i) {
+               padHere = &pad;
                goto out;
             }
          }
@@ -67,12 +62,12 @@ void Surface::Generate(int surftex, LandingPadList& pads)
          if (i != 0)
             change = surface[i-1].points[2].y;
          else
-            change = rand()%MAX_SURFACE_HEIGHT;
+            change = SimContext::Current().Rand()%MAX_SURFACE_HEIGHT;
          surface[i].points[1].x = 0;
          surface[i].points[1].y = change;
 
          do
-            change = surface[i].points[1].y + (rand()%VARIANCE-(VARIANCE/2));
+            change = surface[i].points[1].y + (SimContext::Current().Rand()%VARIANCE-(VARIANCE/2));
          while (change > MAX_SURFACE_HEIGHT || change < MIN_SURFACE_HEIGHT);
          surface[i].points[2].x = SURFACE_SIZE;
          surface[i].points[2].y = change;
@@ -83,7 +78,7 @@ void Surface::Generate(int surftex, LandingPadList& pads)
             change = surface[i-1].points[2].y;
          else {
             do
-               change = rand()%MAX_SURFACE_HEIGHT;
+               change = SimContext::Current().Rand()%MAX_SURFACE_HEIGHT;
             while (change > MAX_SURFACE_HEIGHT || change < MIN_SURFACE_HEIGHT);
          }
          surface[i].points[1].x = 0;
@@ -91,13 +86,37 @@ void Surface::Generate(int surftex, LandingPadList& pads)
          surface[i].points[2].x = SURFACE_SIZE;
          surface[i].points[2].y = change;
 
-         padHere->SetYPos(change);
+         padHere->ypos = change;
       }
 
       surface[i].points[3].x = SURFACE_SIZE;
       surface[i].points[3].y = MAX_SURFACE_HEIGHT;
    }
+}
+
+//
+// Replaces the surface with one made by Generate.
+//
+void Surface::Load(int surftex, SectionList&& sections,
+                   const vector<PadDesc>& pads)
+{
+   surface = move(sections);
+   texidx = surftex;
+
+   // Sections join up so one height per edge is enough for collisions
+   m_heights.resize(surface.size() + 1);
+   for (size_t i = 0; i < surface.size(); i++)
+      m_heights[i] = surface[i].points[1].y;
+   if (!surface.empty())
+      m_heights.back() = surface.back().points[2].y;
+
+   m_padAt.assign(surface.size(), -1);
+   for (size_t j = 0; j < pads.size(); j++) {
+      for (int k = 0; k < pads[j].length; k++)
+         m_padAt[pads[j].index + k] = j;
+   }
 
+   const int nPolys = surface.size();
    VertexI *vertexBuf = new VertexI[4 * nPolys];
 
    for (int i = 0; i < nPolys; i++) {
@@ -147,45 +166,43 @@ void Surface::Display() const
 // Returns true if ship has collided with surface. Sets padIndex to the index
 // of pad if the player hit it, -1 otherwise.
 //
-bool Surface::CheckCollisions(Ship& ship, LandingPadList& pads, int* padIndex)
+bool Surface::CheckCollisions(const Ship& ship, int* padIndex) const
 {
-   LineSegment l;
    int lookmin = (int)(ship.GetX()/SURFACE_SIZE) - 2;
    int lookmax = (int)(ship.GetX()/SURFACE_SIZE) + 2;
    if (lookmin < 0)	lookmin = 0;
    if (lookmax >= viewport->GetLevelWidth()/SURFACE_SIZE)
       lookmax = viewport->GetLevelWidth()/SURFACE_SIZE - 1;
 
-   if (ship.GetY() < viewport->GetLevelHeight() - MAX_SURFACE_HEIGHT)
+   const int base = viewport->GetLevelHeight() - MAX_SURFACE_HEIGHT;
+
+   if (ship.GetY() < base)
       return false;
 
    *padIndex = -1;
 
-   for (int i = lookmin; i <= lookmax; i++) {
-      l.p1.x = i*SURFACE_SIZE;
-      l.p1.y = viewport->GetLevelHeight() - MAX_SURFACE_HEIGHT + surface[i].points[1].y;
-      l.p2.x = (i+1)*SURFACE_SIZE;
-      l.p2.y = viewport->GetLevelHeight() - MAX_SURFACE_HEIGHT + surface[i].points[2].y;
-
-      // Look through each hot spot and check for collisions
-      if (ship.HotSpotCollision(l)) {
-         // See if this is a landing pad
-         int j = 0;
-         for (LandingPadListIt it = pads.begin();
-              it != pads.end();
-              ++it, ++j) {
-            LandingPad& pad = *it;
-            for (int m = 0; m < pad.GetLength(); m++) {
-               if (pad.GetIndex() + m == i) {
-                  // Hit a landing pad
-                  *padIndex = j;
-                  goto out;
-               }
-            }
-         }
-      out:
-         return true;
-      }
+   // Nothing can be hit if the ship cannot get as low as the highest
+   // ground under it during this step
+   int highest = MAX_SURFACE_HEIGHT;
+   for (int i = lookmin; i <= lookmax + 1; i++)
+      highest = min(highest, m_heights[i]);
+
+   const Rect swept = ship.GetSweptBounds();
+   if (swept.y + swept.h < base + highest)
+      return false;
+
+   LineSegment segs[5];
+   int count = 0;
+   for (int i = lookmin; i <= lookmax; i++, count++) {
+      segs[count] = LineSegment(i*SURFACE_SIZE, base + m_heights[i],
+                                (i+1)*SURFACE_SIZE, base + m_heights[i+1]);
    }
-   return false;
+
+   // Look through each hot spot and check for collisions
+   const int hit = ship.FirstHotSpotCollision(segs, count);
+   if (hit == -1)
+      return false;
+
+   *padIndex = m_padAt[lookmin + hit];
+   return true;
 }
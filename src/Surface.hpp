@@ -11,10 +11,18 @@
 class Surface {
 public:
    Surface(Viewport* v);
-   ~Surface();
 
-   void Generate(int surftex, LandingPadList& pads);
-   bool CheckCollisions(Ship& ship, LandingPadList& pads, int* padIndex);
+   struct Section {
+      float texX, texwidth;
+      Point points[4];
+   };
+   typedef vector<Section> SectionList;
+
+   static void Generate(int levelWidth, vector<PadDesc>& pads,
+                        SectionList& sections);
+   void Load(int surftex, SectionList&& sections,
+             const vector<PadDesc>& pads);
+   bool CheckCollisions(const Ship& ship, int* padIndex) const;
    void Display() const;
 
    static const int NUM_SURF_TEX = 4;   // Number of available surface textures
@@ -30,9 +38,12 @@ private:
    Viewport* viewport;
    VertexBuffer m_vbo;
 
-   struct SurfaceSection {
-      float texX, texwidth;
-      Point points[4];
-   };
-   SurfaceSection* surface;
+   SectionList surface;
+
+   // Height of the ground at the left edge of each section and the right
+   // edge of the last one, measured down from the highest possible point
+   vector<int> m_heights;
+
+   // Index of the landing pad on each section or -1
+   vector<int> m_padAt;
 };
@@ -5,37 +5,125 @@
 
 #include "Texture.hpp"
 #include "OpenGL.hpp"
+#include "AssetPack.hpp"
+#include "AssetLoader.hpp"
 
 #include <map>
+#include <vector>
 #include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
 #include <iostream>
 #include <sstream>
 #include <cassert>
 
-#include <SDL_image.h>
-
 using namespace std;
 
+class AtlasPage;
+
 namespace {
    typedef map<string, TextureHolder*> TextureCache;
    TextureCache theCache;
+
+   // Guards the cache and the atlas as textures may be loaded on any
+   // thread
+   mutex theLock;
 }
 
+//
+// Textures loaded from files keep their texels in memory until first
+// used so that loading does not need the GL context. The GL texture is
+// then created on the thread that draws it.
+//
 class TextureHolder {
 public:
-   TextureHolder(const string& file);
+   TextureHolder(int width, int height, const GLubyte *rgba,
+                 shared_ptr<const ImageData> image);
    TextureHolder(int width, int height, const GLubyte *data,
                  GLuint fmt, GLuint filter);
+   TextureHolder(AtlasPage *page, int width, int height,
+                 float u0, float v0, float u1, float v1);
    TextureHolder(const TextureHolder&) = delete;
    ~TextureHolder();
 
-   GLuint GetGLTexture() const { return m_texture; }
+   GLuint GetGLTexture();
    int GetWidth() const { return m_width; }
    int GetHeight() const { return m_height; }
 
+   float MapU(float u) const { return m_u0 + u * (m_u1 - m_u0); }
+   float MapV(float v) const { return m_v0 + v * (m_v1 - m_v0); }
+
 private:
-   GLuint m_texture;
+   void Upload();
+
+   GLuint m_texture = 0;
    int m_width, m_height;
+   float m_u0 = 0.0f, m_v0 = 0.0f, m_u1 = 1.0f, m_v1 = 1.0f;
+   AtlasPage *m_page = nullptr;
+
+   // Texels waiting to be uploaded and the decoded image that owns
+   // them, if they are not in the asset pack
+   const GLubyte *m_pending = nullptr;
+   shared_ptr<const ImageData> m_image;
+};
+
+//
+// One texture of the atlas. Images added from any thread are queued
+// and copied into the texture the next time it is used.
+//
+class AtlasPage {
+public:
+   explicit AtlasPage(int size) : m_size(size) {}
+   AtlasPage(const AtlasPage&) = delete;
+   ~AtlasPage();
+
+   bool Allocate(int width, int height, int& x, int& y);
+   void Queue(int x, int y, int width, int height, vector<GLubyte>&& texels);
+   GLuint GetGLTexture();
+
+private:
+   struct Shelf {
+      int y, height, used;
+   };
+
+   struct PendingImage {
+      int x, y, width, height;
+      vector<GLubyte> texels;
+   };
+
+   void Flush();
+
+   const int m_size;
+   GLuint m_texture = 0;
+   int m_top = 0;
+   vector<Shelf> m_shelves;
+   vector<PendingImage> m_pending;
+   atomic<bool> m_dirty { false };
+};
+
+//
+// Packs small sprite images into a few large textures so that a frame
+// of sprites can be drawn with very few texture changes. Images are
+// placed on horizontal shelves as they are loaded and each is
+// surrounded by a copy of its edge pixels so linear filtering never
+// samples a neighbouring image.
+//
+class TextureAtlas {
+public:
+   TextureHolder *Add(int width, int height, const GLubyte *rgba);
+   void Clear();
+
+   static TextureAtlas& GetInstance();
+
+   // Larger images are given a texture of their own
+   static const int MAX_IMAGE_SIZE = 512;
+
+private:
+   static const int PADDING = 1;
+
+   vector<unique_ptr<AtlasPage>> m_pages;
+   int m_pageSize = 0;
 };
 
 static bool IsPowerOfTwo(int n)
@@ -50,41 +138,59 @@ static bool IsPowerOfTwo(int n)
    return pop == 1;
 }
 
-TextureHolder::TextureHolder(const string& file)
+TextureHolder::TextureHolder(int width, int height, const GLubyte *rgba,
+                             shared_ptr<const ImageData> image)
+   : m_width(width), m_height(height),
+     m_pending(rgba),
+     m_image(image)
 {
-   SDL_Surface* surface = IMG_Load(LocateResource(file).c_str());
-   if (NULL == surface)
-      Die("Failed to load image: %s", IMG_GetError());
+}
 
-   if (!IsPowerOfTwo(surface->w))
-      cerr << "Warning: " << file << " width not a power of 2" << endl;
-   if (!IsPowerOfTwo(surface->h))
-      cerr << "Warning: " << file << " height not a power of 2" << endl;
+TextureHolder::TextureHolder(int width, int height, const GLubyte *data,
+                             GLuint fmt, GLuint filter)
+   : m_width(width), m_height(height)
+{
+   if (OpenGL::GetInstance().IsHeadless())
+      return;
 
-   if (!OpenGL::GetInstance().IsTextureSizeSupported(surface->w, surface->h))
-      cerr << "Warning: " << file << " bigger than max OpenGL texture" << endl;
+   glGenTextures(1, &m_texture);
+   glBindTexture(GL_TEXTURE_2D, m_texture);
 
-   int ncols = surface->format->BytesPerPixel;
-   GLenum texture_format;
-   if (ncols == 4) {
-      // Contains an alpha channel
-      if (surface->format->Rmask == 0x000000ff)
-         texture_format = GL_RGBA;
-      else
-         texture_format = GL_BGRA;
-   }
-   else if (ncols == 3) {
-      if (surface->format->Rmask == 0x000000ff)
-         texture_format = GL_RGB;
-      else
-         texture_format = GL_BGR;
-   }
-   else
-      Die("Unsupported image colour format: %s", file.c_str());
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
+                fmt, GL_UNSIGNED_BYTE, data);
+}
+
+TextureHolder::TextureHolder(AtlasPage *page, int width, int height,
+                             float u0, float v0, float u1, float v1)
+   : m_width(width), m_height(height),
+     m_u0(u0), m_v0(v0), m_u1(u1), m_v1(v1),
+     m_page(page)
+{
+}
 
-   m_width = surface->w;
-   m_height = surface->h;
+TextureHolder::~TextureHolder()
+{
+   OpenGL::GetInstance().DeleteTexture(m_texture);
+}
+
+GLuint TextureHolder::GetGLTexture()
+{
+   if (m_page != nullptr)
+      return m_page->GetGLTexture();
 
+   if (m_pending != nullptr)
+      Upload();
+
+   return m_texture;
+}
+
+void TextureHolder::Upload()
+{
    glGenTextures(1, &m_texture);
    glBindTexture(GL_TEXTURE_2D, m_texture);
 
@@ -93,43 +199,245 @@ TextureHolder::TextureHolder(const string& file)
    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-   // Load the surface's data into the texture
-   glTexImage2D(GL_TEXTURE_2D, 0, ncols, surface->w, surface->h, 0,
-                texture_format, GL_UNSIGNED_BYTE, surface->pixels);
+   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_width, m_height, 0,
+                GL_RGBA, GL_UNSIGNED_BYTE, m_pending);
 
-   SDL_FreeSurface(surface);
+   m_pending = nullptr;
+   m_image.reset();
 }
 
-TextureHolder::TextureHolder(int width, int height, const GLubyte *data,
-                             GLuint fmt, GLuint filter)
+AtlasPage::~AtlasPage()
 {
-   glGenTextures(1, &m_texture);
-   glBindTexture(GL_TEXTURE_2D, m_texture);
+   OpenGL::GetInstance().DeleteTexture(m_texture);
+}
 
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+//
+// Finds space on the shelf that wastes the least height, or opens a new
+// shelf if none fits.
+//
+bool AtlasPage::Allocate(int width, int height, int& x, int& y)
+{
+   Shelf *best = NULL;
+   for (Shelf& shelf : m_shelves) {
+      if (shelf.height >= height && shelf.used + width <= m_size
+          && (best == NULL || shelf.height < best->height))
+         best = &shelf;
+   }
 
-   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
-                fmt, GL_UNSIGNED_BYTE, data);
+   if (best == NULL) {
+      if (m_top + height > m_size || width > m_size)
+         return false;
+
+      m_shelves.push_back(Shelf { m_top, height, 0 });
+      m_top += height;
+      best = &m_shelves.back();
+   }
+
+   x = best->used;
+   y = best->y;
+   best->used += width;
+
+   return true;
 }
 
-TextureHolder::~TextureHolder()
+void AtlasPage::Queue(int x, int y, int width, int height,
+                      vector<GLubyte>&& texels)
 {
-   glDeleteTextures(1, &m_texture);
+   m_pending.push_back(PendingImage { x, y, width, height, std::move(texels) });
+   m_dirty = true;
 }
 
-Texture Texture::Load(const string& fileName)
+GLuint AtlasPage::GetGLTexture()
+{
+   if (m_dirty)
+      Flush();
+
+   return m_texture;
+}
+
+void AtlasPage::Flush()
+{
+   lock_guard<mutex> lock(theLock);
+
+   if (m_texture == 0) {
+      glGenTextures(1, &m_texture);
+      glBindTexture(GL_TEXTURE_2D, m_texture);
+
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_size, m_size, 0,
+                   GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+   }
+   else
+      glBindTexture(GL_TEXTURE_2D, m_texture);
+
+   glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+   for (const PendingImage& image : m_pending)
+      glTexSubImage2D(GL_TEXTURE_2D, 0, image.x, image.y,
+                      image.width, image.height,
+                      GL_RGBA, GL_UNSIGNED_BYTE, image.texels.data());
+   glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+   m_pending.clear();
+   m_dirty = false;
+}
+
+TextureAtlas& TextureAtlas::GetInstance()
+{
+   static TextureAtlas atlas;
+   return atlas;
+}
+
+//
+// Copies the RGBA image into the atlas and returns a holder for its
+// region, or NULL if it is too large to share a texture. Must be
+// called with theLock held.
+//
+TextureHolder *TextureAtlas::Add(int imageWidth, int imageHeight,
+                                 const GLubyte *rgba)
+{
+   if (imageWidth > MAX_IMAGE_SIZE || imageHeight > MAX_IMAGE_SIZE)
+      return NULL;
+
+   if (m_pageSize == 0)
+      m_pageSize = min(2048, OpenGL::GetInstance().GetMaxTextureSize());
+
+   const int width = imageWidth + 2*PADDING;
+   const int height = imageHeight + 2*PADDING;
+
+   int x = 0, y = 0;
+   AtlasPage *target = NULL;
+   for (unique_ptr<AtlasPage>& page : m_pages) {
+      if (page->Allocate(width, height, x, y)) {
+         target = page.get();
+         break;
+      }
+   }
+
+   if (target == NULL) {
+      m_pages.emplace_back(new AtlasPage(m_pageSize));
+      target = m_pages.back().get();
+      if (!target->Allocate(width, height, x, y))
+         return NULL;
+   }
+
+   // Without a GL context only the placement is needed
+   if (!OpenGL::GetInstance().IsHeadless()) {
+      // Extend the edge pixels into the padding
+      vector<GLubyte> pixels(width * height * 4);
+      for (int j = 0; j < height; j++) {
+         const int sy = min(max(j - PADDING, 0), imageHeight - 1);
+         const GLubyte *row = rgba + sy * imageWidth * 4;
+
+         for (int i = 0; i < width; i++) {
+            const int sx = min(max(i - PADDING, 0), imageWidth - 1);
+            copy(row + sx*4, row + sx*4 + 4, &pixels[(j * width + i) * 4]);
+         }
+      }
+
+      target->Queue(x, y, width, height, std::move(pixels));
+   }
+
+   const float size = m_pageSize;
+   return new TextureHolder(target, imageWidth, imageHeight,
+                            (x + PADDING) / size,
+                            (y + PADDING) / size,
+                            (x + PADDING + imageWidth) / size,
+                            (y + PADDING + imageHeight) / size);
+}
+
+void TextureAtlas::Clear()
+{
+   m_pages.clear();
+}
+
+//
+// Returns a new holder for the image. Decoding happens outside the
+// lock so several threads can load different textures at once.
+//
+static TextureHolder *LoadHolder(const string& fileName, bool sprite)
 {
-   TextureCache::iterator it = theCache.find(fileName);
-   if (it != theCache.end())
-      return Texture((*it).second, false);
+   int width, height;
+   const GLubyte *texels;
+   shared_ptr<const ImageData> image;
+
+   const AssetPack& pack = AssetPack::GetInstance();
+   if (const PackEntry *entry = pack.Find(fileName, PACK_TEXTURE)) {
+      width = entry->params[0];
+      height = entry->params[1];
+      texels = static_cast<const GLubyte*>(pack.GetData(entry));
+   }
    else {
-      TextureHolder *holder = new TextureHolder(fileName);
-      theCache[fileName] = holder;
-      return Texture(holder, false);
+      image = AssetLoader::GetInstance().TakeImage(fileName);
+      if (!image) {
+         shared_ptr<ImageData> decoded = make_shared<ImageData>();
+         DecodeImage(LocateResource(fileName), *decoded);
+         image = decoded;
+      }
+
+      width = image->width;
+      height = image->height;
+      texels = image->texels.data();
+   }
+
+   if (sprite) {
+      lock_guard<mutex> lock(theLock);
+      if (TextureHolder *holder =
+          TextureAtlas::GetInstance().Add(width, height, texels))
+         return holder;
+   }
+
+   if (!IsPowerOfTwo(width))
+      cerr << "Warning: " << fileName << " width not a power of 2" << endl;
+   if (!IsPowerOfTwo(height))
+      cerr << "Warning: " << fileName << " height not a power of 2" << endl;
+
+   const int maxSize = OpenGL::GetInstance().GetMaxTextureSize();
+   if (width > maxSize || height > maxSize)
+      cerr << "Warning: " << fileName << " bigger than max OpenGL texture" << endl;
+
+   return new TextureHolder(width, height, texels, image);
+}
+
+static TextureHolder *LoadCached(const string& fileName, bool sprite)
+{
+   {
+      lock_guard<mutex> lock(theLock);
+
+      TextureCache::iterator it = theCache.find(fileName);
+      if (it != theCache.end())
+         return (*it).second;
    }
+
+   TextureHolder *holder = LoadHolder(fileName, sprite);
+
+   lock_guard<mutex> lock(theLock);
+
+   // Another thread may have loaded the same file in the meantime
+   pair<TextureCache::iterator, bool> result =
+      theCache.insert(make_pair(fileName, holder));
+   if (!result.second)
+      delete holder;
+
+   return (*result.first).second;
+}
+
+Texture Texture::Load(const string& fileName)
+{
+   return Texture(LoadCached(fileName, false), false);
+}
+
+//
+// Load an image which is only drawn as a sprite. Small images are
+// placed in a shared atlas texture so texture coordinates must be
+// passed through MapU and MapV and lie between zero and one.
+//
+Texture Texture::LoadSprite(const string& fileName)
+{
+   return Texture(LoadCached(fileName, true), false);
 }
 
 Texture Texture::Make(int width, int height, const GLubyte *data,
@@ -140,10 +448,14 @@ Texture Texture::Make(int width, int height, const GLubyte *data,
 
 void Texture::UnloadAll()
 {
+   lock_guard<mutex> lock(theLock);
+
    for (auto& it : theCache)
       delete it.second;
 
    theCache.clear();
+
+   TextureAtlas::GetInstance().Clear();
 }
 
 Texture::Texture(TextureHolder *holder, bool owner)
@@ -208,3 +520,19 @@ int Texture::GetHeight() const
    else
       return m_holder->GetHeight();
 }
+
+float Texture::MapU(float u) const
+{
+   if (m_holder == nullptr)
+      return u;
+   else
+      return m_holder->MapU(u);
+}
+
+float Texture::MapV(float v) const
+{
+   if (m_holder == nullptr)
+      return v;
+   else
+      return m_holder->MapV(v);
+}
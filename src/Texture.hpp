@@ -25,7 +25,11 @@ public:
    int GetWidth() const;
    int GetHeight() const;
 
+   float MapU(float u) const;
+   float MapV(float v) const;
+
    static Texture Load(const string& fileName);
+   static Texture LoadSprite(const string& fileName);
    static Texture Make(int width, int height, const GLubyte *data,
                        GLuint fmt, GLuint filter=GL_LINEAR);
    static void UnloadAll();
@@ -0,0 +1,228 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "ThreadPool.hpp"
+
+namespace {
+   // The pool this thread works for and its queue number
+   thread_local ThreadPool* currentPool = nullptr;
+   thread_local int currentIndex = -1;
+
+   mutex sharedLock;
+   unique_ptr<ThreadPool> sharedPool;
+   int sharedThreads = 0;
+}
+
+//
+// Creates nthreads workers, or one per processor if nthreads is zero.
+//
+ThreadPool::ThreadPool(int nthreads)
+   : m_queued(0)
+{
+   if (nthreads <= 0)
+      nthreads = max(1u, thread::hardware_concurrency());
+
+   for (int i = 0; i <= nthreads; i++)
+      m_queues.emplace_back(new Queue);
+
+   for (int i = 0; i < nthreads; i++)
+      m_threads.emplace_back(&ThreadPool::Worker, this, i);
+}
+
+//
+// Runs any tasks still queued then joins the workers.
+//
+ThreadPool::~ThreadPool()
+{
+   {
+      lock_guard<mutex> lock(m_sleepLock);
+      m_stop = true;
+   }
+
+   m_wake.notify_all();
+
+   for (thread& t : m_threads)
+      t.join();
+}
+
+//
+// Sets the number of workers in the shared pool. This must be called
+// before anything uses the pool.
+//
+void ThreadPool::Initialise(int nthreads)
+{
+   lock_guard<mutex> lock(sharedLock);
+
+   if (sharedPool)
+      Die("Thread pool is already running");
+
+   sharedThreads = nthreads;
+}
+
+ThreadPool& ThreadPool::GetInstance()
+{
+   lock_guard<mutex> lock(sharedLock);
+
+   if (!sharedPool)
+      sharedPool.reset(new ThreadPool(sharedThreads));
+
+   return *sharedPool;
+}
+
+//
+// Queues a task without any way to wait for it.
+//
+void ThreadPool::Spawn(function<void()> task)
+{
+   const int index = currentPool == this ? currentIndex : m_threads.size();
+
+   // Counted first so the task cannot be taken while the count is zero
+   m_queued++;
+
+   {
+      Queue& queue = *m_queues[index];
+      lock_guard<mutex> lock(queue.lock);
+      queue.tasks.push_back(move(task));
+   }
+
+   // Take the lock so a worker about to sleep cannot miss this
+   { lock_guard<mutex> lock(m_sleepLock); }
+   m_wake.notify_one();
+}
+
+bool ThreadPool::TakeFrom(Queue& queue, bool back, function<void()>& task)
+{
+   lock_guard<mutex> lock(queue.lock);
+
+   if (queue.tasks.empty())
+      return false;
+
+   if (back) {
+      task = move(queue.tasks.back());
+      queue.tasks.pop_back();
+   }
+   else {
+      task = move(queue.tasks.front());
+      queue.tasks.pop_front();
+   }
+
+   m_queued--;
+   return true;
+}
+
+//
+// Finds a task for the given queue number: the newest from its own
+// queue, then the oldest from the shared queue, then the oldest from
+// each other worker in turn.
+//
+bool ThreadPool::Take(int index, function<void()>& task)
+{
+   const int nqueues = m_queues.size();
+   const int shared = nqueues - 1;
+
+   if (m_queued == 0)
+      return false;
+
+   if (index != shared && TakeFrom(*m_queues[index], true, task))
+      return true;
+
+   if (TakeFrom(*m_queues[shared], false, task))
+      return true;
+
+   for (int i = 1; i < nqueues; i++) {
+      const int victim = (index + i) % nqueues;
+      if (victim != shared && TakeFrom(*m_queues[victim], false, task))
+         return true;
+   }
+
+   return false;
+}
+
+//
+// Runs one queued task on the calling thread if there is any. Used to
+// help out while waiting for other tasks.
+//
+bool ThreadPool::RunPending()
+{
+   const int index = currentPool == this ? currentIndex : m_threads.size();
+
+   function<void()> task;
+   if (!Take(index, task))
+      return false;
+
+   task();
+   return true;
+}
+
+void ThreadPool::Worker(int index)
+{
+   currentPool = this;
+   currentIndex = index;
+
+   for (;;) {
+      function<void()> task;
+      if (Take(index, task)) {
+         task();
+         continue;
+      }
+
+      unique_lock<mutex> lock(m_sleepLock);
+      m_wake.wait(lock, [this] { return m_stop || m_queued > 0; });
+
+      if (m_stop && m_queued == 0)
+         return;
+   }
+}
+
+TaskGroup::TaskGroup(ThreadPool& pool)
+   : m_pool(pool)
+{
+
+}
+
+TaskGroup::~TaskGroup()
+{
+   Wait();
+}
+
+void TaskGroup::Finished()
+{
+   ThreadPool& pool = m_pool;
+   vector<function<void()>> continuations;
+
+   {
+      lock_guard<mutex> lock(m_lock);
+      if (--m_pending == 0) {
+         continuations.swap(m_continuations);
+         m_done.notify_all();
+      }
+   }
+
+   // The group may be gone once the lock is released
+   for (function<void()>& f : continuations)
+      pool.Spawn(move(f));
+}
+
+//
+// Returns once every task has finished, running queued tasks meanwhile.
+//
+void TaskGroup::Wait()
+{
+   for (;;) {
+      {
+         lock_guard<mutex> lock(m_lock);
+         if (m_pending == 0)
+            return;
+      }
+
+      if (!m_pool.RunPending()) {
+         // Nothing to help with so sleep until a task finishes or
+         // there might be more work to do
+         unique_lock<mutex> lock(m_lock);
+         m_done.wait_for(lock, chrono::milliseconds(1),
+                         [this] { return m_pending == 0; });
+      }
+   }
+}
@@ -0,0 +1,164 @@
+//
+// Copyright (C) 2020  Nick Gasson
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#pragma once
+
+#include "Platform.hpp"
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+//
+// A fixed set of worker threads shared by the whole program. Each worker
+// has its own queue: tasks started from a worker go on the back of its
+// queue and it takes from the back, so the most recent and cache-warm
+// work runs first. Idle workers steal from the front of other queues.
+// Tasks started from other threads go on a shared queue.
+//
+class ThreadPool {
+public:
+   explicit ThreadPool(int nthreads=0);
+   ThreadPool(const ThreadPool&) = delete;
+   ~ThreadPool();
+
+   static void Initialise(int nthreads);
+   static ThreadPool& GetInstance();
+
+   template <typename F>
+   auto Submit(F&& f) -> future<decltype(f())>;
+
+   void Spawn(function<void()> task);
+   bool RunPending();
+
+   template <typename F>
+   void ParallelFor(int begin, int end, int grain, F f);
+
+   int GetThreadCount() const { return m_threads.size(); }
+
+private:
+   struct Queue {
+      mutex lock;
+      deque<function<void()>> tasks;
+   };
+
+   void Worker(int index);
+   bool Take(int index, function<void()>& task);
+   bool TakeFrom(Queue& queue, bool back, function<void()>& task);
+
+   // One queue per worker followed by the shared queue
+   vector<unique_ptr<Queue>> m_queues;
+   vector<thread> m_threads;
+
+   atomic<int> m_queued;
+   mutex m_sleepLock;
+   condition_variable m_wake;
+   bool m_stop = false;
+};
+
+//
+// Tasks that can be waited for together. Waiting runs other tasks from
+// the pool rather than blocking so it is safe from inside a task. Then
+// adds a continuation that starts on the pool once all the tasks added
+// before it have finished.
+//
+class TaskGroup {
+public:
+   explicit TaskGroup(ThreadPool& pool = ThreadPool::GetInstance());
+   TaskGroup(const TaskGroup&) = delete;
+   ~TaskGroup();
+
+   template <typename F>
+   void Run(F&& f);
+
+   template <typename F>
+   void Then(F&& f);
+
+   void Wait();
+
+private:
+   void Finished();
+
+   ThreadPool& m_pool;
+   mutex m_lock;
+   condition_variable m_done;
+   int m_pending = 0;
+   vector<function<void()>> m_continuations;
+};
+
+template <typename F>
+auto ThreadPool::Submit(F&& f) -> future<decltype(f())>
+{
+   typedef decltype(f()) Result;
+
+   // std::function must be copyable so the task is shared
+   auto task = make_shared<packaged_task<Result()>>(std::forward<F>(f));
+   future<Result> result = task->get_future();
+
+   Spawn([task] { (*task)(); });
+   return result;
+}
+
+//
+// Calls f(i) for each i in [begin, end) split into tasks of at least
+// grain iterations. The calling thread helps until all are done.
+//
+template <typename F>
+void ThreadPool::ParallelFor(int begin, int end, int grain, F f)
+{
+   // A few tasks per thread so idle workers have something to steal
+   const int count = end - begin;
+   const int chunks = max(1, min(count / max(grain, 1),
+                                 (GetThreadCount() + 1) * 4));
+
+   TaskGroup group(*this);
+   for (int c = 1; c < chunks; c++) {
+      const int first = begin + (count * c) / chunks;
+      const int last = begin + (count * (c + 1)) / chunks;
+      group.Run([first, last, &f] {
+         for (int i = first; i < last; i++)
+            f(i);
+      });
+   }
+
+   // The first chunk runs here
+   const int last = begin + count / chunks;
+   for (int i = begin; i < last; i++)
+      f(i);
+
+   group.Wait();
+}
+
+template <typename F>
+void TaskGroup::Run(F&& f)
+{
+   {
+      lock_guard<mutex> lock(m_lock);
+      m_pending++;
+   }
+
+   m_pool.Spawn([this, f = std::forward<F>(f)]() mutable {
+      f();
+      Finished();
+   });
+}
+
+template <typename F>
+void TaskGroup::Then(F&& f)
+{
+   unique_lock<mutex> lock(m_lock);
+   if (m_pending == 0) {
+      lock.unlock();
+      m_pool.Spawn(std::forward<F>(f));
+   }
+   else
+      m_continuations.emplace_back(std::forward<F>(f));
+}
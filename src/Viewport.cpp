@@ -9,14 +9,33 @@
 #include "ObjectGrid.hpp"
 
 Viewport::Viewport()
-   : adjustX(0), adjustY(0), levelWidth(0), levelHeight(0)
+   : adjustX(0), adjustY(0), lastX(0), lastY(0),
+     levelWidth(0), levelHeight(0), screenWidth(0), screenHeight(0)
 {
 }
 
-void Viewport::SetXAdjust(int x)
+//
+// The adjusts used for drawing are interpolated between the position
+// saved at the start of the last simulation step and the current one.
+//
+int Viewport::GetXAdjust() const
+{
+   return OpenGL::GetInstance().Interpolate(lastX, adjustX);
+}
+
+int Viewport::GetYAdjust() const
+{
+   return OpenGL::GetInstance().Interpolate(lastY, adjustY);
+}
+
+void Viewport::SavePosition()
 {
-   const int screenWidth = OpenGL::GetInstance().GetWidth();
+   lastX = adjustX;
+   lastY = adjustY;
+}
 
+void Viewport::SetXAdjust(int x)
+{
    adjustX = x;
    if (adjustX < 0)
       adjustX = 0;
@@ -26,8 +45,6 @@ void Viewport::SetXAdjust(int x)
 
 void Viewport::SetYAdjust(int y)
 {
-   const int screenHeight = OpenGL::GetInstance().GetHeight();
-
    adjustY = y;
    if (adjustY < 0)
       adjustY = 0;
@@ -42,9 +59,6 @@ void Viewport::SetYAdjust(int y)
 //
 bool Viewport::PointInScreen(int xpos, int ypos, int width, int height)
 {
-   const int screenWidth = OpenGL::GetInstance().GetWidth();
-   const int screenHeight = OpenGL::GetInstance().GetHeight();
-
    return ((xpos + width > adjustX && xpos - adjustX < screenWidth)
            && (ypos + height > adjustY && ypos - adjustY < screenHeight));
 }
@@ -10,22 +10,29 @@ class Viewport {
 public:
    Viewport();
 
-   int GetXAdjust() const { return adjustX; }
-   int GetYAdjust() const { return adjustY; }
+   int GetXAdjust() const;
+   int GetYAdjust() const;
    void SetXAdjust(int x);
    void SetYAdjust(int y);
+   void SavePosition();
 
    int GetLevelWidth() const { return levelWidth; }
    int GetLevelHeight() const { return levelHeight; }
    void SetLevelWidth(int w) { levelWidth = w; }
    void SetLevelHeight(int h) { levelHeight = h; }
 
+   int GetScreenWidth() const { return screenWidth; }
+   int GetScreenHeight() const { return screenHeight; }
+   void SetScreenSize(int w, int h) { screenWidth = w; screenHeight = h; }
+
    bool ObjectInScreen(int xpos, int ypos, int width, int height);
    bool PointInScreen(int xpos, int ypos, int width, int height);
 
 private:
    int adjustX, adjustY;
+   int lastX, lastY;
    int levelWidth, levelHeight;
+   int screenWidth, screenHeight;
 };
 
 #endif